@@ -0,0 +1,24 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#ifndef COMPILER_CONFIG_HPP
+#define COMPILER_CONFIG_HPP
+
+#define FERAL_VERSION_MAJOR 0
+#define FERAL_VERSION_MINOR 0
+#define FERAL_VERSION_PATCH 7
+
+#define BUILD_CXX_COMPILER "GNU 12.2.0"
+#define BUILD_DATE "Mon Oct 19, 2026 at 06:00:49"
+
+#endif // COMPILER_CONFIG_HPP
@@ -29,6 +29,7 @@ extern const size_t OPT_G;
 extern const size_t OPT_H;
 extern const size_t OPT_I;
 extern const size_t OPT_L;
+extern const size_t OPT_O; // register form byte code (fused instructions)
 extern const size_t OPT_P; // show parse tree
 extern const size_t OPT_R; // recursively show everything (ex. FrontEnd->VM->Import->FrontEnd...)
 extern const size_t OPT_S;
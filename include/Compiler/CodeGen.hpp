@@ -19,6 +19,9 @@
 namespace gen
 {
 bool generate(const ptree_t *ptree, bcode_t &bc);
+// fuse stack instruction sequences into register form instructions
+// which work directly on variables/constants (used with -o flag)
+void regify(bcode_t &bc);
 }
 
 #endif // COMPILER_CODE_GEN_HPP
@@ -41,6 +41,7 @@ enum TokType
 	TOK_IN,
 	TOK_WHILE,
 	TOK_RETURN,
+	TOK_YIELD,
 	TOK_CONTINUE,
 	TOK_BREAK,
 	TOK_TRUE,
@@ -41,15 +41,22 @@ enum OpCodes
 
 	OP_FNCL,     // call a function (string arg - argument format)
 	OP_MEM_FNCL, // call a member function (string arg - argument format)
+	OP_TAIL_FNCL,	  // OP_FNCL in tail position (return f(...)) - reuses the caller's frame
+	OP_TAIL_MEM_FNCL, // OP_MEM_FNCL in tail position (return x.f(...))
 	OP_ATTR,     // get attribute from an object (operand is attribute name)
 
 	OP_RET,	     // return - bool - false pushes nil on top of stack
+	OP_YIELD,    // suspends the generator function, leaving the value on top of stack for
+		     // its caller - execution resumes from the next instruction
 	OP_CONTINUE, // size_t operand - jump to
 	OP_BREAK,    // size_t operand - jump to
 
 	// for loops
 	OP_PUSH_LOOP, // marks a loop's beginning for variable stack
 	OP_POP_LOOP,  // marks a loop's ending for variable stack
+	OP_FOR_ITER,  // size_t operand - pops iterable, pushes its next value or jumps to operand
+		      // if exhausted - must be followed by the loop variable creation
+		      // (LOAD <name>; CREATE or CREATE_R <name>)
 
 	// for 'or' keyword
 	OP_PUSH_JMP,  // marks the position to jump to if 'or' exists in an expression
@@ -57,6 +64,13 @@ enum OpCodes
 		      // OP_PUSH_JMP)
 	OP_POP_JMP,   // unmarks the position to jump to if 'or' exists in an expression
 
+	// register form instructions (generated by gen::regify() with -o flag)
+	// operands are variables/constants (reg_t) instead of values on the vm stack
+	OP_CREATE_R, // create a new variable (string operand - name) from value on stack
+	OP_MOV_R,    // size_t operand (reg op) - store value of reg op's rhs in lhs variable
+	OP_UNOP_R,   // size_t operand (reg op) - call reg op's name on lhs
+	OP_BINOP_R,  // size_t operand (reg op) - call reg op's name on lhs with rhs as argument
+
 	_OP_LAST,
 };
 
@@ -87,6 +101,24 @@ union op_data_t
 	bool b;
 };
 
+// operand for register form instructions - a variable (ODT_IDEN) or a constant
+struct reg_t
+{
+	size_t idx;
+	OpDataType dtype;
+	op_data_t data;
+};
+
+// out of line operands for register form instructions
+struct reg_op_t
+{
+	reg_t lhs;
+	reg_t rhs;
+	char *name; // function/operator name (nullptr if unused)
+};
+
+struct fn_proto_t;
+
 struct op_t
 {
 	// src_id is set afterwards since srcfile_t is usually made at later time
@@ -100,6 +132,9 @@ struct op_t
 class bcode_t
 {
 	std::vector<op_t> m_bcode;
+	std::vector<reg_op_t> m_regs;
+	// function prototypes for OP_MKFN (owns a reference to each)
+	std::vector<fn_proto_t *> m_protos;
 
 public:
 	~bcode_t();
@@ -111,9 +146,27 @@ public:
 	void addsz(const size_t &idx, const OpCodes op, const std::string &data);
 	void addsz(const size_t &idx, const OpCodes op, const size_t &data);
 
+	// returns the location of the added register operands
+	size_t addreg(const reg_op_t &reg);
+	// takes the reference of proto, returns its location
+	size_t addproto(fn_proto_t *proto);
+
 	OpCodes at(const size_t &pos) const;
 	void updatesz(const size_t &pos, const size_t &value);
 
+	inline const reg_op_t &reg(const size_t &pos) const
+	{
+		return m_regs[pos];
+	}
+	inline fn_proto_t *proto(const size_t &pos) const
+	{
+		return m_protos[pos];
+	}
+	inline const std::vector<fn_proto_t *> &protos() const
+	{
+		return m_protos;
+	}
+
 	inline const std::vector<op_t> &get() const
 	{
 		return m_bcode;
@@ -0,0 +1,155 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+
+#ifndef VM_PROFILER_HPP
+#define VM_PROFILER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "OpCodes.hpp"
+#include "Vars/Base.hpp"
+
+/*
+ * opcode level execution profiler (--profile=ops)
+ * counts executions and accumulates (self) time per opcode, per instruction location and
+ * per function - the time between two instructions is charged to the innermost one
+ * exec() uses it only when vm_state_t::prof is set (no overhead otherwise)
+ */
+class vm_prof_t
+{
+public:
+	struct stat_t
+	{
+		size_t count;
+		uint64_t time; // nanoseconds
+	};
+
+private:
+	struct stats_t
+	{
+		stat_t ops[_OP_LAST];
+		std::unordered_map<uint64_t, stat_t> locs;
+		std::unordered_map<uint64_t, stat_t> fns;
+		std::unordered_map<nativefnptr_t, stat_t> natives;
+	};
+
+	// profilers of running thread copies (all of them owned by the main vm's profiler) - their
+	// stats are merged into m_threads_stats when their thread is done, never while running
+	std::vector<vm_prof_t *> m_children;
+	vm_prof_t *m_parent;
+	stats_t m_threads_stats;
+	std::mutex m_children_mtx;
+
+	stat_t m_ops[_OP_LAST];
+	// key: loc_key(src_id, idx)
+	std::unordered_map<uint64_t, stat_t> m_locs;
+	// key: loc_key(src_id, body begin) - inclusive time
+	std::unordered_map<uint64_t, stat_t> m_fns;
+	std::unordered_map<nativefnptr_t, stat_t> m_natives;
+
+	// instruction being executed by innermost exec() and its location stat
+	OpCodes m_curr_op;
+	stat_t *m_curr_loc;
+	uint64_t m_last;
+	// instructions of outer exec() calls
+	std::vector<std::pair<OpCodes, stat_t *>> m_frames;
+
+	inline void charge(const uint64_t &t)
+	{
+		if(m_curr_op == _OP_LAST) return;
+		m_ops[m_curr_op].time += t - m_last;
+		m_curr_loc->time += t - m_last;
+	}
+
+public:
+	vm_prof_t();
+	~vm_prof_t();
+
+	static inline uint64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+	}
+	static inline uint64_t loc_key(const size_t &src_id, const size_t &idx)
+	{
+		return (uint64_t)src_id << 40 | (uint64_t)idx;
+	}
+
+	// called before executing each instruction
+	inline void op(const op_t &op)
+	{
+		uint64_t t = now();
+		charge(t);
+		m_curr_op  = op.op;
+		m_curr_loc = &m_locs[loc_key(op.src_id, op.idx)];
+		m_last	   = t;
+		++m_ops[op.op].count;
+		++m_curr_loc->count;
+	}
+	// called on entry and exit of exec()
+	void frame_push();
+	void frame_pop();
+
+	void fn_add(const size_t &src_id, const size_t &begin, const uint64_t &time);
+	void native_add(nativefnptr_t fn, const uint64_t &time);
+
+	// profiler for a thread copy of the vm (owned by the main vm's profiler)
+	vm_prof_t *thread_copy();
+	// called by a thread copy of the vm once its thread is done - merges the stats into the
+	// main profiler and deletes this one
+	void thread_done();
+
+	// writes text report to stderr and json report to json_path (if not empty)
+	void report(vm_state_t &vm, const std::string &json_path);
+};
+
+#define SAMPLE_HZ_DEFAULT 100
+
+// frame of the lightweight exec() chain which is walked by the sampling profiler
+struct exec_frame_t
+{
+	exec_frame_t *prev;
+	size_t src_id;
+	size_t begin; // function body begin, 0 for source level code
+	const op_t *volatile op;
+};
+
+/*
+ * sampling profiler (--profile=sample[:hz])
+ * SIGPROF (setitimer(ITIMER_PROF)) is handled by the thread that is executing, which
+ * records its exec() frame chain - exec() maintains the chain only when sampling is active
+ */
+namespace sampler
+{
+bool start(const size_t &hz);
+void stop();
+bool active();
+
+// called by exec() on entry/exit (registers the thread on first use) and periodically between
+// instructions to aggregate the recorded samples outside of the signal handler
+void frame_push(exec_frame_t &frame);
+void frame_pop(exec_frame_t &frame);
+void safe_point();
+
+// writes collapsed stacks (flamegraph.pl format) to path, one root frame per thread
+void report(vm_state_t &vm, const std::string &path);
+} // namespace sampler
+
+#endif // VM_PROFILER_HPP
@@ -14,6 +14,7 @@
 #ifndef VM_SRC_FILE_HPP
 #define VM_SRC_FILE_HPP
 
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -43,7 +44,11 @@ class srcfile_t
 	std::string m_dir;
 	std::string m_path;
 	std::string m_data; // content
-	std::vector<src_col_range_t> m_cols;
+	// line divisions - built lazily (only required when reporting errors)
+	mutable std::vector<src_col_range_t> m_cols;
+	// index in m_data till which m_cols has been generated
+	mutable size_t m_cols_till;
+	mutable std::mutex m_cols_mtx;
 
 	bcode_t m_bcode;
 
@@ -61,7 +66,7 @@ public:
 	srcfile_t(const std::string &dir, const std::string &path, const bool is_main = false);
 
 	/**
-	 * \brief Loads the file at m_path
+	 * \brief Loads the file at m_path (using mmap)
 	 *
 	 * \return Errors E_OK on success, anything else on failure
 	 */
@@ -69,16 +74,21 @@ public:
 
 	/**
 	 * \brief Append content to an instance
+	 * Line divisions for the content are generated lazily, when required.
 	 *
 	 * \param data The content to be appended
 	 */
 	void add_data(const std::string &data);
+
 	/**
-	 * \brief Append line divisions to an instance
+	 * \brief Find the line (0 based) containing the index in code
 	 *
-	 * \param cols Line divisions to be appended (vector of src_col_range_t)
+	 * \param idx Index in the code
+	 * \param line Set to the line number of the found line
+	 * \param range Set to the column range of the found line
+	 * \return bool true if found, false if idx is out of range
 	 */
-	void add_cols(const std::vector<src_col_range_t> &cols);
+	bool find_line(const size_t &idx, size_t &line, src_col_range_t &range) const;
 
 	/**
 	 * \brief Return the id of the instance
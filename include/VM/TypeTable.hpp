@@ -0,0 +1,199 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+
+#ifndef VM_TYPE_TABLE_HPP
+#define VM_TYPE_TABLE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Vars/Base.hpp"
+
+struct vm_state_t;
+
+// fast path for 'for x in <iterable>' - returns next value of the iterable (nullptr if
+// exhausted) which is bound to the loop variable as is (never copied)
+// reuse is the loop variable of previous iteration if nothing else refers to it, in which case
+// it can be updated in place and returned
+typedef var_base_t *(*iter_next_fn_t)(vm_state_t &vm, var_base_t *iterable, var_base_t *reuse,
+				      const size_t &src_id, const size_t &idx);
+
+/*
+ * map which is read without locking (read-copy-update)
+ * readers follow an atomic pointer to an immutable version of the map; a writer (serialized by
+ * the owner) publishes an updated copy in its place and retires the replaced version with the
+ * owner's epoch at the time, which the owner frees once no reader can still be using it
+ * while the map is not shared between threads, there are no concurrent readers and writers
+ * update the current version in place instead
+ */
+template<typename K, typename V> class rcu_map_t
+{
+public:
+	typedef std::unordered_map<K, V> map_t;
+
+private:
+	std::atomic<map_t *> m_cur;
+	// replaced versions and the epoch in which they were replaced
+	std::vector<std::pair<std::uint64_t, map_t *>> m_retired;
+
+public:
+	rcu_map_t() : m_cur(new map_t()) {}
+	~rcu_map_t()
+	{
+		for(auto &m : m_retired) delete m.second;
+		delete m_cur.load();
+	}
+
+	inline const map_t &get() const
+	{
+		return *m_cur.load();
+	}
+	// the value of key, def if there is none
+	inline V find(const K &key, const V &def) const
+	{
+		const map_t &m = get();
+		auto it	       = m.find(key);
+		return it == m.end() ? def : it->second;
+	}
+
+	// epoch is 0 if the map is not shared
+	void set(const K &key, const V &val, const std::uint64_t &epoch)
+	{
+		map_t *cur = m_cur.load(std::memory_order_relaxed);
+		if(epoch == 0) {
+			(*cur)[key] = val;
+			return;
+		}
+		map_t *next = new map_t(*cur);
+		(*next)[key] = val;
+		m_cur.store(next);
+		m_retired.push_back({epoch, cur});
+	}
+
+	// frees the versions retired before min_epoch
+	void reclaim(const std::uint64_t &min_epoch)
+	{
+		size_t kept = 0;
+		for(auto &m : m_retired) {
+			if(m.first < min_epoch) delete m.second;
+			else m_retired[kept++] = m;
+		}
+		m_retired.resize(kept);
+	}
+};
+
+/*
+ * type functions, native iteration functions and type names
+ * one table is shared by a vm and all its thread copies so that whatever any of them registers
+ * (for example by a 'let f in vec_t = ...' run in a thread) is visible to all
+ * lookups - which are on the hot path of every method call - never lock; registration is
+ * serialized with a mutex
+ * replaced versions of the maps are freed with epochs: each vm has a reader which announces the
+ * current epoch while it looks something up, and each update advances the epoch and then frees
+ * the versions retired before the oldest epoch still announced
+ */
+class type_table_t
+{
+public:
+	// one per vm, which must be used by one thread at a time
+	class reader_t
+	{
+		friend class type_table_t;
+		// epoch in which the current lookup began, 0 if there is none
+		std::atomic<std::uint64_t> m_epoch;
+
+	public:
+		reader_t() : m_epoch(0) {}
+	};
+
+private:
+	typedef rcu_map_t<std::string, var_base_t *> fns_t;
+
+	// announces a lookup by a reader for its duration
+	class read_guard_t
+	{
+		reader_t *m_reader;
+
+	public:
+		inline read_guard_t(const type_table_t &table, reader_t &reader) : m_reader(nullptr)
+		{
+			// nothing is retired before the table is shared
+			if(!table.m_shared.load(std::memory_order_relaxed)) return;
+			m_reader = &reader;
+			m_reader->m_epoch.store(table.m_epoch.load());
+		}
+		inline ~read_guard_t()
+		{
+			if(m_reader) m_reader->m_epoch.store(0, std::memory_order_release);
+		}
+	};
+
+	rcu_map_t<std::uintptr_t, fns_t *> m_fns;
+	// functions for all types (type_id<var_all_t>())
+	fns_t *m_all_fns;
+	rcu_map_t<std::uintptr_t, iter_next_fn_t> m_iter_next_fns;
+	rcu_map_t<std::uintptr_t, std::string> m_names;
+	std::mutex m_write_mtx;
+	// set once the table is used by more than one thread
+	std::atomic<bool> m_shared;
+	std::atomic<std::uint64_t> m_epoch;
+	std::vector<reader_t *> m_readers;
+
+	// with m_write_mtx held - the epoch to retire replaced versions with (0 if not shared)
+	std::uint64_t begin_update();
+	// with m_write_mtx held - frees the versions no reader can be using anymore
+	void reclaim();
+
+public:
+	type_table_t();
+	~type_table_t();
+
+	// called before the table is handed to another thread
+	inline void share()
+	{
+		m_shared = true;
+	}
+
+	void add_reader(reader_t *reader);
+	void remove_reader(reader_t *reader);
+
+	// false if the type already has a function with this name
+	bool add_fn(const std::uintptr_t &type, const std::string &name, var_base_t *fn,
+		    const bool &iref);
+	// nullptr if the type (and var_all_t) has no function with this name
+	var_base_t *get_fn(reader_t &reader, const std::uintptr_t &type,
+			   const std::string &name) const;
+	inline bool has_fns(reader_t &reader, const std::uintptr_t &type) const
+	{
+		read_guard_t guard(*this, reader);
+		return m_fns.find(type, nullptr) != nullptr;
+	}
+
+	void set_iter_next_fn(const std::uintptr_t &type, iter_next_fn_t fn);
+	inline iter_next_fn_t get_iter_next_fn(reader_t &reader, const std::uintptr_t &type) const
+	{
+		read_guard_t guard(*this, reader);
+		return m_iter_next_fns.find(type, nullptr);
+	}
+
+	void set_name(const std::uintptr_t &type, const std::string &name);
+	// false if the type has no name
+	bool get_name(reader_t &reader, const std::uintptr_t &type, std::string &name) const;
+};
+
+#endif // VM_TYPE_TABLE_HPP
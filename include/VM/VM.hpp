@@ -20,16 +20,21 @@
 
 #include "DyLib.hpp"
 #include "SrcFile.hpp"
+#include "TypeTable.hpp"
 #include "Vars.hpp"
 #include "VMFailStack.hpp"
 #include "VMStack.hpp"
 
+class vm_prof_t;
+
 #define _STRINGIZE(x) #x
 #define STRINGIFY(x) _STRINGIZE(x)
 
 typedef std::vector<var_src_t *> src_stack_t;
 
 typedef std::unordered_map<std::string, var_src_t *> all_srcs_t;
+// index is the srcfile_t id, nullptr if the source with that id is not loaded in this vm
+typedef std::vector<var_src_t *> srcs_by_id_t;
 
 #define EXEC_STACK_MAX_DEFAULT 2000
 
@@ -42,6 +47,9 @@ typedef srcfile_t *(*fmod_load_fn_t)(const std::string &src_file, const std::str
 				     const size_t &flags, const bool is_main_src, Errors &err,
 				     const size_t &begin_idx, const size_t &end_idx);
 
+// called when the vm (not a thread copy) is about to be destroyed, before anything is released
+typedef void (*vm_exit_fn_t)(vm_state_t &vm);
+
 typedef bool (*mod_init_fn_t)(vm_state_t &vm, const size_t src_id, const size_t &idx);
 typedef void (*mod_deinit_fn_t)();
 #define INIT_MODULE(name) \
@@ -64,6 +72,18 @@ template<typename T, typename... Args> T *make_all(Args... args)
 	return res;
 }
 
+// a call in tail position (return f(...)) of a feral function - set by vm::exec() and
+// performed by var_fn_t::call() once the caller's frame is gone
+// fn and all the args hold a reference
+struct tail_call_t
+{
+	var_fn_t *fn;
+	size_t src_id;
+	size_t idx;
+	std::vector<var_base_t *> args;
+	std::vector<fn_assn_arg_t> assn_args;
+};
+
 struct vm_state_t
 {
 	bool exit_called;
@@ -76,8 +96,15 @@ struct vm_state_t
 	// vm fail stack
 	vm_failstack_t fails;
 
+	// pending tail call (fn is nullptr if none)
+	tail_call_t tail_call;
+
+	// execution profiler (--profile=ops), nullptr if disabled
+	vm_prof_t *prof;
+
 	src_stack_t src_stack;
 	all_srcs_t all_srcs;
+	srcs_by_id_t srcs_by_id;
 	vm_stack_t *vm_stack;
 
 	// globally common variables
@@ -96,6 +123,7 @@ struct vm_state_t
 		   const bool &is_thread_copy = false);
 	~vm_state_t();
 
+	void add_src_by_id(var_src_t *src);
 	void push_src(srcfile_t *src, const size_t &idx);
 	void push_src(const std::string &src_path);
 	void pop_src();
@@ -140,6 +168,11 @@ struct vm_state_t
 		return m_dll_locs;
 	}
 
+	inline var_src_t *get_src(const size_t &src_id) const
+	{
+		return src_id < srcs_by_id.size() ? srcs_by_id[src_id] : nullptr;
+	}
+
 	inline var_src_t *current_source() const
 	{
 		return src_stack.back();
@@ -175,6 +208,16 @@ struct vm_state_t
 	}
 	var_base_t *get_typefn(var_base_t *var, const std::string &name);
 
+	// used by OP_FOR_ITER instead of calling the 'next' typefn of type T
+	template<typename T> void set_iter_next_fn(iter_next_fn_t fn)
+	{
+		m_types->set_iter_next_fn(type_id<T>(), fn);
+	}
+	inline iter_next_fn_t get_iter_next_fn(const std::uintptr_t &type)
+	{
+		return m_types->get_iter_next_fn(m_types_reader, type);
+	}
+
 	// used to convert typeid -> name
 	void set_typename(const std::uintptr_t &type, const std::string &name);
 	std::string type_name(const std::uintptr_t &type);
@@ -197,7 +240,24 @@ struct vm_state_t
 
 	bool load_core_mods();
 
+	// exit functions are called in reverse order of addition
+	void add_exit_fn(vm_exit_fn_t fn);
+
+	// state of a native module which belongs to this vm (thread copies have their own), created
+	// on first use and deleted with the vm - before the dlls are unloaded
+	template<typename T> T *mod_data(const std::string &name)
+	{
+		auto it = m_mod_data.find(name);
+		if(it != m_mod_data.end()) return static_cast<T *>(it->second.data);
+		T *data		 = new T();
+		m_mod_data[name] = {data, [](void *d) { delete static_cast<T *>(d); }};
+		return data;
+	}
+
 	vm_state_t *thread_copy(const size_t &src_id, const size_t &idx);
+	// changes whenever something a thread copy would capture at module level changes
+	// (loaded sources, globals, source level variables), never decreases
+	size_t mod_gen();
 
 	inline bool is_thread_copy()
 	{
@@ -214,12 +274,21 @@ private:
 	std::vector<std::string> m_dll_locs;
 	// global vars/objects that are required
 	std::unordered_map<std::string, var_base_t *> m_globals;
-	// functions for any and all C++ types
-	std::unordered_map<std::uintptr_t, vars_frame_t *> m_typefns;
-	// names of types (optional)
-	std::unordered_map<std::uintptr_t, std::string> m_typenames;
+	// functions, native iteration functions (for OP_FOR_ITER) and names of all C++ types
+	// shared with (and by) the thread copies
+	type_table_t *m_types;
+	// announces lookups in m_types by this vm
+	type_table_t::reader_t m_types_reader;
 	// all functions to call before unloading dlls
 	std::unordered_map<std::string, mod_deinit_fn_t> m_dll_deinit_fns;
+	// all functions to call before the vm begins releasing anything
+	std::vector<vm_exit_fn_t> m_exit_fns;
+	struct mod_data_t
+	{
+		void *data;
+		void (*deleter)(void *data);
+	};
+	std::unordered_map<std::string, mod_data_t> m_mod_data;
 	// path where feral binary exists (used by sys.self_bin())
 	std::string m_self_bin;
 	// parent directory of where feral binary exists (used by sys.self_base())
@@ -231,11 +300,20 @@ private:
 const char *nmod_ext();
 const char *fmod_ext(const bool compiled = false);
 
+// suspended body of a generator function (see var_gen_t) - vm::exec() resumes it from pos
+// with vars as the function's variables, and updates both when the body yields again
+// vars is nullptr once the body has returned (or failed)
+struct gen_frame_t
+{
+	vars_stack_t *vars;
+	size_t pos;
+};
+
 namespace vm
 {
 // end = 0 = till size of bcode
 int exec(vm_state_t &vm, const bcode_t *custom_bcode = nullptr, const size_t &begin = 0,
-	 const size_t &end = 0);
+	 const size_t &end = 0, gen_frame_t *gen = nullptr);
 } // namespace vm
 
 #endif // VM_VM_HPP
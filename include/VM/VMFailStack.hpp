@@ -14,14 +14,33 @@
 #ifndef VM_VM_FAIL_STACK_HPP
 #define VM_VM_FAIL_STACK_HPP
 
-#include <deque>
+#include <string>
 #include <vector>
 
 #include "Vars/Base.hpp"
 
+// a failure recorded for an 'or' block - the error variable (val) is created only when it is
+// popped (bound to the 'or' variable) unless the failure was raised with a variable
+struct fail_t
+{
+	size_t src_id;
+	size_t idx;
+	var_base_t *val; // nullptr if the failure is msg
+	std::string msg;
+};
+
+// one block per active 'or' - blocks (and the storage of their failures) are reused
+struct fail_blk_t
+{
+	std::vector<fail_t> fails;
+	size_t front;
+	bool named; // has an 'or' variable which receives the failure
+};
+
 class vm_failstack_t
 {
-	std::vector<std::deque<var_base_t *>> m_stack;
+	std::vector<fail_blk_t> m_stack;
+	size_t m_size;
 
 public:
 	vm_failstack_t();
@@ -29,28 +48,40 @@ public:
 
 	inline void blka()
 	{
-		m_stack.push_back(std::deque<var_base_t *>{});
+		if(m_size == m_stack.size()) m_stack.emplace_back();
+		fail_blk_t &blk = m_stack[m_size++];
+		blk.front	= 0;
+		blk.named	= false;
+	}
+	void blkr();
+
+	// the current block has an 'or' variable
+	inline void set_named()
+	{
+		m_stack[m_size - 1].named = true;
 	}
-	inline void blkr()
+	// if false, failures of the current block would be discarded anyway
+	inline bool accepts() const
 	{
-		for(auto &e : m_stack.back()) var_dref(e);
-		m_stack.pop_back();
+		return m_stack[m_size - 1].named;
 	}
 
 	void push(var_base_t *val, const bool iref = true);
+	void push(const size_t &src_id, const size_t &idx, const char *msg);
 	var_base_t *pop(const bool dref = true);
 
 	inline size_t size() const
 	{
-		return m_stack.size();
+		return m_size;
 	}
 	inline bool empty() const
 	{
-		return m_stack.empty();
+		return m_size == 0;
 	}
 	inline bool backempty() const
 	{
-		return m_stack.back().empty();
+		const fail_blk_t &blk = m_stack[m_size - 1];
+		return blk.front == blk.fails.size();
 	}
 };
 
@@ -14,20 +14,40 @@
 #ifndef VM_VARS_HPP
 #define VM_VARS_HPP
 
+#include <atomic>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "Vars/Base.hpp"
 
+// frames are shared between a vm and its thread copies (see vars_stack_t::thread_copy())
+// a shared frame is frozen - whichever vm wants to modify it gets its own copy first
 class vars_frame_t
 {
 	std::unordered_map<std::string, var_base_t *> m_vars;
+	// number of vars_stack_t which contain this frame
+	std::atomic<size_t> m_ref;
 
 public:
 	vars_frame_t();
+	// copies other's variables (not its reference count)
+	vars_frame_t(const vars_frame_t &other);
 	~vars_frame_t();
 
+	inline void iref()
+	{
+		++m_ref;
+	}
+	inline size_t dref()
+	{
+		return --m_ref;
+	}
+	inline bool shared() const
+	{
+		return m_ref > 1;
+	}
+
 	inline const std::unordered_map<std::string, var_base_t *> &all() const
 	{
 		return m_vars;
@@ -44,8 +64,6 @@ public:
 
 	static void *operator new(size_t sz);
 	static void operator delete(void *ptr, size_t sz);
-
-	vars_frame_t *thread_copy(const size_t &src_id, const size_t &idx);
 };
 
 class vars_stack_t
@@ -58,6 +76,9 @@ class vars_stack_t
 	std::vector<vars_frame_t *> m_stack;
 	size_t m_top;
 
+	// the frame at pos, copied first if it is shared with another vm
+	vars_frame_t *own(const size_t &pos);
+
 public:
 	vars_stack_t();
 	~vars_stack_t();
@@ -65,9 +86,15 @@ public:
 	// checks if a variable exists in CURRENT scope ONLY
 	bool exists(const std::string &name);
 	var_base_t *get(const std::string &name);
+	// gets a variable from CURRENT scope ONLY
+	var_base_t *get_curr(const std::string &name);
 
 	void inc_top(const size_t &count);
 	void dec_top(const size_t &count);
+	inline const size_t &top() const
+	{
+		return m_top;
+	}
 
 	void push_loop();
 	// 'break' also uses this
@@ -77,6 +104,7 @@ public:
 	void add(const std::string &name, var_base_t *val, const bool inc_ref);
 	void rem(const std::string &name, const bool dec_ref);
 
+	// shares all frames with the copy, so the cost does not depend on the number of variables
 	vars_stack_t *thread_copy(const size_t &src_id, const size_t &idx);
 };
 
@@ -90,6 +118,8 @@ public:
 class vars_t
 {
 	size_t m_fn_stack;
+	// bumped whenever the source level (outermost) scope gains or loses a variable
+	size_t m_mod_gen;
 	std::unordered_map<std::string, var_base_t *> m_stash;
 	// maps function id to vars_frame_t
 	std::unordered_map<size_t, vars_stack_t *> m_fn_vars;
@@ -102,12 +132,18 @@ public:
 	bool exists(const std::string &name);
 
 	var_base_t *get(const std::string &name);
+	// gets a variable from CURRENT scope ONLY
+	var_base_t *get_curr(const std::string &name);
 
 	void blk_add(const size_t &count);
 	void blk_rem(const size_t &count);
 
 	void push_fn();
 	void pop_fn();
+	// for generators - pop_fn_detach() removes the function's variables without deleting them,
+	// push_fn(stack) continues with them (in place of a new vars_stack_t)
+	void push_fn(vars_stack_t *stack);
+	vars_stack_t *pop_fn_detach();
 
 	void stash(const std::string &name, var_base_t *val, const bool &iref = true);
 	void unstash();
@@ -130,6 +166,11 @@ public:
 	void addm(const std::string &name, var_base_t *val, const bool inc_ref);
 	void rem(const std::string &name, const bool dec_ref);
 
+	inline const size_t &mod_gen() const
+	{
+		return m_mod_gen;
+	}
+
 	vars_t *thread_copy(const size_t &src_id, const size_t &idx);
 };
 
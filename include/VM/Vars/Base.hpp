@@ -14,9 +14,11 @@
 #ifndef VM_VARS_BASE_HPP
 #define VM_VARS_BASE_HPP
 
+#include <atomic>
 #include <cassert>
 #include <gmp.h>
 #include <map>
+#include <memory>
 #include <mpfr.h>
 #include <mutex>
 #include <string>
@@ -79,8 +81,17 @@ public:
 	virtual var_base_t *copy(const size_t &src_id, const size_t &idx) = 0;
 	virtual void set(var_base_t *from)				  = 0;
 
-	bool to_str(vm_state_t &vm, std::string &data, const size_t &src_id, const size_t &idx);
-	bool to_bool(vm_state_t &vm, bool &data, const size_t &src_id, const size_t &idx);
+	// builtin types are converted inline, others call their 'str'/'bool' attribute or typefn
+	inline bool to_str(vm_state_t &vm, std::string &data, const size_t &src_id,
+			   const size_t &idx);
+	inline bool to_bool(vm_state_t &vm, bool &data, const size_t &src_id, const size_t &idx);
+	// appends the string form to out - containers are written element by element, without
+	// building intermediate strings
+	bool append_str(vm_state_t &vm, std::string &out, const size_t &src_id, const size_t &idx);
+	// call the 'str'/'bool' attribute or typefn
+	bool to_str_call(vm_state_t &vm, std::string &data, const size_t &src_id,
+			 const size_t &idx);
+	bool to_bool_call(vm_state_t &vm, bool &data, const size_t &src_id, const size_t &idx);
 
 	inline void set_src_id_idx(const size_t &src_id, const size_t &idx)
 	{
@@ -301,12 +312,39 @@ public:
 };
 #define VEC(x) static_cast<var_vec_t *>(x)
 
+// key is nullptr for erased entries
+struct map_entry_t
+{
+	var_base_t *key;
+	var_base_t *val;
+	size_t hash;
+};
+
+// open addressing hash map which keeps the type of keys
+// int, str, bool, flt, nil, and typeid keys are hashed and compared natively, other types by
+// their 'str' typefn output
+// entries are kept in insertion order; the index is a table of control bytes (empty/deleted
+// or 7 bits of the key hash) so that most non matching slots are skipped without touching
+// the entries
+// iteration is in insertion order, or in the order of the keys' string form if sorted
 class var_map_t : public var_base_t
 {
-	std::map<std::string, var_base_t *> m_val;
+	std::vector<map_entry_t> m_entries;
+	std::vector<unsigned char> m_ctrl;
+	std::vector<size_t> m_slots; // slot -> position in m_entries
+	size_t m_size;
+	size_t m_used; // occupied + deleted slots
 	bool m_refs;
+	bool m_sorted;
+
+	// finds key - slot is the location of key if found, or where it can be inserted
+	bool find_slot(vm_state_t &vm, var_base_t *key, const size_t &hash, size_t &slot,
+		       bool &found, const size_t &src_id, const size_t &idx);
+	void rehash(const size_t &cap);
 
 public:
+	var_map_t(const bool &refs, const bool &sorted, const size_t &src_id, const size_t &idx);
+	// string keys, takes the references of the values
 	var_map_t(const std::map<std::string, var_base_t *> &val, const bool &refs,
 		  const size_t &src_id, const size_t &idx);
 	~var_map_t();
@@ -314,24 +352,79 @@ public:
 	var_base_t *copy(const size_t &src_id, const size_t &idx);
 	void set(var_base_t *from);
 
-	std::map<std::string, var_base_t *> &get();
+	// all of these return false if hashing/comparing the key failed
+	// val is referenced (refs map) or copied; key is copied
+	bool insert(vm_state_t &vm, var_base_t *key, var_base_t *val, const size_t &src_id,
+		    const size_t &idx);
+	// val is nullptr if key does not exist
+	bool find(vm_state_t &vm, var_base_t *key, var_base_t *&val, const size_t &src_id,
+		  const size_t &idx);
+	bool erase(vm_state_t &vm, var_base_t *key, const size_t &src_id, const size_t &idx);
+	// positions of the entries in iteration order
+	bool order(vm_state_t &vm, std::vector<size_t> &pos, const size_t &src_id,
+		   const size_t &idx);
+
+	inline const std::vector<map_entry_t> &entries() const
+	{
+		return m_entries;
+	}
+	inline size_t size() const
+	{
+		return m_size;
+	}
+	inline bool empty() const
+	{
+		return m_size == 0;
+	}
 	bool is_ref_map();
+	inline bool is_sorted() const
+	{
+		return m_sorted;
+	}
 };
 #define MAP(x) static_cast<var_map_t *>(x)
 
+inline bool var_base_t::to_str(vm_state_t &vm, std::string &data, const size_t &src_id,
+			       const size_t &idx)
+{
+	if(m_type == type_id<var_str_t>()) {
+		data = STR(this)->get();
+		return true;
+	}
+	data.clear();
+	return append_str(vm, data, src_id, idx);
+}
+
+inline bool var_base_t::to_bool(vm_state_t &vm, bool &data, const size_t &src_id,
+				const size_t &idx)
+{
+	if(m_type == type_id<var_bool_t>()) data = BOOL(this)->get();
+	else if(m_type == type_id<var_int_t>()) data = mpz_sgn(INT(this)->get()) != 0;
+	else if(m_type == type_id<var_nil_t>()) data = false;
+	else if(m_type == type_id<var_str_t>()) data = !STR(this)->get().empty();
+	else if(m_type == type_id<var_flt_t>()) data = mpfr_cmp_si(FLT(this)->get(), 0) != 0;
+	else if(m_type == type_id<var_vec_t>()) data = !VEC(this)->get().empty();
+	else if(m_type == type_id<var_map_t>()) data = !MAP(this)->empty();
+	else return to_bool_call(vm, data, src_id, idx);
+	return true;
+}
+
 struct fn_body_span_t
 {
 	size_t begin;
 	size_t end;
 };
 
+// arguments of a native function call
+// this is a view over the caller's argument storage (nothing is copied per call), so it
+// must not outlive the call
 struct fn_data_t
 {
 	size_t src_id;
 	size_t idx;
-	std::vector<var_base_t *> args;
-	std::vector<fn_assn_arg_t> assn_args;
-	std::unordered_map<std::string, size_t> assn_args_loc;
+	const std::vector<var_base_t *> &args;
+	const std::vector<fn_assn_arg_t> &assn_args;
+	const std::unordered_map<std::string, size_t> &assn_args_loc;
 };
 
 typedef var_base_t *(*nativefnptr_t)(vm_state_t &vm, const fn_data_t &fd);
@@ -342,16 +435,45 @@ union fn_body_t
 	fn_body_span_t feral;
 };
 
+// immutable part of a function, shared by all function objects made from the same definition
+// built once - by code generation for feral functions, on registration for native ones
+struct fn_proto_t
+{
+	std::string src_name;
+	std::string kw_arg;
+	std::string var_arg;
+	std::vector<std::string> args;
+	// positions (in args) of the arguments which have default values (feral functions only)
+	std::vector<size_t> assn_args;
+	// body contains 'yield' - calling the function creates a generator instead of running it
+	bool is_gen;
+	std::atomic<size_t> ref;
+
+	fn_proto_t();
+	fn_proto_t(const std::string &src_name, const std::string &kw_arg,
+		   const std::string &var_arg, const std::vector<std::string> &args);
+};
+inline void proto_iref(fn_proto_t *proto)
+{
+	++proto->ref;
+}
+inline void proto_dref(fn_proto_t *proto)
+{
+	if(--proto->ref == 0) delete proto;
+}
+
 class var_fn_t : public var_base_t
 {
-	std::string m_src_name;
-	std::string m_kw_arg;
-	std::string m_var_arg;
-	std::vector<std::string> m_args;
+	fn_proto_t *m_proto;
 	std::unordered_map<std::string, var_base_t *> m_assn_args;
 	fn_body_t m_body;
 	bool m_is_native;
 
+	// executes the body of a feral function (not native)
+	bool call_feral(vm_state_t &vm, const std::vector<var_base_t *> &args,
+			const std::vector<fn_assn_arg_t> &assn_args, const size_t &src_id,
+			const size_t &idx);
+
 public:
 	var_fn_t(const std::string &src_name, const std::string &kw_arg, const std::string &var_arg,
 		 const std::vector<std::string> &args,
@@ -361,16 +483,32 @@ public:
 	var_fn_t(const std::string &src_name, const std::vector<std::string> &args,
 		 const std::unordered_map<std::string, var_base_t *> &assn_args,
 		 const fn_body_t &body, const size_t &src_id, const size_t &idx);
+	// proto is shared with the caller (a reference is taken)
+	var_fn_t(fn_proto_t *proto, const std::unordered_map<std::string, var_base_t *> &assn_args,
+		 const fn_body_t &body, const bool is_native, const size_t &src_id,
+		 const size_t &idx);
 
 	~var_fn_t();
 
 	var_base_t *copy(const size_t &src_id, const size_t &idx);
 	void set(var_base_t *from);
 
-	std::string &src_name();
-	std::string &kw_arg();
-	std::string &var_arg();
-	std::vector<std::string> &args();
+	inline const std::string &src_name() const
+	{
+		return m_proto->src_name;
+	}
+	inline const std::string &kw_arg() const
+	{
+		return m_proto->kw_arg;
+	}
+	inline const std::string &var_arg() const
+	{
+		return m_proto->var_arg;
+	}
+	inline const std::vector<std::string> &args() const
+	{
+		return m_proto->args;
+	}
 	std::unordered_map<std::string, var_base_t *> &assn_args();
 	fn_body_t &body();
 	bool is_native();
@@ -379,9 +517,56 @@ public:
 			 const std::vector<fn_assn_arg_t> &assn_args,
 			 const std::unordered_map<std::string, size_t> &assn_args_loc,
 			 const size_t &src_id, const size_t &idx);
+
+	// calls the native function (is_native() must be true) and returns its result directly
+	// instead of pushing it on the vm stack - nullptr on failure
+	// the result is not referenced, it may be a new variable (ref count 0) or an existing one
+	var_base_t *call_native(vm_state_t &vm, const fn_data_t &fd);
 };
 #define FN(x) static_cast<var_fn_t *>(x)
 
+// calls fn (any callable) with args - args[0] is 'self' (nullptr if none) - and returns the
+// result with a reference held, nullptr on failure
+// native functions are called directly so that the result does not go through the vm stack
+var_base_t *var_call(vm_state_t &vm, var_base_t *fn, const std::vector<var_base_t *> &args,
+		     const size_t &src_id, const size_t &idx);
+
+class vars_stack_t;
+// a call of a generator function (see fn_proto_t::is_gen) - each next() runs the body till its
+// next 'yield', the function's variables are kept in between
+// copies share the generator
+class var_gen_t : public var_base_t
+{
+	struct state_t
+	{
+		var_fn_t *fn;
+		// function's variables, nullptr once the body has returned
+		vars_stack_t *vars;
+		// instruction to resume the body from
+		size_t pos;
+		std::atomic<bool> running;
+
+		state_t(var_fn_t *fn, vars_stack_t *vars);
+		~state_t();
+	};
+	std::shared_ptr<state_t> m_state;
+
+	var_gen_t(std::shared_ptr<state_t> state, const size_t &src_id, const size_t &idx);
+
+public:
+	// takes over vars (which contains the arguments), a reference to fn is taken
+	var_gen_t(var_fn_t *fn, vars_stack_t *vars, const size_t &src_id, const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	// the next yielded value with a reference held - vm.nil (also referenced) once the body
+	// has returned, nullptr on failure (which ends the generator as well)
+	var_base_t *next(vm_state_t &vm, const size_t &src_id, const size_t &idx);
+	bool done() const;
+};
+#define GEN(x) static_cast<var_gen_t *>(x)
+
 class vars_t;
 class var_src_t : public var_base_t
 {
@@ -0,0 +1,96 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#ifndef ARRAY_TYPE_HPP
+#define ARRAY_TYPE_HPP
+
+#include "../VM/VM.hpp"
+
+// element type of a packed array
+// bool elements are stored as 0/1 bytes, same as u8
+enum ArrayKind
+{
+	AK_I64,
+	AK_F64,
+	AK_U8,
+	AK_BOOL,
+
+	_AK_LAST,
+};
+
+extern const char *ArrayKindStrs[_AK_LAST];
+
+// contiguous array of unboxed numbers - elements are only converted to feral
+// objects when they are accessed
+class var_array_t : public var_base_t
+{
+	unsigned char *m_data;
+	size_t m_len;
+	size_t m_cap;
+	ArrayKind m_kind;
+
+public:
+	var_array_t(const ArrayKind &kind, const size_t &len, const size_t &src_id,
+		    const size_t &idx);
+	~var_array_t();
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	// new elements are zero initialized
+	// both return false (leaving the array as is) if the memory cannot be allocated
+	bool resize(const size_t &new_len);
+	bool reserve(const size_t &new_cap);
+
+	template<typename T> inline T *data()
+	{
+		return (T *)m_data;
+	}
+	inline const size_t &len() const
+	{
+		return m_len;
+	}
+	inline const ArrayKind &kind() const
+	{
+		return m_kind;
+	}
+	inline size_t elem_size() const
+	{
+		return m_kind == AK_I64 || m_kind == AK_F64 ? 8 : 1;
+	}
+};
+#define ARRAY(x) static_cast<var_array_t *>(x)
+
+class var_array_iterable_t : public var_base_t
+{
+	var_array_t *m_arr;
+	size_t m_curr;
+
+public:
+	var_array_iterable_t(var_array_t *arr, const size_t &src_id, const size_t &idx);
+	~var_array_iterable_t();
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	// index of the next element, false if exhausted
+	bool next(size_t &pos);
+
+	inline var_array_t *get()
+	{
+		return m_arr;
+	}
+};
+#define ARRAY_ITERABLE(x) static_cast<var_array_iterable_t *>(x)
+
+#endif // ARRAY_TYPE_HPP
@@ -0,0 +1,90 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#ifndef ATOMIC_TYPE_HPP
+#define ATOMIC_TYPE_HPP
+
+#include <atomic>
+#include <memory>
+
+#include "../VM/VM.hpp"
+
+// 64 bit integer - copies share the value
+class var_atomic_int_t : public var_base_t
+{
+	std::shared_ptr<std::atomic<int64_t>> m_val;
+
+public:
+	var_atomic_int_t(std::shared_ptr<std::atomic<int64_t>> val, const size_t &src_id,
+			 const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::atomic<int64_t> &get()
+	{
+		return *m_val;
+	}
+};
+#define ATOMIC_INT(x) static_cast<var_atomic_int_t *>(x)
+
+// holds a feral value which is never handed out itself - stores take a copy and loads give one,
+// so threads never share a mutable object
+// the lock only guards swapping the pointer (and taking a reference to it), the copying is done
+// outside of it
+class atomic_cell_t
+{
+	std::atomic_flag m_lock;
+	var_base_t *m_val;
+
+	inline void lock()
+	{
+		while(m_lock.test_and_set(std::memory_order_acquire)) {}
+	}
+	inline void unlock()
+	{
+		m_lock.clear(std::memory_order_release);
+	}
+
+public:
+	// takes over the reference to val
+	atomic_cell_t(var_base_t *val);
+	~atomic_cell_t();
+
+	// a copy of the held value
+	var_base_t *load(const size_t &src_id, const size_t &idx);
+	// take over the reference to val, exchange() gives away the previous value's
+	void store(var_base_t *val);
+	var_base_t *exchange(var_base_t *val);
+};
+
+// copies share the cell
+class var_atomic_ref_t : public var_base_t
+{
+	std::shared_ptr<atomic_cell_t> m_cell;
+
+public:
+	var_atomic_ref_t(std::shared_ptr<atomic_cell_t> cell, const size_t &src_id,
+			 const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::shared_ptr<atomic_cell_t> &get()
+	{
+		return m_cell;
+	}
+};
+#define ATOMIC_REF(x) static_cast<var_atomic_ref_t *>(x)
+
+#endif // ATOMIC_TYPE_HPP
@@ -0,0 +1,126 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#ifndef CHAN_TYPE_HPP
+#define CHAN_TYPE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "../VM/VM.hpp"
+
+enum ChanStatus
+{
+	CHAN_OK,
+	CHAN_WOULD_BLOCK, // full (send) or empty (recv)
+	CHAN_CLOSED,	  // closed (send) or closed and empty (recv)
+	CHAN_TIMEOUT,
+};
+
+// multi producer, multi consumer queue of feral values
+// bounded channels are a lock free ring buffer (one sequence number per slot), unbounded ones
+// a deque behind a mutex; either way, threads block on condition variables only when they
+// must wait, and the other side takes the mutex only if someone is waiting
+class chan_t
+{
+	struct slot_t
+	{
+		std::atomic<size_t> seq;
+		var_base_t *val;
+	};
+
+	// 0 for unbounded
+	size_t m_cap;
+	slot_t *m_slots;
+	alignas(64) std::atomic<size_t> m_send_pos;
+	alignas(64) std::atomic<size_t> m_recv_pos;
+
+	// unbounded channel
+	std::mutex m_queue_mtx;
+	std::deque<var_base_t *> m_queue;
+
+	alignas(64) std::atomic<bool> m_closed;
+	std::atomic<size_t> m_send_waiters;
+	std::atomic<size_t> m_recv_waiters;
+	std::mutex m_wait_mtx;
+	std::condition_variable m_not_full;
+	std::condition_variable m_not_empty;
+
+	bool push(var_base_t *val);
+	bool pop(var_base_t *&val);
+	void wake(std::atomic<size_t> &waiters, std::condition_variable &cv);
+
+public:
+	chan_t(const size_t &cap);
+	~chan_t();
+
+	// on success, the channel takes over the reference to val
+	// timeout is in milliseconds, negative to wait forever
+	ChanStatus try_send(var_base_t *val);
+	ChanStatus send(var_base_t *val, const long long &timeout);
+	// on success, val holds a reference which the caller now owns
+	ChanStatus try_recv(var_base_t *&val);
+	ChanStatus recv(var_base_t *&val, const long long &timeout);
+
+	void close();
+	inline bool closed() const
+	{
+		return m_closed;
+	}
+	size_t len();
+	inline const size_t &cap() const
+	{
+		return m_cap;
+	}
+};
+
+// copies share the channel
+class var_chan_t : public var_base_t
+{
+	std::shared_ptr<chan_t> m_chan;
+
+public:
+	var_chan_t(std::shared_ptr<chan_t> chan, const size_t &src_id, const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::shared_ptr<chan_t> &get()
+	{
+		return m_chan;
+	}
+};
+#define CHAN(x) static_cast<var_chan_t *>(x)
+
+// receives until the channel is closed and empty
+class var_chan_iterable_t : public var_base_t
+{
+	std::shared_ptr<chan_t> m_chan;
+
+public:
+	var_chan_iterable_t(std::shared_ptr<chan_t> chan, const size_t &src_id, const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::shared_ptr<chan_t> &get()
+	{
+		return m_chan;
+	}
+};
+#define CHAN_ITERABLE(x) static_cast<var_chan_iterable_t *>(x)
+
+#endif // CHAN_TYPE_HPP
@@ -0,0 +1,115 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#ifndef EVENT_TYPE_HPP
+#define EVENT_TYPE_HPP
+
+#include <map>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+
+#include "../VM/VM.hpp"
+
+// readiness of a file descriptor, as watched for and as reported to the handlers
+enum EventKind
+{
+	EV_READ	 = 1 << 0,
+	EV_WRITE = 1 << 1,
+	EV_HUP	 = 1 << 2, // reported only - the other end is closed
+	EV_ERR	 = 1 << 3, // reported only
+};
+
+// single threaded reactor - file descriptors are watched with epoll (poll() where epoll is not
+// available) and timers are kept in a heap, the earliest of which decides how long a poll waits
+// a handler is either a function, called with (fd, events) for watches and without arguments for
+// timers, or a generator which is resumed instead (and dropped once it is done)
+class event_loop_t
+{
+	struct watch_t
+	{
+		int events;
+		var_base_t *fn;
+	};
+	struct timer_entry_t
+	{
+		uint64_t when; // steady clock, in milliseconds
+		uint64_t interval; // 0 for one shot timers
+		var_base_t *fn;
+	};
+	typedef std::pair<uint64_t, size_t> timer_pos_t; // when, id
+
+	int m_poll_fd; // epoll instance, -1 if poll() is used (not linux, or epoll failed)
+	std::unordered_map<int, watch_t> m_watches;
+	std::map<size_t, timer_entry_t> m_timers;
+	// cancelled and rescheduled timers leave stale entries which are skipped
+	std::priority_queue<timer_pos_t, std::vector<timer_pos_t>, std::greater<timer_pos_t>>
+	m_timer_queue;
+	size_t m_next_timer;
+	bool m_stop;
+
+	bool run_timers(vm_state_t &vm, const size_t &src_id, const size_t &idx);
+	// waits for at most timeout ms (-1 = no limit) and calls the handlers of the ready fds
+	bool poll(vm_state_t &vm, const int &timeout, const size_t &src_id, const size_t &idx);
+	// done is set if the handler was a generator which has finished
+	bool call(vm_state_t &vm, var_base_t *fn, const std::vector<var_base_t *> &args, bool &done,
+		  const size_t &src_id, const size_t &idx);
+
+public:
+	event_loop_t();
+	~event_loop_t();
+
+	// the error is set in err (for vm.fail()) on failure
+	bool watch(const int &fd, const int &events, var_base_t *fn, std::string &err);
+	bool unwatch(const int &fd, std::string &err);
+	// returns the timer id
+	size_t add_timer(const uint64_t &ms, var_base_t *fn, const bool &repeat);
+	bool cancel(const size_t &id);
+
+	// runs until stop() is called or nothing is left to wait for, false if a handler failed
+	// watches of file descriptors which have been closed meanwhile are dropped first
+	bool run(vm_state_t &vm, const size_t &src_id, const size_t &idx);
+	inline void stop()
+	{
+		m_stop = true;
+	}
+	inline size_t pending() const
+	{
+		return m_watches.size() + m_timers.size();
+	}
+
+	// drops the watches for fd of the loops running on this thread - called before fd is
+	// closed by a handler, since epoll forgets a closed fd without reporting it
+	static void fd_closed(const int &fd);
+};
+
+// copies share the loop
+class var_event_loop_t : public var_base_t
+{
+	std::shared_ptr<event_loop_t> m_loop;
+
+public:
+	var_event_loop_t(std::shared_ptr<event_loop_t> loop, const size_t &src_id,
+			 const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::shared_ptr<event_loop_t> &get()
+	{
+		return m_loop;
+	}
+};
+#define EVENT_LOOP(x) static_cast<var_event_loop_t *>(x)
+
+#endif // EVENT_TYPE_HPP
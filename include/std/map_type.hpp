@@ -19,10 +19,14 @@
 class var_map_iterable_t : public var_base_t
 {
 	var_map_t *m_map;
-	std::map<std::string, var_base_t *>::iterator m_curr;
+	// positions of entries in iteration order (sorted maps only), else entries are iterated
+	// as they are stored
+	std::vector<size_t> m_order;
+	size_t m_curr;
 
 public:
-	var_map_iterable_t(var_map_t *map, const size_t &src_id, const size_t &idx);
+	var_map_iterable_t(var_map_t *map, const std::vector<size_t> &order, const size_t &src_id,
+			   const size_t &idx);
 	~var_map_iterable_t();
 
 	var_base_t *copy(const size_t &src_id, const size_t &idx);
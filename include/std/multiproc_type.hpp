@@ -14,41 +14,116 @@
 #ifndef MULTIPROC_TYPE_HPP
 #define MULTIPROC_TYPE_HPP
 
-#include <future>
-#include <thread>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <vector>
 
 #include "../VM/VM.hpp"
 
-class var_multiproc_t : public var_base_t
+// which output streams of a process are captured (the rest are inherited)
+enum CaptureStream
+{
+	CAPTURE_OUT = 1 << 0,
+	CAPTURE_ERR = 1 << 1,
+};
+
+// runs cmd with the shell through posix_spawn() - out_fd and err_fd (-1 to inherit) become its
+// standard output and error, and should be close on exec (so only the child's copies remain)
+// returns 0 or the error number
+int spawn_shell(const std::string &cmd, const int &out_fd, const int &err_fd, pid_t &pid);
+// exit code from a wait status - 128 + signal number if the process was killed by a signal
+int exit_code_of(const int &status);
+
+// a command run with spawn_shell()
+// the process is reaped with wait4() (which also gives its resource usage) - waiting happens in
+// poll() on the capture pipes and, on linux, a pidfd which becomes readable when the process
+// exits, so no CPU is used while waiting
+// copies of a multiproc handle may be used from several threads, so everything which changes
+// after spawn() is guarded by m_mtx, and the accessors return copies
+class proc_t
 {
-	std::thread *m_thread;
-	std::shared_future<int> *m_res;
+	mutable std::mutex m_mtx;
 	size_t m_id;
-	bool m_owner;
+	pid_t m_pid;
+	int m_pidfd; // -1 if not available, open until destruction so poll() never sees a stale fd
+	int m_out_fd, m_err_fd; // -1 if not captured (or closed)
+	std::string m_out, m_err;
+	bool m_done;
+	int m_exit_code; // 128 + signal number if the process was killed by a signal
+	struct rusage m_usage;
+
+	// reads whatever is available on the capture pipes without blocking
+	void drain();
+	// update() with m_mtx held
+	bool update_locked();
 
 public:
-	var_multiproc_t(std::thread *thread, std::shared_future<int> *res, const size_t &src_id,
-			const size_t &idx, const bool &owner = true);
-	var_multiproc_t(std::thread *thread, std::shared_future<int> *res, const size_t &id,
-			const size_t &src_id, const size_t &idx, const bool &owner = true);
-	~var_multiproc_t();
+	proc_t(const size_t &id);
+	~proc_t();
 
-	var_base_t *copy(const size_t &src_id, const size_t &idx);
-	void set(var_base_t *from);
+	// returns 0 or the error number
+	int spawn(const std::string &cmd, const int &capture);
 
-	inline std::thread *&get_thread()
+	// reaps the process if it has exited, true if it is done
+	bool update();
+
+	// blocks until any (or all) of the processes are done, returns the index of a done one
+	static size_t wait(const std::vector<proc_t *> &procs, const bool &all);
+
+	inline const size_t &id() const
 	{
-		return m_thread;
+		return m_id;
 	}
-	inline std::shared_future<int> *&get_future()
+	inline const pid_t &pid() const
 	{
-		return m_res;
+		return m_pid;
 	}
-	inline size_t get_id()
+	inline bool done() const
 	{
-		return m_id;
+		std::lock_guard<std::mutex> lock(m_mtx);
+		return m_done;
+	}
+	inline int exit_code() const
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		return m_exit_code;
+	}
+	inline struct rusage usage() const
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		return m_usage;
+	}
+	inline std::string out() const
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		return m_out;
+	}
+	inline std::string err() const
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		return m_err;
+	}
+};
+
+// copies share the process
+class var_multiproc_t : public var_base_t
+{
+	std::shared_ptr<proc_t> m_proc;
+
+public:
+	var_multiproc_t(std::shared_ptr<proc_t> proc, const size_t &src_id, const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline proc_t *get()
+	{
+		return m_proc.get();
 	}
 };
 #define MULTIPROC(x) static_cast<var_multiproc_t *>(x)
 
-#endif // MULTIPROC_TYPE_HPP
\ No newline at end of file
+#endif // MULTIPROC_TYPE_HPP
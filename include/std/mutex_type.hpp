@@ -14,13 +14,16 @@
 #ifndef MUTEX_TYPE_HPP
 #define MUTEX_TYPE_HPP
 
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 
 #include "../VM/VM.hpp"
 
+// timed so that try_lock() can wait for a while
 class var_mutex_t : public var_base_t
 {
-	std::mutex m_mtx;
+	std::timed_mutex m_mtx;
 
 public:
 	var_mutex_t(const size_t &src_id, const size_t &idx);
@@ -28,11 +31,112 @@ public:
 	var_base_t *copy(const size_t &src_id, const size_t &idx);
 	void set(var_base_t *from);
 
-	inline std::mutex &get()
+	inline std::timed_mutex &get()
 	{
 		return m_mtx;
 	}
 };
 #define MUTEX(x) static_cast<var_mutex_t *>(x)
 
-#endif // MUTEX_TYPE_HPP
\ No newline at end of file
+// waits on a (locked) var_mutex_t - copies share the condition variable
+class var_cond_t : public var_base_t
+{
+	std::shared_ptr<std::condition_variable_any> m_cv;
+
+public:
+	var_cond_t(std::shared_ptr<std::condition_variable_any> cv, const size_t &src_id,
+		   const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::condition_variable_any &get()
+	{
+		return *m_cv;
+	}
+};
+#define COND(x) static_cast<var_cond_t *>(x)
+
+// any number of readers or a single writer
+// waiting writers keep new readers out so that a steady stream of readers cannot starve them
+class rwlock_t
+{
+	std::mutex m_mtx;
+	std::condition_variable m_readers_cv;
+	std::condition_variable m_writers_cv;
+	size_t m_readers;
+	size_t m_writers_waiting;
+	bool m_writer;
+
+public:
+	rwlock_t();
+
+	// timeout is in milliseconds - negative to wait forever, 0 to not wait at all
+	// false if the lock could not be taken in time
+	bool rlock(const long long &timeout);
+	void runlock();
+	bool wlock(const long long &timeout);
+	void wunlock();
+};
+
+// copies share the lock
+class var_rwlock_t : public var_base_t
+{
+	std::shared_ptr<rwlock_t> m_lock;
+
+public:
+	var_rwlock_t(std::shared_ptr<rwlock_t> lock, const size_t &src_id, const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline rwlock_t &get()
+	{
+		return *m_lock;
+	}
+};
+#define RWLOCK(x) static_cast<var_rwlock_t *>(x)
+
+enum LockKind
+{
+	LOCK_MUTEX,
+	LOCK_READ,
+	LOCK_WRITE,
+};
+
+// holds a taken lock (a var_mutex_t or var_rwlock_t) and releases it when the last copy of the
+// guard is gone - which is at the end of the scope holding it, even if the scope is left due to
+// a failure - or when unlock() is called
+class lock_guard_t
+{
+	var_base_t *m_lock;
+	LockKind m_kind;
+	bool m_held;
+
+public:
+	// the lock must already be taken
+	lock_guard_t(var_base_t *lock, const LockKind &kind);
+	~lock_guard_t();
+
+	void unlock();
+};
+
+class var_lock_guard_t : public var_base_t
+{
+	std::shared_ptr<lock_guard_t> m_guard;
+
+public:
+	var_lock_guard_t(std::shared_ptr<lock_guard_t> guard, const size_t &src_id,
+			 const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline lock_guard_t &get()
+	{
+		return *m_guard;
+	}
+};
+#define LOCK_GUARD(x) static_cast<var_lock_guard_t *>(x)
+
+#endif // MUTEX_TYPE_HPP
@@ -0,0 +1,37 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#ifndef STR_TYPE_HPP
+#define STR_TYPE_HPP
+
+#include "../VM/VM.hpp"
+
+// growable buffer for building a string piece by piece
+class var_str_builder_t : public var_base_t
+{
+	std::string m_buf;
+
+public:
+	var_str_builder_t(const size_t &cap, const size_t &src_id, const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::string &get()
+	{
+		return m_buf;
+	}
+};
+#define STR_BUILDER(x) static_cast<var_str_builder_t *>(x)
+
+#endif // STR_TYPE_HPP
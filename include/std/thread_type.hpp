@@ -14,7 +14,11 @@
 #ifndef THREAD_TYPE_HPP
 #define THREAD_TYPE_HPP
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <memory>
 #include <thread>
 
 #include "../VM/VM.hpp"
@@ -64,4 +68,150 @@ public:
 };
 #define THREAD(x) static_cast<var_thread_t *>(x)
 
+// copy of the submitting vm from which the workers of a pool take their own vm copies
+// a new one is taken only when the module state (vm_state_t::mod_gen()) changes
+struct pool_snap_t
+{
+	vm_state_t *vm;
+	size_t seq;
+	// queued tasks which will use this snapshot
+	std::atomic<size_t> users;
+
+	pool_snap_t(vm_state_t *vm, const size_t &seq);
+	~pool_snap_t();
+};
+
+class pool_t;
+
+// work for a pool worker - fn is called once for each group of argc arguments in args
+// and the results are stored in res, in order; the first failure stops the task
+// a fold task instead calls fn(acc, arg) for each of args[1:], with acc starting at args[0]
+// and then being the result of the previous call - res only has the final acc
+struct pool_task_t
+{
+	var_base_t *fn;
+	std::vector<var_base_t *> args;
+	size_t argc;
+	size_t calls;
+	bool fold;
+	size_t src_id;
+	size_t idx;
+	// owned by the pool, only valid until the task is taken by a worker
+	pool_snap_t *snap;
+	// set for the tasks of pool.submit(), which can be joined by the workers of the pool
+	std::weak_ptr<pool_t> pool;
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool done;
+	var_base_t *err;
+	std::vector<var_base_t *> res;
+
+	// fn and args must be referenced by the caller, the task takes over the references
+	pool_task_t(var_base_t *fn, const std::vector<var_base_t *> &args, const size_t &argc,
+		    const size_t &src_id, const size_t &idx, const bool &fold = false);
+	~pool_task_t();
+
+	// runs the task on (a worker's) vm, false if it failed
+	bool run(vm_state_t &vm);
+	void wait();
+	bool is_done();
+};
+
+// persistent worker threads, each with its own deque of tasks - a worker takes the newest task
+// from its own deque and, once that is empty, steals the oldest one from the others
+// every worker keeps its vm copy until a task comes with a newer snapshot
+// vms are only ever deleted by the threads calling submit() and shutdown(), never by the workers,
+// since the vm copies hold references to everything at module level - including the pool
+class pool_t
+{
+	struct worker_t
+	{
+		std::thread thread;
+		std::mutex mtx;
+		std::deque<std::shared_ptr<pool_task_t>> tasks;
+		vm_state_t *vm;
+		size_t seq;
+	};
+	std::vector<worker_t *> m_workers;
+	std::mutex m_sleep_mtx;
+	std::condition_variable m_sleep_cv;
+	// tasks submitted but not yet taken by a worker - incremented with m_sleep_mtx held
+	std::atomic<size_t> m_pending;
+	std::atomic<size_t> m_next;
+	bool m_stop;
+
+	// guards everything below
+	std::mutex m_snap_mtx;
+	// the last one is the current snapshot
+	std::vector<pool_snap_t *> m_snaps;
+	// vms which the workers are done with
+	std::vector<vm_state_t *> m_retired;
+	vm_state_t *m_snap_from;
+	size_t m_snap_gen;
+	size_t m_snap_seq;
+
+	std::shared_ptr<pool_task_t> take(const size_t &id);
+	void retire(vm_state_t *vm);
+	// deletes retired vms and unused snapshots, m_snap_mtx must be held
+	void collect();
+	void work(const size_t id);
+
+public:
+	pool_t(const size_t &count);
+	~pool_t();
+
+	// false if the pool has been shut down
+	bool submit(vm_state_t &vm, std::shared_ptr<pool_task_t> task);
+	// runs all the pending tasks and stops the workers
+	void shutdown();
+	// true if the calling thread is one of the workers of this pool
+	bool in_worker() const;
+	// for a worker waiting for task (which may be queued behind it) - runs queued tasks on vm,
+	// the vm of the worker, until task is done
+	void run_until(vm_state_t &vm, pool_task_t *task);
+
+	inline size_t size() const
+	{
+		return m_workers.size();
+	}
+};
+
+class var_pool_t : public var_base_t
+{
+	// shared by copies of the var
+	std::shared_ptr<pool_t> m_pool;
+
+public:
+	var_pool_t(std::shared_ptr<pool_t> pool, const size_t &src_id, const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::shared_ptr<pool_t> &get()
+	{
+		return m_pool;
+	}
+};
+#define POOL(x) static_cast<var_pool_t *>(x)
+
+// handle to the result of a submitted function
+class var_pool_task_t : public var_base_t
+{
+	std::shared_ptr<pool_task_t> m_task;
+
+public:
+	var_pool_task_t(std::shared_ptr<pool_task_t> task, const size_t &src_id,
+			const size_t &idx);
+
+	var_base_t *copy(const size_t &src_id, const size_t &idx);
+	void set(var_base_t *from);
+
+	inline std::shared_ptr<pool_task_t> &get()
+	{
+		return m_task;
+	}
+};
+#define POOL_TASK(x) static_cast<var_pool_task_t *>(x)
+
 #endif // THREAD_TYPE_HPP
\ No newline at end of file
@@ -127,11 +127,11 @@ INIT_MODULE(core)
 	vm.add_native_typefn<var_nil_t>("str", nil_to_str, 0, src_id, idx);
 	vm.add_native_typefn<var_typeid_t>("str", typeid_to_str, 0, src_id, idx);
 	vm.add_native_typefn<var_bool_t>("str", bool_to_str, 0, src_id, idx);
-	vm.add_native_typefn<var_int_t>("str", int_to_str, 0, src_id, idx);
-	vm.add_native_typefn<var_flt_t>("str", flt_to_str, 0, src_id, idx);
+	vm.add_native_typefn<var_int_t>("str", builtin_to_str, 0, src_id, idx);
+	vm.add_native_typefn<var_flt_t>("str", builtin_to_str, 0, src_id, idx);
 	vm.add_native_typefn<var_str_t>("str", str_to_str, 0, src_id, idx);
-	vm.add_native_typefn<var_vec_t>("str", vec_to_str, 0, src_id, idx);
-	vm.add_native_typefn<var_map_t>("str", map_to_str, 0, src_id, idx);
+	vm.add_native_typefn<var_vec_t>("str", builtin_to_str, 0, src_id, idx);
+	vm.add_native_typefn<var_map_t>("str", builtin_to_str, 0, src_id, idx);
 
 	// to bool
 	vm.add_native_typefn<var_all_t>("bool", all_to_bool, 0, src_id, idx);
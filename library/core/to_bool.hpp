@@ -58,7 +58,7 @@ var_base_t *vec_to_bool(vm_state_t &vm, const fn_data_t &fd)
 
 var_base_t *map_to_bool(vm_state_t &vm, const fn_data_t &fd)
 {
-	return make<var_bool_t>(!MAP(fd.args[0])->get().empty());
+	return make<var_bool_t>(!MAP(fd.args[0])->empty());
 }
 
 #endif // LIBRARY_CORE_TO_BOOL_HPP
\ No newline at end of file
@@ -41,43 +41,13 @@ var_base_t *typeid_to_str(vm_state_t &vm, const fn_data_t &fd)
 	return make<var_str_t>("typeid<" + std::to_string(TYPEID(fd.args[0])->get()) + ">");
 }
 
-var_base_t *int_to_str(vm_state_t &vm, const fn_data_t &fd)
+// int, flt, vec, and map share the builtin conversion of the vm
+var_base_t *builtin_to_str(vm_state_t &vm, const fn_data_t &fd)
 {
-	typedef void (*gmp_freefunc_t)(void *, size_t);
-
-	char *_res     = mpz_get_str(NULL, 10, INT(fd.args[0])->get());
 	var_str_t *res = make<var_str_t>("");
-	res->get()     = _res;
-
-	gmp_freefunc_t freefunc;
-	mp_get_memory_functions(NULL, NULL, &freefunc);
-	freefunc(_res, strlen(_res) + 1);
-
-	return res;
-}
-
-var_base_t *flt_to_str(vm_state_t &vm, const fn_data_t &fd)
-{
-	mpfr_exp_t expo;
-	char *_res =
-	mpfr_get_str(NULL, &expo, 10, 0, FLT(fd.args[0])->get(), mpfr_get_default_rounding_mode());
-	var_str_t *res = make<var_str_t>(_res);
-	mpfr_free_str(_res);
-	if(res->get().empty() || expo == 0 || expo > 25) return res;
-	auto last_zero_from_end = res->get().find_last_of("123456789");
-	if(last_zero_from_end != std::string::npos)
-		res->get() = res->get().erase(last_zero_from_end + 1);
-	if(expo > 0) {
-		std::string &str_res = res->get();
-		size_t sz	     = str_res.size();
-		while(expo > sz) {
-			str_res += '0';
-		}
-		if(res->get()[0] == '-') ++expo;
-		res->get().insert(expo, ".");
-	} else {
-		std::string pre_zero(-expo, '0');
-		res->get() = "0." + pre_zero + res->get();
+	if(!fd.args[0]->append_str(vm, res->get(), fd.src_id, fd.idx)) {
+		delete res;
+		return nullptr;
 	}
 	return res;
 }
@@ -87,42 +57,4 @@ var_base_t *str_to_str(vm_state_t &vm, const fn_data_t &fd)
 	return fd.args[0];
 }
 
-var_base_t *vec_to_str(vm_state_t &vm, const fn_data_t &fd)
-{
-	var_vec_t *vec	= VEC(fd.args[0]);
-	std::string res = "[";
-	for(auto &e : vec->get()) {
-		std::string str;
-		if(!e->to_str(vm, str, fd.src_id, fd.idx)) {
-			return nullptr;
-		}
-		res += str + ", ";
-	}
-	if(vec->get().size() > 0) {
-		res.pop_back();
-		res.pop_back();
-	}
-	res += "]";
-	return make<var_str_t>(res);
-}
-
-var_base_t *map_to_str(vm_state_t &vm, const fn_data_t &fd)
-{
-	var_map_t *map	= MAP(fd.args[0]);
-	std::string res = "{";
-	for(auto &e : map->get()) {
-		std::string str;
-		if(!e.second->to_str(vm, str, fd.src_id, fd.idx)) {
-			return nullptr;
-		}
-		res += e.first + ": " + str + ", ";
-	}
-	if(map->get().size() > 0) {
-		res.pop_back();
-		res.pop_back();
-	}
-	res += "}";
-	return make<var_str_t>(res);
-}
-
 #endif // LIBRARY_CORE_TO_STR_HPP
\ No newline at end of file
@@ -27,7 +27,14 @@ public:
 	var_base_t *copy(const size_t &src_id, const size_t &idx);
 	void set(var_base_t *from);
 
+	// moves to the next value (available in curr()), false if the range is exhausted
+	bool step();
 	bool next(mpz_t &val);
+
+	inline mpz_t &curr()
+	{
+		return m_curr;
+	}
 };
 #define INT_ITERABLE(x) static_cast<var_int_iterable_t *>(x)
 
@@ -58,7 +65,7 @@ void var_int_iterable_t::set(var_base_t *from)
 	mpz_set(m_curr, INT_ITERABLE(from)->m_curr);
 }
 
-bool var_int_iterable_t::next(mpz_t &val)
+bool var_int_iterable_t::step()
 {
 	if(m_is_reverse) {
 		if(mpz_cmp(m_curr, m_end) <= 0) return false;
@@ -66,29 +73,18 @@ bool var_int_iterable_t::next(mpz_t &val)
 		if(mpz_cmp(m_curr, m_end) >= 0) return false;
 	}
 	if(!m_started) {
-		mpz_init(val);
-		mpz_set(val, m_curr);
 		m_started = true;
 		return true;
 	}
-	mpz_t tmp;
-	mpz_init(tmp);
-	mpz_add(tmp, m_curr, m_step);
-	if(m_is_reverse) {
-		if(mpz_cmp(tmp, m_end) <= 0) {
-			mpz_clear(tmp);
-			return false;
-		}
-	} else {
-		if(mpz_cmp(tmp, m_end) >= 0) {
-			mpz_clear(tmp);
-			return false;
-		}
-	}
-	mpz_set(m_curr, tmp);
-	mpz_init(val);
-	mpz_set(val, m_curr);
-	mpz_clear(tmp);
+	mpz_add(m_curr, m_curr, m_step);
+	if(m_is_reverse) return mpz_cmp(m_curr, m_end) > 0;
+	return mpz_cmp(m_curr, m_end) < 0;
+}
+
+bool var_int_iterable_t::next(mpz_t &val)
+{
+	if(!step()) return false;
+	mpz_init_set(val, m_curr);
 	return true;
 }
 
@@ -156,6 +152,33 @@ var_base_t *int_iterable_next(vm_state_t &vm, const fn_data_t &fd)
 	return res;
 }
 
+var_base_t *int_iterable_next_fast(vm_state_t &vm, var_base_t *iterable, var_base_t *reuse,
+				   const size_t &src_id, const size_t &idx)
+{
+	var_int_iterable_t *it = INT_ITERABLE(iterable);
+	if(!it->step()) return nullptr;
+	if(reuse && reuse->istype<var_int_t>()) {
+		mpz_set(INT(reuse)->get(), it->curr());
+		return reuse;
+	}
+	return make<var_int_t>(it->curr());
+}
+
+// nil once the generator's body has returned
+var_base_t *gen_next(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_base_t *res = GEN(fd.args[0])->next(vm, fd.src_id, fd.idx);
+	if(res == nullptr) return nullptr;
+	// given away like a new variable, the caller takes the reference
+	res->dref();
+	return res;
+}
+
+var_base_t *gen_done(vm_state_t &vm, const fn_data_t &fd)
+{
+	return GEN(fd.args[0])->done() ? vm.tru : vm.fals;
+}
+
 INIT_MODULE(utils)
 {
 	const std::string &src_name = vm.current_source_file()->path();
@@ -171,6 +194,10 @@ INIT_MODULE(utils)
 	vm.register_type<var_int_iterable_t>("int_iterable_t", src_id, idx);
 
 	vm.add_native_typefn<var_int_iterable_t>("next", int_iterable_next, 0, src_id, idx);
+	vm.set_iter_next_fn<var_int_iterable_t>(int_iterable_next_fast);
+
+	vm.add_native_typefn<var_gen_t>("next", gen_next, 0, src_id, idx);
+	vm.add_native_typefn<var_gen_t>("done", gen_done, 0, src_id, idx);
 
 	return true;
 }
@@ -31,6 +31,7 @@ const size_t OPT_S = 1 << 12;
 const size_t OPT_T = 1 << 13; // show tokens
 const size_t OPT_V = 1 << 14; // show version
 const size_t OPT_1 = 1 << 15;
+const size_t OPT_O = 1 << 16; // register form byte code (fused instructions)
 
 namespace args
 {
@@ -51,6 +52,10 @@ size_t parse(const int argc, const char **argv, std::unordered_map<std::string,
 
 		if(len > 2 && argv[i][0] == '-' && argv[i][1] == '-') {
 			args.emplace("__long_opt__", argv[i]);
+			// --<name>=<value> is stored as <name> => <value>, --<name> as <name> => ""
+			const char *eq = strchr(argv[i] + 2, '=');
+			if(eq) args[std::string(argv[i] + 2, eq - argv[i] - 2)] = eq + 1;
+			else args[argv[i] + 2] = "";
 			continue;
 		}
 
@@ -72,6 +77,7 @@ size_t parse(const int argc, const char **argv, std::unordered_map<std::string,
 			case 'h': flags |= OPT_H; break;
 			case 'i': flags |= OPT_I; break;
 			case 'l': flags |= OPT_L; break;
+			case 'o': flags |= OPT_O; break;
 			case 'p': flags |= OPT_P; break;
 			case 'r': flags |= OPT_R; break;
 			case 's': flags |= OPT_S; break;
@@ -13,10 +13,142 @@
 
 #include "Compiler/CodeGen.hpp"
 
+#include <cstring>
+
+#include "VM/Memory.hpp"
+
 namespace gen
 {
 bool generate(const ptree_t *ptree, bcode_t &bc)
 {
 	return ptree->gen_code(bc);
 }
+
+static inline void sfree(char *str)
+{
+	mem::free(str, mem::mult8_roundup(strlen(str) + 1));
+}
+
+static inline bool is_jump(const OpCodes op)
+{
+	return op == OP_JMP || op == OP_JMPT || op == OP_JMPF || op == OP_JMPTPOP ||
+	       op == OP_JMPFPOP || op == OP_JMPN || op == OP_BODY_TILL || op == OP_CONTINUE ||
+	       op == OP_BREAK || op == OP_PUSH_JMP || op == OP_FOR_ITER;
+}
+
+// a load which can be used as a register operand (variable or constant)
+static inline bool is_reg_load(const op_t &op)
+{
+	return op.op == OP_LOAD && op.dtype != ODT_SZ && op.dtype != ODT_BOOL &&
+	       op.dtype != ODT_NIL;
+}
+
+static inline bool is_op_name(const op_t &op)
+{
+	return op.op == OP_LOAD && op.dtype == ODT_STR;
+}
+
+// number of instructions that can be fused starting at bcode[i], 0 if none
+static size_t fusable(const std::vector<op_t> &bcode, const size_t &i,
+		      const std::vector<bool> &targets, OpCodes &fused)
+{
+	size_t sz  = bcode.size();
+	size_t len = 0;
+	// LOAD <lhs>; LOAD <name>; LOAD <rhs>; MEM_FNCL "00"
+	if(i + 3 < sz && is_reg_load(bcode[i]) && is_op_name(bcode[i + 1]) &&
+	   is_reg_load(bcode[i + 2]) && bcode[i + 3].op == OP_MEM_FNCL &&
+	   strcmp(bcode[i + 3].data.s, "00") == 0)
+	{
+		fused = OP_BINOP_R;
+		len   = 4;
+	}
+	// LOAD <lhs>; LOAD <name>; MEM_FNCL "0"
+	else if(i + 2 < sz && is_reg_load(bcode[i]) && is_op_name(bcode[i + 1]) &&
+		bcode[i + 2].op == OP_MEM_FNCL &&
+		(strcmp(bcode[i + 2].data.s, "0") == 0 || bcode[i + 2].data.s[0] == '\0'))
+	{
+		fused = OP_UNOP_R;
+		len   = 3;
+	}
+	// LOAD <rhs>; LOAD <lhs - variable>; STORE; ULOAD
+	else if(i + 3 < sz && is_reg_load(bcode[i]) && bcode[i + 1].op == OP_LOAD &&
+		bcode[i + 1].dtype == ODT_IDEN && bcode[i + 2].op == OP_STORE &&
+		bcode[i + 3].op == OP_ULOAD)
+	{
+		fused = OP_MOV_R;
+		len   = 4;
+	}
+	// LOAD <name>; CREATE false
+	else if(i + 1 < sz && is_op_name(bcode[i]) && bcode[i + 1].op == OP_CREATE &&
+		!bcode[i + 1].data.b)
+	{
+		fused = OP_CREATE_R;
+		len   = 2;
+	}
+	// no instruction, other than the first, can be a jump target
+	for(size_t j = i + 1; j < i + len; ++j) {
+		if(targets[j]) return 0;
+	}
+	return len;
+}
+
+void regify(bcode_t &bc)
+{
+	std::vector<op_t> &bcode = bc.getmut();
+	size_t sz		 = bcode.size();
+
+	std::vector<bool> targets(sz + 1, false);
+	for(auto &op : bcode) {
+		if(is_jump(op.op) && op.data.sz <= sz) targets[op.data.sz] = true;
+	}
+
+	std::vector<op_t> res;
+	// old location -> new location (for updating jumps)
+	std::vector<size_t> locs(sz + 1, 0);
+	res.reserve(sz);
+	for(size_t i = 0; i < sz;) {
+		OpCodes fused = _OP_LAST;
+		size_t len    = fusable(bcode, i, targets, fused);
+		if(len == 0) {
+			locs[i] = res.size();
+			res.push_back(bcode[i]);
+			++i;
+			continue;
+		}
+		for(size_t j = i; j < i + len; ++j) locs[j] = res.size();
+		const op_t &first = bcode[i];
+		if(fused == OP_CREATE_R) {
+			res.push_back(op_t{first.src_id, bcode[i + 1].idx, OP_CREATE_R, ODT_STR,
+					   first.data});
+			i += len;
+			continue;
+		}
+		reg_op_t reg{{first.idx, first.dtype, first.data}, {0, ODT_NIL, {.sz = 0}}, nullptr};
+		const op_t &last = bcode[i + len - 1];
+		if(fused == OP_MOV_R) {
+			// lhs is the variable, rhs is the value
+			const op_t &dst = bcode[i + 1];
+			reg.rhs		= reg.lhs;
+			reg.lhs		= {dst.idx, dst.dtype, dst.data};
+			res.push_back(op_t{first.src_id, bcode[i + 2].idx, OP_MOV_R, ODT_SZ,
+					   {.sz = bc.addreg(reg)}});
+			i += len;
+			continue;
+		}
+		reg.name = bcode[i + 1].data.s;
+		if(fused == OP_BINOP_R) {
+			const op_t &rhs = bcode[i + 2];
+			reg.rhs		= {rhs.idx, rhs.dtype, rhs.data};
+		}
+		sfree(last.data.s);
+		res.push_back(
+		op_t{first.src_id, last.idx, fused, ODT_SZ, {.sz = bc.addreg(reg)}});
+		i += len;
+	}
+	locs[sz] = res.size();
+	for(auto &op : res) {
+		if(is_jump(op.op) && op.data.sz <= sz) op.data.sz = locs[op.data.sz];
+	}
+	bcode.swap(res);
+}
 } // namespace gen
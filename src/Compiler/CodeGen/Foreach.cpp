@@ -25,11 +25,9 @@ bool stmt_foreach_t::gen_code(bcode_t &bc) const
 	size_t continue_jmp_pos = bc.size();
 	// let <loop_var> = __<loop_var>.next()
 	bc.adds(m_expr->idx(), OP_LOAD, ODT_IDEN, "__" + m_loop_var->data);
-	bc.adds(m_expr->idx(), OP_LOAD, ODT_STR, "next");
-	bc.adds(m_expr->idx(), OP_MEM_FNCL, ODT_STR, "");
 	// will be set later
 	size_t jmp_loop_out_loc1 = bc.size();
-	bc.addsz(m_loop_var->pos, OP_JMPN, 0);
+	bc.addsz(m_expr->idx(), OP_FOR_ITER, 0);
 	bc.adds(m_loop_var->pos, OP_LOAD, ODT_STR, m_loop_var->data);
 	bc.addb(m_loop_var->pos, OP_CREATE, false);
 
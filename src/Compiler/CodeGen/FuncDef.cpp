@@ -12,8 +12,7 @@
 */
 
 #include "Compiler/CodeGen/Internal.hpp"
-
-static std::vector<std::string> fn_args;
+#include "VM/Vars/Base.hpp"
 
 bool stmt_fn_def_t::gen_code(bcode_t &bc) const
 {
@@ -23,36 +22,47 @@ bool stmt_fn_def_t::gen_code(bcode_t &bc) const
 	if(bc.get().back().op != OP_RET) bc.addb(idx(), OP_RET, false);
 	bc.updatesz(body_till_pos, bc.size());
 
+	// argument names go in the prototype, only the default values are left for runtime
+	fn_proto_t *proto = new fn_proto_t;
+	// a function with 'yield' in its body (not in a nested function) is a generator
+	const std::vector<op_t> &ops = bc.get();
+	for(size_t i = body_till_pos + 1; i < ops.size(); ++i) {
+		if(ops[i].op == OP_BODY_TILL) {
+			i = ops[i].data.sz - 1;
+		} else if(ops[i].op == OP_YIELD) {
+			proto->is_gen = true;
+			break;
+		}
+	}
 	if(m_args) {
-		if(!m_args->gen_code(bc)) return false;
+		if(!m_args->gen_code(bc)) {
+			proto_dref(proto);
+			return false;
+		}
+		if(m_args->kwarg()) proto->kw_arg = m_args->kwarg()->val()->data;
+		if(m_args->vaarg()) proto->var_arg = m_args->vaarg()->val()->data;
+		for(auto &arg : m_args->args()) {
+			const stmt_simple_t *name = nullptr;
+			if(arg->type() == GT_FN_ASSN_ARG) {
+				name = static_cast<const stmt_fn_assn_arg_t *>(arg)->lhs();
+				proto->assn_args.push_back(proto->args.size());
+			} else {
+				name = static_cast<const stmt_simple_t *>(arg);
+			}
+			proto->args.push_back(name->val()->data);
+		}
 	}
 
-	bc.adds(idx(), OP_MKFN, ODT_STR, m_args ? fn_args.back() : "00");
-	if(m_args) fn_args.pop_back();
+	bc.addsz(idx(), OP_MKFN, bc.addproto(proto));
 	return true;
 }
 
 bool stmt_fn_def_args_t::gen_code(bcode_t &bc) const
 {
-	std::string arg_info;
-	arg_info += m_kwarg ? "1" : "0";
-	arg_info += m_vaarg ? "1" : "0";
-
+	// default values - in reverse so that the first one is on top of the stack
 	for(auto arg = m_args.rbegin(); arg != m_args.rend(); ++arg) {
-		if(!(*arg)->gen_code(bc)) return false;
-	}
-
-	for(auto &arg : m_args) {
-		arg_info += arg->type() == GT_FN_ASSN_ARG ? "1" : "0";
+		if((*arg)->type() != GT_FN_ASSN_ARG) continue;
+		if(!static_cast<const stmt_fn_assn_arg_t *>(*arg)->rhs()->gen_code(bc)) return false;
 	}
-
-	if(m_vaarg) {
-		if(!m_vaarg->gen_code(bc)) return false;
-	}
-	if(m_kwarg) {
-		if(!m_kwarg->gen_code(bc)) return false;
-	}
-
-	fn_args.push_back(arg_info);
 	return true;
 }
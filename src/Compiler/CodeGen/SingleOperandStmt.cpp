@@ -20,7 +20,21 @@ bool stmt_single_operand_stmt_t::gen_code(bcode_t &bc) const
 	if(m_operand) m_operand->gen_code(bc);
 
 	if(m_sost->type == TOK_RETURN) {
+		// mark the call in 'return f(...)' as a tail call
+		if(m_operand && m_operand->type() == GT_EXPR) {
+			const stmt_expr_t *expr = static_cast<const stmt_expr_t *>(m_operand);
+			std::vector<op_t> &ops	= bc.getmut();
+			if(expr->oper() && !expr->or_blk() && !ops.empty() &&
+			   (expr->oper()->type == TOK_OPER_FN ||
+			    expr->oper()->type == TOK_OPER_MEM_FN))
+			{
+				if(ops.back().op == OP_FNCL) ops.back().op = OP_TAIL_FNCL;
+				else if(ops.back().op == OP_MEM_FNCL) ops.back().op = OP_TAIL_MEM_FNCL;
+			}
+		}
 		bc.addb(idx(), OP_RET, m_operand);
+	} else if(m_sost->type == TOK_YIELD) {
+		bc.add(idx(), OP_YIELD);
 	} else if(m_sost->type == TOK_CONTINUE) {
 		// placeholder (updated in For, Foreach, While)
 		bc.addsz(idx(), OP_CONTINUE, 0);
@@ -30,6 +30,7 @@ const char *TokStrs[_TOK_LAST] = {
 "in",
 "while",
 "return",
+"yield",
 "continue",
 "break",
 "true",
@@ -276,6 +277,7 @@ static int classify_str(const std::string &str)
 	if(str == TokStrs[TOK_IN]) return TOK_IN;
 	if(str == TokStrs[TOK_WHILE]) return TOK_WHILE;
 	if(str == TokStrs[TOK_RETURN]) return TOK_RETURN;
+	if(str == TokStrs[TOK_YIELD]) return TOK_YIELD;
 	if(str == TokStrs[TOK_CONTINUE]) return TOK_CONTINUE;
 	if(str == TokStrs[TOK_BREAK]) return TOK_BREAK;
 	if(str == TokStrs[TOK_TRUE]) return TOK_TRUE;
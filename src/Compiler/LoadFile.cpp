@@ -66,6 +66,10 @@ Errors fmod_read_code(const std::string &data, const std::string &src_dir,
 	err = gen::generate(ptree, bc) ? E_OK : E_CODEGEN_FAIL;
 	if(err != E_OK) goto end;
 
+	for(auto &proto : bc.protos()) proto->src_name = src_path;
+
+	if(flags & OPT_O) gen::regify(bc);
+
 	// show bytecode
 	if(flags & OPT_B && (flags & OPT_R || is_main_src)) {
 		fprintf(stdout, "Byte Code (%zu):\n", bc.size());
@@ -74,7 +78,35 @@ Errors fmod_read_code(const std::string &data, const std::string &src_dir,
 		for(size_t i = 0; i < bcode.size(); ++i) {
 			fprintf(stdout, "ID: %-*zu  %*s ", id_padding, i, 12,
 				OpCodeStrs[bcode[i].op]);
-			if(bcode[i].dtype == ODT_BOOL) {
+			if(bcode[i].op == OP_MOV_R || bcode[i].op == OP_UNOP_R ||
+			   bcode[i].op == OP_BINOP_R) {
+				const reg_op_t &reg = bc.reg(bcode[i].data.sz);
+				fprintf(stdout, "[%s]\t[%s]", reg.lhs.data.s,
+					OpDataTypeStrs[reg.lhs.dtype]);
+				if(reg.name) fprintf(stdout, " %s", reg.name);
+				if(bcode[i].op != OP_UNOP_R) {
+					fprintf(stdout, " [%s]\t[%s]", reg.rhs.data.s,
+						OpDataTypeStrs[reg.rhs.dtype]);
+				}
+				fprintf(stdout, "\n");
+			} else if(bcode[i].op == OP_MKFN) {
+				const fn_proto_t *proto = bc.proto(bcode[i].data.sz);
+				fprintf(stdout, "[%zu]\t[SZ] (", bcode[i].data.sz);
+				size_t aa = 0;
+				for(size_t j = 0; j < proto->args.size(); ++j) {
+					bool has_def = aa < proto->assn_args.size() &&
+						       proto->assn_args[aa] == j;
+					if(has_def) ++aa;
+					fprintf(stdout, "%s%s%s", j > 0 ? ", " : "",
+						proto->args[j].c_str(), has_def ? " = .." : "");
+				}
+				if(!proto->var_arg.empty()) {
+					fprintf(stdout, "%s%s...", proto->args.empty() ? "" : ", ",
+						proto->var_arg.c_str());
+				}
+				if(!proto->kw_arg.empty()) fprintf(stdout, " kw: %s", proto->kw_arg.c_str());
+				fprintf(stdout, ")%s\n", proto->is_gen ? " gen" : "");
+			} else if(bcode[i].dtype == ODT_BOOL) {
 				fprintf(stdout, "[%s]\t[BOOL]\n", bcode[i].data.b ? "yes" : "no");
 			} else if(bcode[i].dtype == ODT_SZ) {
 				fprintf(stdout, "[%zu]\t[SZ]\n", bcode[i].data.sz);
@@ -12,6 +12,7 @@
 */
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 
@@ -21,6 +22,7 @@
 #include "Common/String.hpp"
 #include "Compiler/Args.hpp"
 #include "Compiler/LoadFile.hpp"
+#include "VM/Profiler.hpp"
 #include "VM/VM.hpp"
 
 int main(int argc, char **argv)
@@ -75,13 +77,51 @@ int main(int argc, char **argv)
 		vm_state_t vm(feral_bin, feral_base, code_args, flags);
 		vm.set_fmod_load_fn(fmod_load);
 		vm.set_fmod_read_code_fn(fmod_read_code);
+		size_t sample_hz = 0;
+		if(args.find("profile") != args.end()) {
+			const std::string &mode = args["profile"];
+			if(mode == "ops") {
+				vm.prof = new vm_prof_t;
+			} else if(mode == "sample" || mode.compare(0, 7, "sample:") == 0) {
+				sample_hz = SAMPLE_HZ_DEFAULT;
+				if(mode.size() > 7) {
+					char *hz_end = nullptr;
+					sample_hz    = strtoul(mode.c_str() + 7, &hz_end, 10);
+					if(*hz_end != '\0') sample_hz = 0;
+				}
+				if(sample_hz == 0) {
+					fprintf(stderr, "invalid sampling frequency in: '%s'\n",
+						mode.c_str());
+					delete main_src;
+					return E_FAIL;
+				}
+			} else {
+				fprintf(stderr,
+					"unknown profile mode: '%s' (available: ops, sample[:hz])\n",
+					mode.c_str());
+				delete main_src;
+				return E_FAIL;
+			}
+		}
 		vm.push_src(main_src, 0);
 		if(!vm.load_core_mods()) {
 			vm.pop_src();
 			err = E_EXEC_FAIL;
 			return err;
 		}
+		if(sample_hz > 0 && !sampler::start(sample_hz)) {
+			fprintf(stderr, "failed to start sampling profiler at %zu hz\n", sample_hz);
+			vm.pop_src();
+			return E_FAIL;
+		}
 		exec_err = vm::exec(vm);
+		if(vm.prof) {
+			auto out = args.find("profile-out");
+			vm.prof->report(vm, out != args.end() ? out->second : "feral.prof.json");
+		} else if(sampler::active()) {
+			auto out = args.find("profile-out");
+			sampler::report(vm, out != args.end() ? out->second : "feral.prof.folded");
+		}
 		vm.pop_src();
 	} else {
 		if(main_src) delete main_src;
@@ -33,7 +33,7 @@ Errors parse_block(phelper_t &ph, stmt_base_t *&loc, const bool with_brace)
 		stmt_base_t *stmt = nullptr;
 		if(ph.accept(TOK_LET)) {
 			if(parse_var_decl(ph, stmt) != E_OK) goto fail;
-		} else if(ph.accept(TOK_CONTINUE, TOK_BREAK, TOK_RETURN)) {
+		} else if(ph.accept(TOK_CONTINUE, TOK_BREAK, TOK_RETURN) || ph.accept(TOK_YIELD)) {
 			if(parse_single_operand_stmt(ph, stmt) != E_OK) goto fail;
 		} else if(ph.accept(TOK_IF)) {
 			if(parse_conditional(ph, stmt) != E_OK) goto fail;
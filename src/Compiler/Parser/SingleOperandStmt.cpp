@@ -20,6 +20,13 @@ Errors parse_single_operand_stmt(phelper_t &ph, stmt_base_t *&loc)
 
 	ph.next();
 
+	if(sost->type == TOK_YIELD && ph.accept(TOK_COLS, TOK_LBRACE)) {
+		err::set(E_PARSE_FAIL, ph.peak()->pos,
+			 "'yield' statement expects an expression after the keyword, found: '%s'",
+			 TokStrs[ph.peakt()]);
+		goto fail;
+	}
+
 	if(ph.accept(TOK_COLS)) {
 		ph.next();
 		goto done;
@@ -14,6 +14,7 @@
 #include <cstring>
 
 #include "VM/Consts.hpp"
+#include "VM/Profiler.hpp"
 #include "VM/Vars.hpp"
 
 struct jump_data_t
@@ -22,10 +23,70 @@ struct jump_data_t
 	size_t pos;
 };
 
+// fetch register operand with a reference which must be released with var_dref()
+// like a LOAD onto the vm stack, the reference keeps a variable alive even if the function
+// called by the instruction reassigns or removes it
+static inline var_base_t *reg_get(vm_state_t &vm, vars_t *vars, const reg_t &reg,
+				  const size_t &src_id)
+{
+	var_base_t *res = nullptr;
+	if(reg.dtype != ODT_IDEN) {
+		res = consts::get(vm, reg.dtype, reg.data, src_id, reg.idx);
+		if(res == nullptr) {
+			vm.fail(src_id, reg.idx, "invalid data received as const");
+			return nullptr;
+		}
+		var_iref(res);
+		return res;
+	}
+	res = vars->get(reg.data.s);
+	if(res == nullptr) res = vm.gget(reg.data.s);
+	if(res == nullptr) {
+		vm.fail(src_id, reg.idx, "variable '%s' does not exist", reg.data.s);
+		return nullptr;
+	}
+	var_iref(res);
+	return res;
+}
+
+// native functions are called directly and their time is recorded by the profiler here,
+// feral functions are recorded by exec_internal() itself
+template<bool PROF>
+static inline var_base_t *call_fn(vm_state_t &vm, var_base_t *fn,
+				  const std::vector<var_base_t *> &args,
+				  const std::vector<fn_assn_arg_t> &assn_args,
+				  const std::unordered_map<std::string, size_t> &assn_args_loc,
+				  const size_t &src_id, const size_t &idx)
+{
+	if(!fn->istype<var_fn_t>() || !FN(fn)->is_native()) {
+		return fn->call(vm, args, assn_args, assn_args_loc, src_id, idx);
+	}
+	// natives are called directly with a view of the argument storage
+	uint64_t begin	= PROF ? vm_prof_t::now() : 0;
+	var_base_t *res = FN(fn)->call_native(vm, {src_id, idx, args, assn_args, assn_args_loc});
+	if(PROF) vm.prof->native_add(FN(fn)->body().native, vm_prof_t::now() - begin);
+	if(res == nullptr) return nullptr;
+	vm.vm_stack->push(res);
+	return vm.nil;
+}
+
+static inline void prof_end(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &src_id,
+			    const size_t &begin, const size_t &end, const uint64_t &prof_begin)
+{
+	vm.prof->frame_pop();
+	// end is non zero only for function bodies
+	if(!custom_bcode && end != 0) {
+		vm.prof->fn_add(src_id, begin, vm_prof_t::now() - prof_begin);
+	}
+}
+
 namespace vm
 {
-// declared in VM.hpp
-int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const size_t &end)
+// PROF = profiling enabled (vm.prof is set), SAMPLE = sampling profiler is active
+// separate instantiations so that profiling has no overhead when disabled
+template<bool PROF, bool SAMPLE>
+static int exec_internal(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin,
+			 const size_t &end, gen_frame_t *gen)
 {
 	++vm.exec_stack_count;
 	var_src_t *src	    = vm.current_source();
@@ -33,7 +94,8 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 	srcfile_t *src_file = src->src();
 	size_t src_id	    = src_file->id();
 	vm_stack_t *vms	    = vm.vm_stack;
-	const auto &bc	    = custom_bcode ? custom_bcode->get() : src_file->bcode().get();
+	const bcode_t &bcode = custom_bcode ? *custom_bcode : src_file->bcode();
+	const auto &bc	     = bcode.get();
 	size_t bc_sz	    = end == 0 ? bc.size() : end;
 
 	std::vector<fn_body_span_t> bodies;
@@ -43,10 +105,31 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 
 	std::vector<jump_data_t> jmps;
 
-	if(!custom_bcode) vars->push_fn();
+	if(gen) vars->push_fn(gen->vars);
+	else if(!custom_bcode) vars->push_fn();
 
-	for(size_t i = begin; i < bc_sz; ++i) {
+	uint64_t prof_begin = 0;
+	if(PROF) {
+		vm.prof->frame_push();
+		prof_begin = vm_prof_t::now();
+	}
+	exec_frame_t frame;
+	size_t sample_ops = 0;
+	if(SAMPLE) {
+		frame.src_id = src_id;
+		// end is non zero only for function bodies
+		frame.begin = !custom_bcode && end != 0 ? begin : 0;
+		frame.op    = nullptr;
+		sampler::frame_push(frame);
+	}
+
+	for(size_t i = gen ? gen->pos : begin; i < bc_sz; ++i) {
 		const op_t &op = bc[i];
+		if(PROF) vm.prof->op(op);
+		if(SAMPLE) {
+			frame.op = &op;
+			if((++sample_ops & 1023) == 0) sampler::safe_point();
+		}
 		if(vm.exec_stack_count >= vm.exec_stack_max) {
 			vm.fail(bc[i].src_id, bc[i].idx, "exceeded call stack size, currently: %zu",
 				vm.exec_stack_count);
@@ -220,46 +303,31 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 			break;
 		}
 		case OP_MKFN: {
-			std::string kw_arg;
-			std::string var_arg;
-			std::vector<std::string> args;
+			fn_proto_t *proto = bcode.proto(op.data.sz);
 			std::unordered_map<std::string, var_base_t *> assn_args;
-			if(op.data.s[0] == '1') {
-				kw_arg = STR(vms->back())->get();
-				vms->pop();
-			}
-			if(op.data.s[1] == '1') {
-				var_arg = STR(vms->back())->get();
+			for(auto &aa : proto->assn_args) {
+				// name is guaranteed to be unique, thanks to parser
+				assn_args[proto->args[aa]] = vms->back()->copy(op.src_id, op.idx);
 				vms->pop();
 			}
 
-			size_t arg_sz = strlen(op.data.s);
-			for(size_t i = 2; i < arg_sz; ++i) {
-				std::string name = STR(vms->back())->get();
-				vms->pop();
-				if(op.data.s[i] == '1') {
-					// name is guaranteed to be unique, thanks to parser
-					assn_args[name] = vms->back()->copy(op.src_id, op.idx);
-					vms->pop();
-				}
-				args.push_back(name);
-			}
-
 			fn_body_span_t body = bodies.back();
 			bodies.pop_back();
 
-			vms->push(new var_fn_t(src_file->path(), kw_arg, var_arg, args, assn_args,
-					       fn_body_t{.feral = body}, false, op.src_id, op.idx),
+			vms->push(new var_fn_t(proto, assn_args, fn_body_t{.feral = body}, false,
+					       op.src_id, op.idx),
 				  false);
 			break;
 		}
-		case OP_MEM_FNCL: // fallthrough
+		case OP_TAIL_MEM_FNCL: // fallthrough
+		case OP_TAIL_FNCL:     // fallthrough
+		case OP_MEM_FNCL:      // fallthrough
 		case OP_FNCL: {
 			args.clear();
 			assn_args.clear();
 			assn_args_loc.clear();
 			size_t len     = strlen(op.data.s);
-			bool mem_call  = op.op == OP_MEM_FNCL;
+			bool mem_call  = op.op == OP_MEM_FNCL || op.op == OP_TAIL_MEM_FNCL;
 			bool va_unpack = op.data.s[0] == '1';
 			for(size_t i = 1; i < len; ++i) {
 				if(op.data.s[i] == '0') {
@@ -317,7 +385,22 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 				goto fncall_fail;
 			}
 			args.insert(args.begin(), in_base);
-			res = fn_base->call(vm, args, assn_args, assn_args_loc, op.src_id, op.idx);
+			// tail call of a feral function from a function body (end is only non zero
+			// for function bodies) - var_fn_t::call() performs it after this frame is gone
+			if((op.op == OP_TAIL_FNCL || op.op == OP_TAIL_MEM_FNCL) && !custom_bcode &&
+			   end != 0 && !gen && fn_base->istype<var_fn_t>() &&
+			   !FN(fn_base)->is_native())
+			{
+				if(mem_call) var_iref(fn_base);
+				vm.tail_call.fn	    = FN(fn_base);
+				vm.tail_call.src_id = op.src_id;
+				vm.tail_call.idx    = op.idx;
+				vm.tail_call.args.swap(args);
+				vm.tail_call.assn_args.swap(assn_args);
+				goto done;
+			}
+			res = call_fn<PROF>(vm, fn_base, args, assn_args, assn_args_loc, op.src_id,
+					    op.idx);
 			// don't show the following failure when exec stack count is exceeded or
 			// there'll be a GIANT stack trace
 			if(!res) {
@@ -367,6 +450,22 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 			}
 			goto done;
 		}
+		case OP_YIELD: {
+			if(!gen) {
+				vm.fail(op.src_id, op.idx,
+					"'yield' can only be used in the body of a function");
+				vms->pop();
+				goto handle_error;
+			}
+			if(!jmps.empty()) {
+				vm.fail(op.src_id, op.idx, "cannot yield inside an 'or' block");
+				vms->pop();
+				goto handle_error;
+			}
+			gen->pos  = i + 1;
+			gen->vars = vars->pop_fn_detach();
+			goto suspend;
+		}
 		case OP_PUSH_LOOP: {
 			vars->push_loop();
 			break;
@@ -385,6 +484,95 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 			i = op.data.sz - 1;
 			break;
 		}
+		case OP_FOR_ITER: {
+			var_base_t *it = vms->pop(false);
+			// generator - resumed directly, the value is left for loop variable creation
+			// (which copies it if the generator still refers to it), nil ends the loop
+			if(it->istype<var_gen_t>()) {
+				var_base_t *val = GEN(it)->next(vm, op.src_id, op.idx);
+				var_dref(it);
+				if(val == nullptr) {
+					if(!vm.exec_stack_count_exceeded) {
+						vm.fail(op.src_id, op.idx,
+							"generator failed, look at error above");
+					}
+					goto handle_error;
+				}
+				if(vm.exit_called) {
+					var_dref(val);
+					goto done;
+				}
+				if(val->istype<var_nil_t>()) {
+					var_dref(val);
+					i = op.data.sz - 1;
+					break;
+				}
+				vms->push(val, false);
+				break;
+			}
+			iter_next_fn_t next_fn = vm.get_iter_next_fn(it->type());
+			// user iterable - call it.next() and leave the result for loop variable
+			// creation, nil ends the loop
+			if(next_fn == nullptr) {
+				var_base_t *fn_base = nullptr;
+				var_base_t *res	    = nullptr;
+				if(it->attr_based()) fn_base = it->attr_get("next");
+				if(fn_base == nullptr) fn_base = vm.get_typefn(it, "next");
+				if(!fn_base) {
+					vm.fail(op.src_id, op.idx,
+						"callable '%s' does not exist for %s", "next",
+						vm.type_name(it).c_str());
+					var_dref(it);
+					goto handle_error;
+				}
+				if(!fn_base->callable()) {
+					vm.fail(op.src_id, op.idx,
+						"'%s' is not a function or struct definition",
+						vm.type_name(fn_base).c_str());
+					var_dref(it);
+					goto handle_error;
+				}
+				args.clear();
+				assn_args.clear();
+				assn_args_loc.clear();
+				args.push_back(it);
+				res = call_fn<PROF>(vm, fn_base, args, assn_args, assn_args_loc,
+						    op.src_id, op.idx);
+				var_dref(it);
+				if(!res) {
+					if(!vm.exec_stack_count_exceeded) {
+						vm.fail(op.src_id, op.idx,
+							"%s call failed, look at error above",
+							vm.type_name(fn_base).c_str());
+					}
+					goto handle_error;
+				}
+				if(!res->istype<var_nil_t>()) {
+					vms->push(res, false);
+				}
+				if(vm.exit_called) goto done;
+				if(vms->back()->istype<var_nil_t>()) {
+					vms->pop();
+					i = op.data.sz - 1;
+				}
+				break;
+			}
+			// builtin iterable - bind the value to loop variable here and skip the
+			// loop variable creation instructions
+			const char *name    = bc[i + 1].data.s;
+			var_base_t *reuse   = vars->get_curr(name);
+			var_base_t *val	    = nullptr;
+			if(reuse && reuse->ref() > 1) reuse = nullptr;
+			val = next_fn(vm, it, reuse, op.src_id, op.idx);
+			var_dref(it);
+			if(val == nullptr) {
+				i = op.data.sz - 1;
+				break;
+			}
+			if(val != reuse) vars->add(name, val, true);
+			i += bc[i + 1].op == OP_CREATE_R ? 1 : 2;
+			break;
+		}
 		case OP_PUSH_JMP: {
 			// name is set in the next instruction
 			jmps.push_back({nullptr, op.data.sz});
@@ -393,6 +581,7 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 		}
 		case OP_PUSH_JMPN: {
 			jmps.back().name = op.data.s;
+			vm.fails.set_named();
 			break;
 		}
 		case OP_POP_JMP: {
@@ -400,6 +589,93 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 			vm.fails.blkr();
 			break;
 		}
+		case OP_CREATE_R: {
+			var_base_t *val = vms->pop(false);
+			if(val->load_as_ref() || val->ref() == 1) {
+				vars->add(op.data.s, val, true);
+				val->unset_load_as_ref();
+			} else {
+				vars->add(op.data.s, val->copy(op.src_id, op.idx), false);
+			}
+			var_dref(val);
+			break;
+		}
+		case OP_MOV_R: {
+			const reg_op_t &reg = bcode.reg(op.data.sz);
+			var_base_t *val	    = reg_get(vm, vars, reg.rhs, op.src_id);
+			if(val == nullptr) goto handle_error;
+			var_base_t *var = reg_get(vm, vars, reg.lhs, op.src_id);
+			if(var == nullptr) {
+				var_dref(val);
+				goto handle_error;
+			}
+			if(var->type() != val->type()) {
+				vm.fail(op.src_id, op.idx,
+					"type mismatch for assignment: %s cannot be assigned to "
+					"variable of type: %s",
+					vm.type_name(val).c_str(), vm.type_name(var).c_str());
+				var_dref(val);
+				goto handle_error;
+			}
+			var->set(val);
+			var_dref(val);
+			break;
+		}
+		case OP_UNOP_R: // fallthrough
+		case OP_BINOP_R: {
+			const reg_op_t &reg = bcode.reg(op.data.sz);
+			var_base_t *in_base = reg_get(vm, vars, reg.lhs, op.src_id);
+			var_base_t *arg	    = nullptr;
+			var_base_t *fn_base = nullptr;
+			var_base_t *res	    = nullptr;
+			if(in_base == nullptr) goto handle_error;
+			if(op.op == OP_BINOP_R) {
+				arg = reg_get(vm, vars, reg.rhs, op.src_id);
+				if(arg == nullptr) {
+					var_dref(in_base);
+					goto handle_error;
+				}
+			}
+			if(in_base->attr_based()) fn_base = in_base->attr_get(reg.name);
+			if(fn_base == nullptr) fn_base = vm.get_typefn(in_base, reg.name);
+			if(!fn_base) {
+				vm.fail(op.src_id, op.idx, "callable '%s' does not exist for %s",
+					reg.name, vm.type_name(in_base).c_str());
+				goto regcall_fail;
+			}
+			if(!fn_base->callable()) {
+				vm.fail(op.src_id, op.idx,
+					"'%s' is not a function or struct definition",
+					vm.type_name(fn_base).c_str());
+				goto regcall_fail;
+			}
+			args.clear();
+			assn_args.clear();
+			assn_args_loc.clear();
+			args.push_back(in_base);
+			if(arg) args.push_back(arg);
+			res = call_fn<PROF>(vm, fn_base, args, assn_args, assn_args_loc, op.src_id,
+					    op.idx);
+			if(!res) {
+				if(!vm.exec_stack_count_exceeded) {
+					vm.fail(op.src_id, op.idx,
+						"%s call failed, look at error above",
+						vm.type_name(fn_base).c_str());
+				}
+				goto regcall_fail;
+			}
+			if(!res->istype<var_nil_t>()) {
+				vms->push(res, false);
+			}
+			var_dref(in_base);
+			if(arg) var_dref(arg);
+			if(vm.exit_called) goto done;
+			break;
+		regcall_fail:
+			var_dref(in_base);
+			if(arg) var_dref(arg);
+			goto handle_error;
+		}
 		// NOOP - only exists for completeness sake + for handle_error
 		case _OP_LAST: {
 			assert(false); // flow should never come here
@@ -429,12 +705,28 @@ int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const
 done:
 	assert(jmps.size() == 0);
 	if(!custom_bcode) vars->pop_fn();
+	if(gen) gen->vars = nullptr;
+suspend:
 	--vm.exec_stack_count;
+	if(PROF) prof_end(vm, custom_bcode, src_id, begin, end, prof_begin);
+	if(SAMPLE) sampler::frame_pop(frame);
 	return vm.exit_code;
 fail:
 	if(!custom_bcode) vars->pop_fn();
+	if(gen) gen->vars = nullptr;
 	--vm.exec_stack_count;
+	if(PROF) prof_end(vm, custom_bcode, src_id, begin, end, prof_begin);
+	if(SAMPLE) sampler::frame_pop(frame);
 	return E_EXEC_FAIL;
 }
 
+// declared in VM.hpp
+int exec(vm_state_t &vm, const bcode_t *custom_bcode, const size_t &begin, const size_t &end,
+	 gen_frame_t *gen)
+{
+	if(vm.prof) return exec_internal<true, false>(vm, custom_bcode, begin, end, gen);
+	if(sampler::active()) return exec_internal<false, true>(vm, custom_bcode, begin, end, gen);
+	return exec_internal<false, false>(vm, custom_bcode, begin, end, gen);
+}
+
 } // namespace vm
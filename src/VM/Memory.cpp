@@ -93,16 +93,17 @@ void *mem_mgr_t::alloc(size_t sz)
 	}
 
 	if(m_free_chunks[sz].size() == 0) {
-		for(auto &p : m_pools) {
-			size_t free_space = POOL_SIZE - (p.head - p.mem);
-			if(free_space >= sz) {
-				u8 *loc = p.head;
-				p.head += sz;
+		// only the last pool can have free space worth using - scanning all the pools
+		// makes allocation linear in the number of live objects
+		auto &last	  = m_pools.back();
+		size_t free_space = POOL_SIZE - (last.head - last.mem);
+		if(free_space >= sz) {
+			u8 *loc = last.head;
+			last.head += sz;
 #if defined(MEM_PROFILE) && defined(DEBUG_MODE)
-				fprintf(stdout, "Allocating from pool ... %zu\n", sz);
+			fprintf(stdout, "Allocating from pool ... %zu\n", sz);
 #endif
-				return loc;
-			}
+			return loc;
 		}
 		alloc_pool();
 		auto &p = m_pools.back();
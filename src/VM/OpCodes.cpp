@@ -16,6 +16,7 @@
 #include <cstring>
 
 #include "VM/Memory.hpp"
+#include "VM/Vars/Base.hpp"
 
 const char *OpCodeStrs[_OP_LAST] = {
 "CREATE", // create a new variable
@@ -36,22 +37,32 @@ const char *OpCodeStrs[_OP_LAST] = {
 "BLK_ADD", // add count scopes
 "BLK_REM", // rem count scopes
 
-"FUNC_CALL",   // call a function
-"M_FUNC_CALL", // call a member function (string arg - argument format)
-"ATTRIBUTE",   // get attribute from an object (string arg - argument format)
+"FUNC_CALL",	// call a function
+"M_FUNC_CALL",	// call a member function (string arg - argument format)
+"T_FUNC_CALL",	// call a function in tail position
+"TM_FUNC_CALL", // call a member function in tail position
+"ATTRIBUTE",	// get attribute from an object (string arg - argument format)
 
 "RETURN",   // return - bool - false pushes nil on top of stack
+"YIELD",    // suspends the generator function, leaving the value on top of stack
 "CONTINUE", // size_t operand - jump to
 "BREAK",    // size_t operand - jump to
 
 // for loops
 "PUSH_LOOP", // marks a loop's beginning for variable stack
 "POP_LOOP",  // marks a loop's ending for variable stack
+"FOR_ITER",  // pushes next value of iterable or jumps to operand if exhausted
 
 // for 'or' keyword as of right now
 "OP_PUSH_JMP",	// marks the position to jump to if 'or' exists in an expression
 "OP_PUSH_JMPN", // sets the variable name for last jump instruction (must occur after OP_PUSH_JMP)
 "OP_POP_JMP",	// unmarks the position to jump to if 'or' exists in an expression
+
+// register form instructions
+"CREATE_R", // create a new variable (string operand - name) from value on stack
+"MOV_R",    // store value of reg op's rhs in lhs variable
+"UNOP_R",   // call reg op's name on lhs
+"BINOP_R",  // call reg op's name on lhs with rhs as argument
 };
 
 const char *OpDataTypeStrs[_ODT_LAST] = {
@@ -70,13 +81,28 @@ inline char *scpy(const std::string &str)
 	return strcpy(res, str.c_str());
 }
 
+static inline void sfree(char *str)
+{
+	mem::free(str, mem::mult8_roundup(strlen(str) + 1));
+}
+
 bcode_t::~bcode_t()
 {
 	for(auto &op : m_bcode) {
 		if(op.dtype != ODT_SZ && op.dtype != ODT_BOOL && op.dtype != ODT_NIL) {
-			mem::free(op.data.s, mem::mult8_roundup(strlen(op.data.s) + 1));
+			sfree(op.data.s);
+		}
+	}
+	for(auto &r : m_regs) {
+		if(r.lhs.dtype != ODT_SZ && r.lhs.dtype != ODT_BOOL && r.lhs.dtype != ODT_NIL) {
+			sfree(r.lhs.data.s);
+		}
+		if(r.rhs.dtype != ODT_SZ && r.rhs.dtype != ODT_BOOL && r.rhs.dtype != ODT_NIL) {
+			sfree(r.rhs.data.s);
 		}
+		if(r.name) sfree(r.name);
 	}
+	for(auto &p : m_protos) proto_dref(p);
 }
 
 void bcode_t::add(const size_t &idx, const OpCodes op)
@@ -101,6 +127,18 @@ void bcode_t::addsz(const size_t &idx, const OpCodes op, const size_t &data)
 	m_bcode.push_back(op_t{0, idx, op, ODT_SZ, {.sz = data}});
 }
 
+size_t bcode_t::addreg(const reg_op_t &reg)
+{
+	m_regs.push_back(reg);
+	return m_regs.size() - 1;
+}
+
+size_t bcode_t::addproto(fn_proto_t *proto)
+{
+	m_protos.push_back(proto);
+	return m_protos.size() - 1;
+}
+
 OpCodes bcode_t::at(const size_t &pos) const
 {
 	if(pos >= m_bcode.size()) return _OP_LAST;
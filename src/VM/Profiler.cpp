@@ -0,0 +1,537 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+
+#include "VM/Profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <map>
+#include <sys/time.h>
+
+#include "VM/VM.hpp"
+
+// number of entries shown in text report for lines and functions
+#define PROF_REPORT_TOP 20
+
+struct prof_entry_t
+{
+	std::string name;
+	std::string file;
+	size_t line; // 0 if unknown
+	vm_prof_t::stat_t stat;
+};
+
+static void merge_stat(vm_prof_t::stat_t &into, const vm_prof_t::stat_t &from)
+{
+	into.count += from.count;
+	into.time += from.time;
+}
+
+static std::string json_str(const std::string &str)
+{
+	std::string res = "\"";
+	for(auto &c : str) {
+		if(c == '"' || c == '\\') {
+			res += '\\';
+			res += c;
+		} else if((unsigned char)c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			res += buf;
+		} else {
+			res += c;
+		}
+	}
+	return res + "\"";
+}
+
+// demangled symbol name without argument list
+static std::string sym_name(const char *sym)
+{
+	int status	= 0;
+	char *demangled = abi::__cxa_demangle(sym, nullptr, nullptr, &status);
+	if(status != 0 || !demangled) return sym;
+	std::string res = demangled;
+	free(demangled);
+	size_t paren = res.find('(');
+	if(paren != std::string::npos) res.erase(paren);
+	return res;
+}
+
+static bool src_line(vm_state_t &vm, const size_t &src_id, const size_t &idx, std::string &file,
+		     size_t &line)
+{
+	var_src_t *src = vm.get_src(src_id);
+	if(src == nullptr) return false;
+	src_col_range_t range;
+	file = src->src()->path();
+	if(!src->src()->find_line(idx, line, range)) return false;
+	++line;
+	return true;
+}
+
+static bool entry_cmp(const prof_entry_t &a, const prof_entry_t &b)
+{
+	return a.stat.time > b.stat.time;
+}
+
+static void report_text(const char *title, const char *what,
+			const std::vector<prof_entry_t> &entries, const uint64_t &total,
+			const size_t &max)
+{
+	fprintf(stderr, "\n%s:\n", title);
+	fprintf(stderr, "%14s %12s %7s  %s\n", "count", "time(us)", "time%", what);
+	for(size_t i = 0; i < entries.size() && i < max; ++i) {
+		const prof_entry_t &e = entries[i];
+		fprintf(stderr, "%14zu %12.1f %6.2f%%  ", e.stat.count, e.stat.time / 1000.0,
+			total ? e.stat.time * 100.0 / total : 0.0);
+		if(!e.name.empty()) fprintf(stderr, "%s ", e.name.c_str());
+		if(!e.file.empty()) fprintf(stderr, "%s", e.file.c_str());
+		if(e.line) fprintf(stderr, ":%zu", e.line);
+		fprintf(stderr, "\n");
+	}
+}
+
+static void report_json(FILE *f, const char *key, const std::vector<prof_entry_t> &entries,
+			const bool &last)
+{
+	fprintf(f, "  %s: [", json_str(key).c_str());
+	for(size_t i = 0; i < entries.size(); ++i) {
+		const prof_entry_t &e = entries[i];
+		fprintf(f, "%s\n    {\"name\": %s, \"file\": %s, \"line\": %zu, \"count\": %zu, "
+			   "\"time_ns\": %" PRIu64 "}",
+			i == 0 ? "" : ",", json_str(e.name).c_str(), json_str(e.file).c_str(), e.line,
+			e.stat.count, e.stat.time);
+	}
+	fprintf(f, "\n  ]%s\n", last ? "" : ",");
+}
+
+static void merge_stats(std::unordered_map<uint64_t, vm_prof_t::stat_t> &into,
+			const std::unordered_map<uint64_t, vm_prof_t::stat_t> &from)
+{
+	for(auto &s : from) merge_stat(into[s.first], s.second);
+}
+
+vm_prof_t::vm_prof_t()
+	: m_parent(nullptr), m_threads_stats(), m_ops(), m_curr_op(_OP_LAST), m_curr_loc(nullptr),
+	  m_last(0)
+{}
+vm_prof_t::~vm_prof_t()
+{
+	for(auto &c : m_children) delete c;
+}
+
+void vm_prof_t::frame_push()
+{
+	uint64_t t = now();
+	charge(t);
+	m_frames.push_back({m_curr_op, m_curr_loc});
+	m_curr_op = _OP_LAST;
+	m_last	  = t;
+}
+void vm_prof_t::frame_pop()
+{
+	uint64_t t = now();
+	charge(t);
+	m_curr_op  = m_frames.back().first;
+	m_curr_loc = m_frames.back().second;
+	m_frames.pop_back();
+	m_last = t;
+}
+
+void vm_prof_t::fn_add(const size_t &src_id, const size_t &begin, const uint64_t &time)
+{
+	stat_t &s = m_fns[loc_key(src_id, begin)];
+	++s.count;
+	s.time += time;
+}
+void vm_prof_t::native_add(nativefnptr_t fn, const uint64_t &time)
+{
+	stat_t &s = m_natives[fn];
+	++s.count;
+	s.time += time;
+}
+
+vm_prof_t *vm_prof_t::thread_copy()
+{
+	// threads started by threads are registered with the main profiler as well, since this
+	// one is gone once its thread is done
+	if(m_parent) return m_parent->thread_copy();
+	vm_prof_t *prof = new vm_prof_t;
+	prof->m_parent	= this;
+	std::lock_guard<std::mutex> lock(m_children_mtx);
+	m_children.push_back(prof);
+	return prof;
+}
+
+void vm_prof_t::thread_done()
+{
+	vm_prof_t *p = m_parent;
+	std::lock_guard<std::mutex> lock(p->m_children_mtx);
+	for(size_t i = 0; i < _OP_LAST; ++i) merge_stat(p->m_threads_stats.ops[i], m_ops[i]);
+	merge_stats(p->m_threads_stats.locs, m_locs);
+	merge_stats(p->m_threads_stats.fns, m_fns);
+	for(auto &n : m_natives) merge_stat(p->m_threads_stats.natives[n.first], n.second);
+	p->m_children.erase(std::find(p->m_children.begin(), p->m_children.end(), this));
+	delete this;
+}
+
+// threads which are still running are not included
+void vm_prof_t::report(vm_state_t &vm, const std::string &json_path)
+{
+	stat_t ops[_OP_LAST];
+	std::unordered_map<uint64_t, stat_t> locs = m_locs;
+	std::unordered_map<uint64_t, stat_t> fns  = m_fns;
+	std::unordered_map<nativefnptr_t, stat_t> natives = m_natives;
+	std::copy(m_ops, m_ops + _OP_LAST, ops);
+	{
+		std::lock_guard<std::mutex> lock(m_children_mtx);
+		for(size_t i = 0; i < _OP_LAST; ++i) merge_stat(ops[i], m_threads_stats.ops[i]);
+		merge_stats(locs, m_threads_stats.locs);
+		merge_stats(fns, m_threads_stats.fns);
+		for(auto &n : m_threads_stats.natives) merge_stat(natives[n.first], n.second);
+	}
+
+	uint64_t total = 0;
+	std::vector<prof_entry_t> op_entries;
+	for(size_t i = 0; i < _OP_LAST; ++i) {
+		total += ops[i].time;
+		if(ops[i].count == 0) continue;
+		op_entries.push_back({OpCodeStrs[i], "", 0, ops[i]});
+	}
+
+	// instruction locations are grouped by source line
+	std::unordered_map<uint64_t, prof_entry_t> line_map;
+	for(auto &l : locs) {
+		std::string file;
+		size_t line = 0;
+		if(!src_line(vm, l.first >> 40, l.first & ((1ULL << 40) - 1), file, line)) continue;
+		prof_entry_t &e = line_map[loc_key(l.first >> 40, line)];
+		e.file		= file;
+		e.line		= line;
+		merge_stat(e.stat, l.second);
+	}
+	std::vector<prof_entry_t> line_entries;
+	for(auto &l : line_map) line_entries.push_back(l.second);
+
+	std::vector<prof_entry_t> fn_entries;
+	for(auto &f : fns) {
+		size_t src_id  = f.first >> 40;
+		size_t begin   = f.first & ((1ULL << 40) - 1);
+		var_src_t *src = vm.get_src(src_id);
+		prof_entry_t e{"fn", "", 0, f.second};
+		if(src && begin > 0 && begin <= src->src()->bcode().size()) {
+			src_line(vm, src_id, src->src()->bcode().get()[begin - 1].idx, e.file, e.line);
+		}
+		fn_entries.push_back(e);
+	}
+	for(auto &n : natives) {
+		Dl_info info = {};
+		prof_entry_t e{"native", "", 0, n.second};
+		if(dladdr((void *)n.first, &info)) {
+			if(info.dli_sname) e.name += " " + sym_name(info.dli_sname);
+			if(info.dli_fname) e.file = info.dli_fname;
+		}
+		fn_entries.push_back(e);
+	}
+
+	std::sort(op_entries.begin(), op_entries.end(), entry_cmp);
+	std::sort(line_entries.begin(), line_entries.end(), entry_cmp);
+	std::sort(fn_entries.begin(), fn_entries.end(), entry_cmp);
+
+	fprintf(stderr, "\nProfile (ops), total time: %.3f ms\n", total / 1000000.0);
+	report_text("Opcodes", "opcode", op_entries, total, op_entries.size());
+	report_text("Lines", "location", line_entries, total, PROF_REPORT_TOP);
+	report_text("Functions (inclusive time)", "function", fn_entries, total,
+		    PROF_REPORT_TOP);
+
+	if(json_path.empty()) return;
+	FILE *f = fopen(json_path.c_str(), "w");
+	if(!f) {
+		fprintf(stderr, "failed to open profile output file: %s\n", json_path.c_str());
+		return;
+	}
+	fprintf(f, "{\n  \"total_ns\": %" PRIu64 ",\n", total);
+	report_json(f, "opcodes", op_entries, false);
+	report_json(f, "lines", line_entries, false);
+	report_json(f, "functions", fn_entries, true);
+	fprintf(f, "}\n");
+	fclose(f);
+	fprintf(stderr, "\nprofile written to: %s\n", json_path.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////// Sampling Profiler /////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// max frames recorded per sample (innermost ones)
+#define SAMPLE_DEPTH_MAX 64
+// samples which can be recorded before the thread drains them
+#define SAMPLE_RING_SZ 512
+
+namespace sampler
+{
+struct sample_loc_t
+{
+	size_t src_id; // of the frame
+	size_t begin;
+	size_t op_src_id;
+	size_t op_idx;
+};
+
+struct sample_t
+{
+	size_t depth;
+	sample_loc_t locs[SAMPLE_DEPTH_MAX];
+};
+
+struct thread_t
+{
+	size_t id;
+	exec_frame_t *volatile top;
+	// written by signal handler, read by drain()
+	sample_t ring[SAMPLE_RING_SZ];
+	std::atomic<size_t> wr;
+	std::atomic<size_t> rd;
+	std::atomic<size_t> dropped;
+	// aggregated stacks (root frame first) -> sample count
+	std::map<std::vector<size_t>, size_t> stacks;
+	std::mutex mtx;
+};
+
+// the first access of a (default model) thread local in a shared library may allocate, which
+// must not happen in the signal handler - initial exec ones are allocated with the thread
+#if defined(__GNUC__)
+#define TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define TLS_INITIAL_EXEC
+#endif
+
+static std::atomic<bool> s_active(false);
+static size_t s_hz = 0;
+static std::vector<thread_t *> s_threads;
+static std::mutex s_threads_mtx;
+static thread_local thread_t *tl_thread TLS_INITIAL_EXEC = nullptr;
+
+static void on_sigprof(int sig)
+{
+	if(!s_active.load(std::memory_order_acquire)) return;
+	thread_t *t = tl_thread;
+	if(t == nullptr) return;
+	size_t wr = t->wr.load(std::memory_order_relaxed);
+	if(wr - t->rd.load(std::memory_order_acquire) >= SAMPLE_RING_SZ) {
+		t->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	sample_t &s = t->ring[wr % SAMPLE_RING_SZ];
+	s.depth	    = 0;
+	for(exec_frame_t *f = t->top; f != nullptr && s.depth < SAMPLE_DEPTH_MAX; f = f->prev) {
+		const op_t *op = f->op;
+		s.locs[s.depth++] = {f->src_id, f->begin, op ? op->src_id : f->src_id,
+				     op ? op->idx : 0};
+	}
+	t->wr.store(wr + 1, std::memory_order_release);
+}
+
+// moves recorded samples of t to its aggregated stacks
+static void drain(thread_t *t)
+{
+	std::lock_guard<std::mutex> lock(t->mtx);
+	size_t rd = t->rd.load(std::memory_order_relaxed);
+	size_t wr = t->wr.load(std::memory_order_acquire);
+	std::vector<size_t> key;
+	for(; rd < wr; ++rd) {
+		const sample_t &s = t->ring[rd % SAMPLE_RING_SZ];
+		key.clear();
+		for(size_t i = s.depth; i > 0; --i) {
+			key.push_back(s.locs[i - 1].src_id);
+			key.push_back(s.locs[i - 1].begin);
+		}
+		// innermost instruction location
+		if(s.depth > 0) {
+			key.push_back(s.locs[0].op_src_id);
+			key.push_back(s.locs[0].op_idx);
+		}
+		++t->stacks[key];
+	}
+	t->rd.store(rd, std::memory_order_release);
+}
+
+static thread_t *register_thread()
+{
+	thread_t *t = new thread_t;
+	t->top	    = nullptr;
+	t->wr	    = 0;
+	t->rd	    = 0;
+	t->dropped  = 0;
+	{
+		std::lock_guard<std::mutex> lock(s_threads_mtx);
+		t->id = s_threads.size();
+		s_threads.push_back(t);
+	}
+	tl_thread = t;
+	return t;
+}
+
+bool start(const size_t &hz)
+{
+	if(hz == 0 || hz > 1000000) return false;
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_sigprof;
+	sa.sa_flags   = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if(sigaction(SIGPROF, &sa, nullptr) != 0) return false;
+	// the main thread is registered before the first signal can arrive
+	if(tl_thread == nullptr) register_thread();
+	s_hz = hz;
+	s_active.store(true, std::memory_order_release);
+	struct itimerval timer;
+	timer.it_interval.tv_sec  = 0;
+	timer.it_interval.tv_usec = 1000000 / hz;
+	timer.it_value		  = timer.it_interval;
+	if(setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+		s_active.store(false, std::memory_order_release);
+		return false;
+	}
+	return true;
+}
+
+static void disarm()
+{
+	// the handler stays installed as SIGPROF terminates the process by default
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+// sampling is not restarted afterwards
+// the thread records are never freed - other threads may have passed their s_active check just
+// before it was cleared, and still be in the signal handler or frame_push/pop() with their record
+void stop()
+{
+	disarm();
+	s_active.store(false, std::memory_order_release);
+}
+
+bool active()
+{
+	return s_active.load(std::memory_order_acquire);
+}
+
+void frame_push(exec_frame_t &frame)
+{
+	if(!s_active.load(std::memory_order_acquire)) return;
+	thread_t *t = tl_thread;
+	if(t == nullptr) t = register_thread();
+	frame.prev = t->top;
+	// frame must be complete before the signal handler can see it
+	std::atomic_signal_fence(std::memory_order_release);
+	t->top = &frame;
+}
+void frame_pop(exec_frame_t &frame)
+{
+	if(!s_active.load(std::memory_order_acquire)) return;
+	thread_t *t = tl_thread;
+	t->top	    = frame.prev;
+	std::atomic_signal_fence(std::memory_order_release);
+	if(t->wr.load(std::memory_order_relaxed) != t->rd.load(std::memory_order_relaxed)) {
+		drain(t);
+	}
+}
+void safe_point()
+{
+	if(!s_active.load(std::memory_order_acquire)) return;
+	thread_t *t = tl_thread;
+	if(t->wr.load(std::memory_order_relaxed) - t->rd.load(std::memory_order_relaxed) >=
+	   SAMPLE_RING_SZ / 2)
+	{
+		drain(t);
+	}
+}
+
+static std::string frame_name(vm_state_t &vm, const size_t &src_id, const size_t &begin)
+{
+	var_src_t *src = vm.get_src(src_id);
+	if(src == nullptr) return "<unknown>";
+	std::string file;
+	size_t line = 0;
+	if(begin == 0 || begin > src->src()->bcode().size() ||
+	   !src_line(vm, src_id, src->src()->bcode().get()[begin - 1].idx, file, line))
+	{
+		return src->src()->path();
+	}
+	return "fn@" + file + ":" + std::to_string(line);
+}
+
+void report(vm_state_t &vm, const std::string &path)
+{
+	disarm();
+	std::vector<thread_t *> threads;
+	{
+		std::lock_guard<std::mutex> lock(s_threads_mtx);
+		threads = s_threads;
+	}
+	FILE *f = fopen(path.c_str(), "w");
+	if(!f) {
+		fprintf(stderr, "failed to open profile output file: %s\n", path.c_str());
+		stop();
+		return;
+	}
+	size_t total = 0, dropped = 0;
+	// names are cached since each stack repeats most of them
+	std::map<std::pair<size_t, size_t>, std::string> names;
+	// several instructions map to the same line, so different keys can give the same stack -
+	// each stack must appear only once in the output
+	std::map<std::string, size_t> stacks;
+	std::string stack;
+	for(auto &t : threads) {
+		drain(t);
+		std::lock_guard<std::mutex> lock(t->mtx);
+		dropped += t->dropped.load();
+		for(auto &s : t->stacks) {
+			const std::vector<size_t> &key = s.first;
+			stack = "thread-" + std::to_string(t->id);
+			for(size_t i = 0; i + 1 < key.size(); i += 2) {
+				// last pair is the instruction location (src_id, idx)
+				if(i + 2 >= key.size()) {
+					std::string file;
+					size_t line = 0;
+					if(!src_line(vm, key[i], key[i + 1], file, line)) break;
+					stack += ";" + file + ":" + std::to_string(line);
+					break;
+				}
+				std::string &name = names[{key[i], key[i + 1]}];
+				if(name.empty()) name = frame_name(vm, key[i], key[i + 1]);
+				stack += ";" + name;
+			}
+			stacks[stack] += s.second;
+			total += s.second;
+		}
+	}
+	for(auto &s : stacks) fprintf(f, "%s %zu\n", s.first.c_str(), s.second);
+	fclose(f);
+	stop();
+	fprintf(stderr, "\nProfile (sample, %zu hz): %zu samples (%zu dropped) from %zu thread(s)\n",
+		s_hz, total, dropped, threads.size());
+	fprintf(stderr, "collapsed stacks written to: %s\n", path.c_str());
+}
+} // namespace sampler
@@ -13,7 +13,13 @@
 
 #include "VM/SrcFile.hpp"
 
+#include <algorithm>
 #include <cstdarg>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static size_t src_id()
 {
@@ -22,43 +28,39 @@ static size_t src_id()
 }
 
 srcfile_t::srcfile_t(const std::string &dir, const std::string &path, const bool is_main)
-	: m_id(src_id()), m_dir(dir), m_path(path), m_is_main(is_main)
+	: m_id(src_id()), m_dir(dir), m_path(path), m_cols_till(0), m_is_main(is_main)
 {}
 
 Errors srcfile_t::load_file()
 {
-	FILE *fp;
-	char *line = NULL;
-	size_t len = 0;
-	ssize_t read;
-
-	fp = fopen(m_path.c_str(), "r");
-	if(fp == NULL) {
+	int fd = open(m_path.c_str(), O_RDONLY);
+	if(fd < 0) {
 		fprintf(stderr, "failed to open source file: %s\n", m_path.c_str());
 		return E_FILE_IO;
 	}
 
-	size_t prefix_idx = m_data.size();
-	std::string code;
-	std::vector<src_col_range_t> cols;
-	size_t begin, end;
-	while((read = getline(&line, &len, fp)) != -1) {
-		begin = code.size();
-		code += line;
-		end = code.size();
-		cols.push_back({prefix_idx + begin, prefix_idx + end});
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		fprintf(stderr, "failed to stat source file: %s\n", m_path.c_str());
+		close(fd);
+		return E_FILE_IO;
 	}
 
-	fclose(fp);
-	if(line) free(line);
-
-	if(code.empty()) {
+	if(st.st_size == 0) {
+		close(fd);
 		fprintf(stderr, "encountered empty file: %s\n", m_path.c_str());
 		return E_FILE_EMPTY;
 	}
 
-	add_data(code);
-	add_cols(cols);
+	void *code = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(code == MAP_FAILED) {
+		fprintf(stderr, "failed to map source file: %s\n", m_path.c_str());
+		return E_FILE_IO;
+	}
+
+	m_data.append((const char *)code, st.st_size);
+	munmap(code, st.st_size);
 	return E_OK;
 }
 
@@ -66,9 +68,39 @@ void srcfile_t::add_data(const std::string &data)
 {
 	m_data += data;
 }
-void srcfile_t::add_cols(const std::vector<src_col_range_t> &cols)
+
+bool srcfile_t::find_line(const size_t &idx, size_t &line, src_col_range_t &range) const
 {
-	m_cols.insert(m_cols.end(), cols.begin(), cols.end());
+	std::lock_guard<std::mutex> lock(m_cols_mtx);
+	// generate line divisions for any data that hasn't been scanned yet
+	// memchr() is vectorized by the C library, which is much faster than a bytewise loop
+	if(m_cols_till < m_data.size()) {
+		// last line may have been incomplete when it was scanned (data appended later)
+		if(!m_cols.empty() && m_data[m_cols.back().end - 1] != '\n') {
+			m_cols_till = m_cols.back().begin;
+			m_cols.pop_back();
+		}
+		const char *data = m_data.data();
+		const char *end	 = data + m_data.size();
+		const char *curr = data + m_cols_till;
+		while(curr < end) {
+			const char *nl = (const char *)memchr(curr, '\n', end - curr);
+			const char *line_end = nl ? nl + 1 : end;
+			m_cols.push_back({(size_t)(curr - data), (size_t)(line_end - data)});
+			curr = line_end;
+		}
+		m_cols_till = m_data.size();
+	}
+
+	auto it = std::upper_bound(
+	m_cols.begin(), m_cols.end(), idx,
+	[](const size_t &idx, const src_col_range_t &col) { return idx < col.begin; });
+	if(it == m_cols.begin()) return false;
+	--it;
+	if(idx >= it->end) return false;
+	line  = it - m_cols.begin();
+	range = *it;
+	return true;
 }
 
 void srcfile_t::fail(const size_t &idx, const char *msg, ...) const
@@ -82,24 +114,17 @@ void srcfile_t::fail(const size_t &idx, const char *msg, ...) const
 void srcfile_t::fail(const size_t &idx, const char *msg, va_list vargs) const
 {
 	size_t line, col_begin, col_end, col;
-	bool found = false;
-	for(size_t i = 0; i < m_cols.size(); ++i) {
-		if(idx >= m_cols[i].begin && idx < m_cols[i].end) {
-			line	  = i;
-			col_begin = m_cols[i].begin;
-			col_end	  = m_cols[i].end;
-			col	  = idx - col_begin;
-			found	  = true;
-			break;
-		}
-	}
-	if(!found) {
+	src_col_range_t range;
+	if(!find_line(idx, line, range)) {
 		fprintf(stderr, "could not find error: ");
 		vfprintf(stderr, msg, vargs);
 		fprintf(stderr, "\n");
 		fprintf(stderr, "in file: %s, with index: %zu\n", m_path.c_str(), idx);
 		return;
 	}
+	col_begin = range.begin;
+	col_end	  = range.end;
+	col	  = idx - col_begin;
 
 	fprintf(stderr, "%s %zu[%zu]: error: ", m_path.c_str(), line + 1, col + 1);
 
@@ -0,0 +1,119 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+
+#include "VM/TypeTable.hpp"
+
+#include <algorithm>
+#include <limits>
+
+type_table_t::type_table_t() : m_all_fns(new fns_t()), m_shared(false), m_epoch(1)
+{
+	m_fns.set(type_id<var_all_t>(), m_all_fns, 0);
+}
+type_table_t::~type_table_t()
+{
+	for(auto &type : m_fns.get()) {
+		for(auto &fn : type.second->get()) {
+			var_base_t *f = fn.second;
+			var_dref(f);
+		}
+		delete type.second;
+	}
+}
+
+std::uint64_t type_table_t::begin_update()
+{
+	if(!m_shared) return 0;
+	// a reader which announced this epoch (or an older one) may still see the replaced versions
+	// but one announcing a newer epoch sees the versions published after this
+	return m_epoch.fetch_add(1) + 1;
+}
+
+void type_table_t::reclaim()
+{
+	if(!m_shared) return;
+	std::uint64_t min_epoch = std::numeric_limits<std::uint64_t>::max();
+	for(auto &r : m_readers) {
+		std::uint64_t epoch = r->m_epoch.load();
+		if(epoch != 0 && epoch < min_epoch) min_epoch = epoch;
+	}
+	m_fns.reclaim(min_epoch);
+	for(auto &type : m_fns.get()) type.second->reclaim(min_epoch);
+	m_iter_next_fns.reclaim(min_epoch);
+	m_names.reclaim(min_epoch);
+}
+
+void type_table_t::add_reader(reader_t *reader)
+{
+	std::lock_guard<std::mutex> lock(m_write_mtx);
+	m_readers.push_back(reader);
+}
+
+void type_table_t::remove_reader(reader_t *reader)
+{
+	std::lock_guard<std::mutex> lock(m_write_mtx);
+	auto it = std::find(m_readers.begin(), m_readers.end(), reader);
+	if(it != m_readers.end()) m_readers.erase(it);
+}
+
+bool type_table_t::add_fn(const std::uintptr_t &type, const std::string &name, var_base_t *fn,
+			  const bool &iref)
+{
+	std::lock_guard<std::mutex> lock(m_write_mtx);
+	fns_t *fns = m_fns.find(type, nullptr);
+	if(fns != nullptr && fns->find(name, nullptr) != nullptr) return false;
+	std::uint64_t epoch = begin_update();
+	if(fns == nullptr) {
+		fns = new fns_t();
+		m_fns.set(type, fns, epoch);
+	}
+	if(iref) var_iref(fn);
+	fns->set(name, fn, epoch);
+	reclaim();
+	return true;
+}
+
+var_base_t *type_table_t::get_fn(reader_t &reader, const std::uintptr_t &type,
+				  const std::string &name) const
+{
+	read_guard_t guard(*this, reader);
+	fns_t *fns	= m_fns.find(type, nullptr);
+	var_base_t *res = fns ? fns->find(name, nullptr) : nullptr;
+	return res ? res : m_all_fns->find(name, nullptr);
+}
+
+void type_table_t::set_iter_next_fn(const std::uintptr_t &type, iter_next_fn_t fn)
+{
+	std::lock_guard<std::mutex> lock(m_write_mtx);
+	m_iter_next_fns.set(type, fn, begin_update());
+	reclaim();
+}
+
+void type_table_t::set_name(const std::uintptr_t &type, const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(m_write_mtx);
+	m_names.set(type, name, begin_update());
+	reclaim();
+}
+
+bool type_table_t::get_name(reader_t &reader, const std::uintptr_t &type,
+			    std::string &name) const
+{
+	read_guard_t guard(*this, reader);
+	const auto &names = m_names.get();
+	auto it		  = names.find(type);
+	if(it == names.end()) return false;
+	name = it->second;
+	return true;
+}
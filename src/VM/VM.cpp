@@ -20,6 +20,7 @@
 #include "Common/Env.hpp"
 #include "Common/FS.hpp"
 #include "Common/String.hpp"
+#include "VM/Profiler.hpp"
 #include "VM/Vars.hpp"
 
 // env: FERAL_PATHS
@@ -34,8 +35,13 @@ vm_state_t::vm_state_t(const std::string &self_bin, const std::string &self_base
 	  m_self_base(self_base), m_src_load_fn(nullptr), m_src_read_code_fn(nullptr),
 	  m_is_thread_copy(is_thread_copy)
 {
+	tail_call.fn = nullptr;
+	prof	     = nullptr;
+	m_types	     = nullptr;
 	if(m_is_thread_copy) return;
 
+	m_types = new type_table_t();
+	m_types->add_reader(&m_types_reader);
 	init_typenames(*this);
 
 	std::vector<var_base_t *> src_args_vec;
@@ -58,9 +64,13 @@ vm_state_t::vm_state_t(const std::string &self_bin, const std::string &self_base
 
 vm_state_t::~vm_state_t()
 {
+	if(!m_is_thread_copy) {
+		for(auto fn = m_exit_fns.rbegin(); fn != m_exit_fns.rend(); ++fn) (*fn)(*this);
+	}
 	delete vm_stack;
-	if(!m_is_thread_copy)
-		for(auto &typefn : m_typefns) delete typefn.second;
+	for(auto &d : m_mod_data) d.second.deleter(d.second.data);
+	if(m_types) m_types->remove_reader(&m_types_reader);
+	if(!m_is_thread_copy) delete m_types;
 	for(auto &g : m_globals) var_dref(g.second);
 	for(auto &src : all_srcs) var_dref(src.second);
 	var_dref(nil);
@@ -70,7 +80,12 @@ vm_state_t::~vm_state_t()
 	for(auto &deinit_fn : m_dll_deinit_fns) {
 		deinit_fn.second();
 	}
-	if(m_is_thread_copy) return;
+	if(m_is_thread_copy) {
+		if(prof) prof->thread_done();
+		return;
+	}
+	// profilers of thread copies which are still running are owned by this one
+	if(prof) delete prof;
 	delete dlib;
 }
 
@@ -78,11 +93,19 @@ void vm_state_t::push_src(srcfile_t *src, const size_t &idx)
 {
 	if(all_srcs.find(src->path()) == all_srcs.end()) {
 		all_srcs[src->path()] = new var_src_t(src, new vars_t(), src->id(), idx);
+		add_src_by_id(all_srcs[src->path()]);
 	}
 	var_iref(all_srcs[src->path()]);
 	src_stack.push_back(all_srcs[src->path()]);
 }
 
+void vm_state_t::add_src_by_id(var_src_t *src)
+{
+	size_t id = src->src()->id();
+	if(id >= srcs_by_id.size()) srcs_by_id.resize(id + 1, nullptr);
+	srcs_by_id[id] = src;
+}
+
 void vm_state_t::push_src(const std::string &src_path)
 {
 	assert(all_srcs.find(src_path) != all_srcs.end());
@@ -99,45 +122,30 @@ void vm_state_t::pop_src()
 void vm_state_t::add_typefn(const std::uintptr_t &type, const std::string &name, var_base_t *fn,
 			    const bool iref)
 {
-	if(m_typefns.find(type) == m_typefns.end()) {
-		m_typefns[type] = new vars_frame_t();
-	}
-	if(m_typefns[type]->exists(name)) {
+	if(!m_types->add_fn(type, name, fn, iref)) {
 		fprintf(stderr, "function '%s' for type '%s' already exists\n", name.c_str(),
 			type_name(type).c_str());
 		assert(false);
 		return;
 	}
-	m_typefns[type]->add(name, fn, iref);
 }
 var_base_t *vm_state_t::get_typefn(var_base_t *var, const std::string &name)
 {
-	auto it		= m_typefns.find(var->typefn_id());
-	var_base_t *res = nullptr;
-	if(it == m_typefns.end()) {
-		if(var->attr_based()) goto attr_based;
-		return m_typefns[type_id<var_all_t>()]->get(name);
+	// attribute based vars (structs) without functions of their own use those of their base type
+	if(var->attr_based() && !m_types->has_fns(m_types_reader, var->typefn_id())) {
+		return m_types->get_fn(m_types_reader, var->type(), name);
 	}
-	res = it->second->get(name);
-	if(res) return res;
-	return m_typefns[type_id<var_all_t>()]->get(name);
-attr_based:
-	it = m_typefns.find(var->type());
-	if(it == m_typefns.end()) return m_typefns[type_id<var_all_t>()]->get(name);
-	res = it->second->get(name);
-	if(res) return res;
-	return m_typefns[type_id<var_all_t>()]->get(name);
+	return m_types->get_fn(m_types_reader, var->typefn_id(), name);
 }
 
 void vm_state_t::set_typename(const std::uintptr_t &type, const std::string &name)
 {
-	m_typenames[type] = name;
+	m_types->set_name(type, name);
 }
 std::string vm_state_t::type_name(const std::uintptr_t &type)
 {
-	if(m_typenames.find(type) != m_typenames.end()) {
-		return m_typenames[type];
-	}
+	std::string name;
+	if(m_types->get_name(m_types_reader, type, name)) return name;
 	return "typeid<" + std::to_string(type) + ">";
 }
 std::string vm_state_t::type_name(const var_base_t *val)
@@ -253,17 +261,14 @@ void vm_state_t::fail(const size_t &src_id, const size_t &idx, const char *msg,
 	va_list vargs;
 	va_start(vargs, msg);
 	if(fails.empty() || this->exit_called) {
-		for(auto &src : all_srcs) {
-			if(src.second->src()->id() == src_id) {
-				src.second->src()->fail(idx, msg, vargs);
-				break;
-			}
-		}
-	} else {
-		static char err[4096];
-		vsprintf(err, msg, vargs);
-		fails.push(new var_str_t(err, src_id, idx), false);
+		var_src_t *src = get_src(src_id);
+		if(src) src->src()->fail(idx, msg, vargs);
+	} else if(fails.accepts()) {
+		static thread_local char err[4096];
+		vsnprintf(err, sizeof(err), msg, vargs);
+		fails.push(src_id, idx, err);
 	}
+	// else the failure would be discarded by the enclosing 'or' block, so don't format it
 	va_end(vargs);
 }
 
@@ -273,18 +278,20 @@ void vm_state_t::fail(const size_t &src_id, const size_t &idx, var_base_t *val,
 	if(iref) var_iref(val);
 
 	if(fails.empty() || this->exit_called) {
-		for(auto &src : all_srcs) {
-			if(src.second->src()->id() == src_id) {
-				std::string data;
-				val->to_str(*this, data, src_id, idx);
-				var_dref(val);
-				if(msg) src.second->src()->fail(idx, "%s (%s)", msg, data.c_str());
-				else src.second->src()->fail(idx, data.c_str());
-				break;
-			}
+		var_src_t *src = get_src(src_id);
+		if(!src) {
+			var_dref(val);
+			return;
 		}
-	} else {
+		std::string data;
+		val->to_str(*this, data, src_id, idx);
+		var_dref(val);
+		if(msg) src->src()->fail(idx, "%s (%s)", msg, data.c_str());
+		else src->src()->fail(idx, data.c_str());
+	} else if(fails.accepts()) {
 		fails.push(val, false);
+	} else {
+		var_dref(val);
 	}
 }
 
@@ -297,12 +304,18 @@ bool vm_state_t::load_core_mods()
 	return true;
 }
 
+void vm_state_t::add_exit_fn(vm_exit_fn_t fn)
+{
+	m_exit_fns.push_back(fn);
+}
+
 vm_state_t *vm_state_t::thread_copy(const size_t &src_id, const size_t &idx)
 {
 	vm_state_t *vm = new vm_state_t(m_self_bin, m_self_base, {}, exec_flags, true);
 	for(auto &s : all_srcs) {
 		vm->all_srcs[s.first] =
 		static_cast<var_src_t *>(s.second->thread_copy(src_id, idx));
+		vm->add_src_by_id(vm->all_srcs[s.first]);
 	}
 	for(auto &s : src_stack) {
 		vm->src_stack.push_back(vm->all_srcs[s->src()->path()]);
@@ -318,12 +331,21 @@ vm_state_t *vm_state_t::thread_copy(const size_t &src_id, const size_t &idx)
 	for(auto &glob : vm->m_globals) {
 		var_iref(glob.second);
 	}
-	vm->m_typefns	= m_typefns; // do not delete in destructor
-	vm->m_typenames = m_typenames;
+	m_types->share();
+	vm->m_types = m_types; // do not delete in destructor
+	m_types->add_reader(&vm->m_types_reader);
+	vm->prof    = prof ? prof->thread_copy() : nullptr;
 	// don't copy m_dll_deinit_fns as that will be called by the main thread
 	return vm;
 }
 
+size_t vm_state_t::mod_gen()
+{
+	size_t gen = all_srcs.size() + m_globals.size();
+	for(auto &s : all_srcs) gen += s.second->vars()->mod_gen();
+	return gen;
+}
+
 const char *nmod_ext()
 {
 #if __linux__ || __FreeBSD__ || __NetBSD__ || __OpenBSD__ || __bsdi__ || __DragonFly__
@@ -13,25 +13,38 @@
 
 #include "VM/VMFailStack.hpp"
 
-vm_failstack_t::vm_failstack_t() {}
+vm_failstack_t::vm_failstack_t() : m_size(0) {}
 
 vm_failstack_t::~vm_failstack_t()
 {
-	assert(m_stack.size() == 0);
+	assert(m_size == 0);
+}
+
+void vm_failstack_t::blkr()
+{
+	fail_blk_t &blk = m_stack[--m_size];
+	for(size_t i = blk.front; i < blk.fails.size(); ++i) var_dref(blk.fails[i].val);
+	blk.fails.clear();
 }
 
 void vm_failstack_t::push(var_base_t *val, const bool iref)
 {
 	if(iref) var_iref(val);
-	m_stack.back().push_back(val);
+	m_stack[m_size - 1].fails.push_back({val->src_id(), val->idx(), val, ""});
+}
+
+void vm_failstack_t::push(const size_t &src_id, const size_t &idx, const char *msg)
+{
+	m_stack[m_size - 1].fails.push_back({src_id, idx, nullptr, msg});
 }
 
 var_base_t *vm_failstack_t::pop(const bool dref)
 {
-	if(m_stack.size() == 0 || m_stack.back().size() == 0) return nullptr;
-	var_base_t *front = nullptr;
-	front		  = m_stack.back().front();
-	m_stack.back().pop_front();
-	if(dref) var_dref(front);
-	return front;
+	if(m_size == 0 || backempty()) return nullptr;
+	fail_blk_t &blk = m_stack[m_size - 1];
+	fail_t &front	= blk.fails[blk.front++];
+	var_base_t *res = front.val;
+	if(res == nullptr) res = new var_str_t(front.msg, front.src_id, front.idx);
+	if(dref) var_dref(res);
+	return res;
 }
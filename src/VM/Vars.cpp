@@ -15,16 +15,21 @@
 
 #include "VM/Memory.hpp"
 
-vars_frame_t::vars_frame_t() {}
+vars_frame_t::vars_frame_t() : m_ref(1) {}
+vars_frame_t::vars_frame_t(const vars_frame_t &other) : m_vars(other.m_vars), m_ref(1)
+{
+	for(auto &var : m_vars) var_iref(var.second);
+}
 vars_frame_t::~vars_frame_t()
 {
 	for(auto &var : m_vars) var_dref(var.second);
 }
 
+// find() instead of operator[] since a shared frame may be read by many threads at once
 var_base_t *vars_frame_t::get(const std::string &name)
 {
-	if(m_vars.find(name) == m_vars.end()) return nullptr;
-	return m_vars[name];
+	auto it = m_vars.find(name);
+	return it == m_vars.end() ? nullptr : it->second;
 }
 
 void vars_frame_t::add(const std::string &name, var_base_t *val, const bool inc_ref)
@@ -51,14 +56,9 @@ void vars_frame_t::operator delete(void *ptr, size_t sz)
 	mem::free(ptr, sz);
 }
 
-vars_frame_t *vars_frame_t::thread_copy(const size_t &src_id, const size_t &idx)
+static inline void frame_dref(vars_frame_t *frame)
 {
-	vars_frame_t *f = new vars_frame_t;
-	for(auto &var : m_vars) {
-		var_iref(var.second);
-		f->m_vars[var.first] = var.second;
-	}
-	return f;
+	if(frame->dref() == 0) delete frame;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -71,7 +71,7 @@ vars_stack_t::vars_stack_t() : m_top(0)
 vars_stack_t::~vars_stack_t()
 {
 	for(auto layer = m_stack.rbegin(); layer != m_stack.rend(); ++layer) {
-		delete *layer;
+		frame_dref(*layer);
 	}
 }
 
@@ -83,13 +83,17 @@ bool vars_stack_t::exists(const std::string &name)
 var_base_t *vars_stack_t::get(const std::string &name)
 {
 	for(auto layer = m_stack.rbegin(); layer != m_stack.rend(); ++layer) {
-		if((*layer)->exists(name)) {
-			return (*layer)->get(name);
-		}
+		var_base_t *res = (*layer)->get(name);
+		if(res) return res;
 	}
 	return nullptr;
 }
 
+var_base_t *vars_stack_t::get_curr(const std::string &name)
+{
+	return m_stack.back()->get(name);
+}
+
 void vars_stack_t::inc_top(const size_t &count)
 {
 	for(size_t i = 0; i < count; ++i) {
@@ -101,7 +105,7 @@ void vars_stack_t::dec_top(const size_t &count)
 {
 	if(m_top == 0) return;
 	for(size_t i = 0; i < count && m_top > 0; ++i) {
-		delete m_stack.back();
+		frame_dref(m_stack.back());
 		m_stack.pop_back();
 		--m_top;
 	}
@@ -130,15 +134,24 @@ void vars_stack_t::loop_continue()
 	}
 }
 
+vars_frame_t *vars_stack_t::own(const size_t &pos)
+{
+	vars_frame_t *frame = m_stack[pos];
+	if(!frame->shared()) return frame;
+	m_stack[pos] = new vars_frame_t(*frame);
+	frame_dref(frame);
+	return m_stack[pos];
+}
+
 void vars_stack_t::add(const std::string &name, var_base_t *val, const bool inc_ref)
 {
-	m_stack.back()->add(name, val, inc_ref);
+	own(m_stack.size() - 1)->add(name, val, inc_ref);
 }
 void vars_stack_t::rem(const std::string &name, const bool dec_ref)
 {
-	for(auto layer = m_stack.rbegin(); layer != m_stack.rend(); ++layer) {
-		if((*layer)->exists(name)) {
-			(*layer)->rem(name, dec_ref);
+	for(size_t i = m_stack.size(); i > 0; --i) {
+		if(m_stack[i - 1]->exists(name)) {
+			own(i - 1)->rem(name, dec_ref);
 			return;
 		}
 	}
@@ -147,10 +160,13 @@ void vars_stack_t::rem(const std::string &name, const bool dec_ref)
 vars_stack_t *vars_stack_t::thread_copy(const size_t &src_id, const size_t &idx)
 {
 	vars_stack_t *s = new vars_stack_t;
+	frame_dref(s->m_stack.back());
+	s->m_stack.clear();
 	s->m_loops_from = m_loops_from;
 	s->m_top	= m_top;
 	for(auto &f : m_stack) {
-		s->m_stack.push_back(f->thread_copy(src_id, idx));
+		f->iref();
+		s->m_stack.push_back(f);
 	}
 	return s;
 }
@@ -158,7 +174,7 @@ vars_stack_t *vars_stack_t::thread_copy(const size_t &src_id, const size_t &idx)
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
-vars_t::vars_t() : m_fn_stack(-1)
+vars_t::vars_t() : m_fn_stack(-1), m_mod_gen(0)
 {
 	m_fn_vars[0] = new vars_stack_t;
 }
@@ -183,6 +199,11 @@ var_base_t *vars_t::get(const std::string &name)
 	return res;
 }
 
+var_base_t *vars_t::get_curr(const std::string &name)
+{
+	return m_fn_vars[m_fn_stack]->get_curr(name);
+}
+
 void vars_t::blk_add(const size_t &count)
 {
 	m_fn_vars[m_fn_stack]->inc_top(count);
@@ -211,6 +232,19 @@ void vars_t::pop_fn()
 	--m_fn_stack;
 }
 
+void vars_t::push_fn(vars_stack_t *stack)
+{
+	++m_fn_stack;
+	m_fn_vars[m_fn_stack] = stack;
+}
+vars_stack_t *vars_t::pop_fn_detach()
+{
+	vars_stack_t *stack = m_fn_vars[m_fn_stack];
+	m_fn_vars.erase(m_fn_stack);
+	--m_fn_stack;
+	return stack;
+}
+
 void vars_t::stash(const std::string &name, var_base_t *val, const bool &iref)
 {
 	if(iref) var_iref(val);
@@ -225,16 +259,19 @@ void vars_t::unstash()
 
 void vars_t::add(const std::string &name, var_base_t *val, const bool inc_ref)
 {
+	if(m_fn_stack == 0 && m_fn_vars[0]->top() == 0) ++m_mod_gen;
 	m_fn_vars[m_fn_stack]->add(name, val, inc_ref);
 }
 
 void vars_t::addm(const std::string &name, var_base_t *val, const bool inc_ref)
 {
+	++m_mod_gen;
 	m_fn_vars[0]->add(name, val, inc_ref);
 }
 
 void vars_t::rem(const std::string &name, const bool dec_ref)
 {
+	if(m_fn_stack == 0) ++m_mod_gen;
 	m_fn_vars[m_fn_stack]->rem(name, dec_ref);
 }
 
@@ -242,13 +279,14 @@ vars_t *vars_t::thread_copy(const size_t &src_id, const size_t &idx)
 {
 	vars_t *v = new vars_t;
 	delete v->m_fn_vars[0];
-	v->m_fn_stack = m_fn_stack;
+	// a function only sees its own variables and the source level ones, so the variables of
+	// the functions being executed by this vm are of no use to the copy
+	v->m_fn_stack = m_fn_stack == (size_t)-1 ? -1 : 0;
+	v->m_mod_gen  = m_mod_gen;
 	for(auto &s : m_stash) {
 		var_iref(s.second);
 		v->m_stash[s.first] = s.second;
 	}
-	for(auto &fv : m_fn_vars) {
-		v->m_fn_vars[fv.first] = fv.second->thread_copy(src_id, idx);
-	}
+	v->m_fn_vars[0] = m_fn_vars[0]->thread_copy(src_id, idx);
 	return v;
 }
\ No newline at end of file
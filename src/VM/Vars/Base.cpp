@@ -13,6 +13,8 @@
 
 #include "VM/Vars/Base.hpp"
 
+#include <cstring>
+
 #include "VM/Memory.hpp"
 #include "VM/VM.hpp"
 
@@ -34,7 +36,92 @@ std::uintptr_t var_base_t::typefn_id() const
 	return m_type;
 }
 
-bool var_base_t::to_str(vm_state_t &vm, std::string &data, const size_t &src_id, const size_t &idx)
+static void append_flt(std::string &out, mpfr_t &val)
+{
+	mpfr_exp_t expo;
+	char *_res = mpfr_get_str(NULL, &expo, 10, 0, val, mpfr_get_default_rounding_mode());
+	std::string res(_res);
+	mpfr_free_str(_res);
+	if(res.empty() || expo == 0 || expo > 25) {
+		out += res;
+		return;
+	}
+	auto last_zero_from_end = res.find_last_of("123456789");
+	if(last_zero_from_end != std::string::npos) res.erase(last_zero_from_end + 1);
+	if(expo > 0) {
+		while(expo > res.size()) res += '0';
+		if(res[0] == '-') ++expo;
+		res.insert(expo, ".");
+		out += res;
+	} else {
+		out += "0.";
+		out.append(-expo, '0');
+		out += res;
+	}
+}
+
+bool var_base_t::append_str(vm_state_t &vm, std::string &out, const size_t &src_id,
+			    const size_t &idx)
+{
+	if(m_type == type_id<var_str_t>()) {
+		out += STR(this)->get();
+	} else if(m_type == type_id<var_int_t>()) {
+		// written in place - sizeinbase may be one more than required, + 1 for sign
+		mpz_t &val = INT(this)->get();
+		size_t pos = out.size();
+		out.resize(pos + mpz_sizeinbase(val, 10) + 2);
+		mpz_get_str(&out[pos], 10, val);
+		out.resize(pos + strlen(&out[pos]));
+	} else if(m_type == type_id<var_bool_t>()) {
+		out += BOOL(this)->get() ? "true" : "false";
+	} else if(m_type == type_id<var_nil_t>()) {
+		out += "(nil)";
+	} else if(m_type == type_id<var_flt_t>()) {
+		append_flt(out, FLT(this)->get());
+	} else if(m_type == type_id<var_vec_t>()) {
+		out += '[';
+		bool first = true;
+		for(auto &e : VEC(this)->get()) {
+			if(!first) out += ", ";
+			first = false;
+			if(!e->append_str(vm, out, src_id, idx)) return false;
+		}
+		out += ']';
+	} else if(m_type == type_id<var_map_t>()) {
+		var_map_t *map = MAP(this);
+		std::vector<size_t> order;
+		if(!map->order(vm, order, src_id, idx)) return false;
+		out += '{';
+		for(size_t i = 0; i < order.size(); ++i) {
+			if(i > 0) out += ", ";
+			const map_entry_t &e = map->entries()[order[i]];
+			if(!e.key->append_str(vm, out, src_id, idx)) return false;
+			out += ": ";
+			if(!e.val->append_str(vm, out, src_id, idx)) return false;
+		}
+		out += '}';
+	} else {
+		std::string str;
+		if(!to_str_call(vm, str, src_id, idx)) return false;
+		out += str;
+	}
+	return true;
+}
+
+var_base_t *var_call(vm_state_t &vm, var_base_t *fn, const std::vector<var_base_t *> &args,
+		     const size_t &src_id, const size_t &idx)
+{
+	if(fn->istype<var_fn_t>() && FN(fn)->is_native()) {
+		var_base_t *res = FN(fn)->call_native(vm, {src_id, idx, args, {}, {}});
+		if(res) var_iref(res);
+		return res;
+	}
+	if(!fn->call(vm, args, {}, {}, src_id, idx)) return nullptr;
+	return vm.vm_stack->pop(false);
+}
+
+bool var_base_t::to_str_call(vm_state_t &vm, std::string &data, const size_t &src_id,
+			     const size_t &idx)
 {
 	var_base_t *str_fn = nullptr;
 	if(attr_based()) str_fn = attr_get("str");
@@ -46,12 +133,12 @@ bool var_base_t::to_str(vm_state_t &vm, std::string &data, const size_t &src_id,
 			this->type());
 		return false;
 	}
-	if(!str_fn->call(vm, {this}, {}, {}, src_id, idx)) {
+	var_base_t *str = var_call(vm, str_fn, {this}, src_id, idx);
+	if(!str) {
 		vm.fail(this->src_id(), this->idx(), "function call 'str' for type: %zu failed",
 			this->type());
 		return false;
 	}
-	var_base_t *str = vm.vm_stack->pop(false);
 	if(!str->istype<var_str_t>()) {
 		vm.fail(this->src_id(), this->idx(),
 			"expected string return type from 'str' function, received: %s",
@@ -64,7 +151,8 @@ bool var_base_t::to_str(vm_state_t &vm, std::string &data, const size_t &src_id,
 	return true;
 }
 
-bool var_base_t::to_bool(vm_state_t &vm, bool &data, const size_t &src_id, const size_t &idx)
+bool var_base_t::to_bool_call(vm_state_t &vm, bool &data, const size_t &src_id,
+			      const size_t &idx)
 {
 	var_base_t *bool_fn = nullptr;
 	if(attr_based()) bool_fn = attr_get("bool");
@@ -76,12 +164,12 @@ bool var_base_t::to_bool(vm_state_t &vm, bool &data, const size_t &src_id, const
 			this->type());
 		return false;
 	}
-	if(!bool_fn->call(vm, {this}, {}, {}, src_id, idx)) {
+	var_base_t *b = var_call(vm, bool_fn, {this}, src_id, idx);
+	if(!b) {
 		vm.fail(this->src_id(), this->idx(), "function call 'bool' for type: %zu failed",
 			this->type());
 		return false;
 	}
-	var_base_t *b = vm.vm_stack->pop(false);
 	if(!b->istype<var_bool_t>()) {
 		vm.fail(this->src_id(), this->idx(),
 			"expected string return type from 'bool' function, received: %s",
@@ -134,5 +222,6 @@ void init_typenames(vm_state_t &vm)
 	vm.register_type<var_vec_t>("vec");
 	vm.register_type<var_map_t>("map");
 	vm.register_type<var_fn_t>("func");
+	vm.register_type<var_gen_t>("gen");
 	vm.register_type<var_src_t>("src");
 }
@@ -18,24 +18,41 @@
 /////////////////////////////////////////// VAR_FN ///////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+fn_proto_t::fn_proto_t() : is_gen(false), ref(1) {}
+fn_proto_t::fn_proto_t(const std::string &src_name, const std::string &kw_arg,
+		       const std::string &var_arg, const std::vector<std::string> &args)
+	: src_name(src_name), kw_arg(kw_arg), var_arg(var_arg), args(args), is_gen(false), ref(1)
+{}
+
 var_fn_t::var_fn_t(const std::string &src_name, const std::string &kw_arg,
 		   const std::string &var_arg, const std::vector<std::string> &args,
 		   const std::unordered_map<std::string, var_base_t *> &assn_args,
 		   const fn_body_t &body, const bool is_native, const size_t &src_id,
 		   const size_t &idx)
-	: var_base_t(type_id<var_fn_t>(), src_id, idx, true, false), m_src_name(src_name),
-	  m_kw_arg(kw_arg), m_var_arg(var_arg), m_args(args), m_assn_args(assn_args), m_body(body),
-	  m_is_native(is_native)
+	: var_base_t(type_id<var_fn_t>(), src_id, idx, true, false),
+	  m_proto(new fn_proto_t(src_name, kw_arg, var_arg, args)), m_assn_args(assn_args),
+	  m_body(body), m_is_native(is_native)
 {}
 var_fn_t::var_fn_t(const std::string &src_name, const std::vector<std::string> &args,
 		   const std::unordered_map<std::string, var_base_t *> &assn_args,
 		   const fn_body_t &body, const size_t &src_id, const size_t &idx)
-	: var_base_t(type_id<var_fn_t>(), src_id, idx, true, false), m_src_name(src_name),
-	  m_args(args), m_assn_args(assn_args), m_body(body), m_is_native(true)
+	: var_base_t(type_id<var_fn_t>(), src_id, idx, true, false),
+	  m_proto(new fn_proto_t(src_name, "", "", args)), m_assn_args(assn_args), m_body(body),
+	  m_is_native(true)
 {}
+var_fn_t::var_fn_t(fn_proto_t *proto,
+		   const std::unordered_map<std::string, var_base_t *> &assn_args,
+		   const fn_body_t &body, const bool is_native, const size_t &src_id,
+		   const size_t &idx)
+	: var_base_t(type_id<var_fn_t>(), src_id, idx, true, false), m_proto(proto),
+	  m_assn_args(assn_args), m_body(body), m_is_native(is_native)
+{
+	proto_iref(m_proto);
+}
 var_fn_t::~var_fn_t()
 {
 	for(auto &aa : m_assn_args) var_dref(aa.second);
+	proto_dref(m_proto);
 }
 
 var_base_t *var_fn_t::copy(const size_t &src_id, const size_t &idx)
@@ -43,26 +60,9 @@ var_base_t *var_fn_t::copy(const size_t &src_id, const size_t &idx)
 	for(auto &aa : m_assn_args) {
 		var_iref(aa.second);
 	}
-	return new var_fn_t(m_src_name, m_kw_arg, m_var_arg, m_args, m_assn_args, m_body,
-			    m_is_native, src_id, idx);
+	return new var_fn_t(m_proto, m_assn_args, m_body, m_is_native, src_id, idx);
 }
 
-std::string &var_fn_t::src_name()
-{
-	return m_src_name;
-}
-std::string &var_fn_t::kw_arg()
-{
-	return m_kw_arg;
-}
-std::string &var_fn_t::var_arg()
-{
-	return m_var_arg;
-}
-std::vector<std::string> &var_fn_t::args()
-{
-	return m_args;
-}
 std::unordered_map<std::string, var_base_t *> &var_fn_t::assn_args()
 {
 	return m_assn_args;
@@ -80,28 +80,63 @@ var_base_t *var_fn_t::call(vm_state_t &vm, const std::vector<var_base_t *> &args
 			   const std::vector<fn_assn_arg_t> &assn_args,
 			   const std::unordered_map<std::string, size_t> &assn_args_loc,
 			   const size_t &src_id, const size_t &idx)
+{
+	if(m_is_native) {
+		var_base_t *res = call_native(vm, {src_id, idx, args, assn_args, assn_args_loc});
+		if(res == nullptr) return nullptr;
+		vm.vm_stack->push(res);
+		return vm.nil;
+	}
+	bool ok = call_feral(vm, args, assn_args, src_id, idx);
+	// the body ended with a call in tail position (return f(...)) - perform it here,
+	// after the caller's frame is gone, so that tail recursion runs in constant space
+	while(ok && vm.tail_call.fn) {
+		tail_call_t tc;
+		std::swap(tc, vm.tail_call);
+		vm.tail_call.fn = nullptr;
+		ok = tc.fn->call_feral(vm, tc.args, tc.assn_args, tc.src_id, tc.idx);
+		for(auto &arg : tc.args) var_dref(arg);
+		for(auto &arg : tc.assn_args) var_dref(arg.val);
+		var_dref(tc.fn);
+	}
+	return ok ? vm.nil : nullptr;
+}
+
+var_base_t *var_fn_t::call_native(vm_state_t &vm, const fn_data_t &fd)
 {
 	// - 1 for self
-	if(args.size() - 1 < m_args.size() - m_assn_args.size() ||
-	   (args.size() - 1 > m_args.size() && m_var_arg.empty()))
+	if(fd.args.size() - 1 < m_proto->args.size() - m_assn_args.size() ||
+	   (fd.args.size() - 1 > m_proto->args.size() && m_proto->var_arg.empty()))
 	{
-		vm.fail(src_id, idx,
+		vm.fail(fd.src_id, fd.idx,
 			"argument count required: %zu (without default args: %zu), received: %zu",
-			m_args.size(), m_args.size() - m_assn_args.size(), args.size() - 1);
+			m_proto->args.size(), m_proto->args.size() - m_assn_args.size(), fd.args.size() - 1);
 		return nullptr;
 	}
-	if(m_is_native) {
-		var_base_t *res = m_body.native(vm, {src_id, idx, args, assn_args, assn_args_loc});
-		if(res == nullptr) return nullptr;
-		// if it's a new variable (created with make<>() function)
-		// set src_id and idx
-		if(res->ref() == 0) {
-			res->set_src_id_idx(src_id, idx);
-		}
-		vm.vm_stack->push(res);
-		return vm.nil;
+	var_base_t *res = m_body.native(vm, fd);
+	if(res == nullptr) return nullptr;
+	// if it's a new variable (created with make<>() function)
+	// set src_id and idx
+	if(res->ref() == 0) {
+		res->set_src_id_idx(fd.src_id, fd.idx);
 	}
-	vm.push_src(m_src_name);
+	return res;
+}
+
+bool var_fn_t::call_feral(vm_state_t &vm, const std::vector<var_base_t *> &args,
+			  const std::vector<fn_assn_arg_t> &assn_args, const size_t &src_id,
+			  const size_t &idx)
+{
+	// - 1 for self
+	if(args.size() - 1 < m_proto->args.size() - m_assn_args.size() ||
+	   (args.size() - 1 > m_proto->args.size() && m_proto->var_arg.empty()))
+	{
+		vm.fail(src_id, idx,
+			"argument count required: %zu (without default args: %zu), received: %zu",
+			m_proto->args.size(), m_proto->args.size() - m_assn_args.size(), args.size() - 1);
+		return false;
+	}
+	vm.push_src(m_proto->src_name);
 	vars_t *vars = vm.current_source()->vars();
 	// take care of 'self' (always - data or nullptr)
 	if(args[0] != nullptr) {
@@ -110,7 +145,7 @@ var_base_t *var_fn_t::call(vm_state_t &vm, const std::vector<var_base_t *> &args
 	// for default arguments
 	std::unordered_set<std::string> found_args;
 	size_t i = 1;
-	for(auto &a : m_args) {
+	for(auto &a : m_proto->args) {
 		if(i == args.size()) break;
 		vars->stash(a, args[i++]);
 		found_args.insert(a);
@@ -122,32 +157,40 @@ var_base_t *var_fn_t::call(vm_state_t &vm, const std::vector<var_base_t *> &args
 		copy->dref();
 		vars->stash(aa.first, copy);
 	}
-	if(!m_var_arg.empty()) {
+	if(!m_proto->var_arg.empty()) {
 		std::vector<var_base_t *> vec;
 		while(i < args.size()) {
 			var_iref(args[i]);
 			vec.push_back(args[i]);
 			++i;
 		}
-		vars->stash(m_var_arg, make<var_vec_t>(vec, false));
+		vars->stash(m_proto->var_arg, make<var_vec_t>(vec, false));
 	}
-	if(!m_kw_arg.empty()) {
+	if(!m_proto->kw_arg.empty()) {
 		std::map<std::string, var_base_t *> map;
 		for(auto &arg : assn_args) {
 			var_iref(arg.val);
 			map[arg.name] = arg.val;
 		}
-		vars->stash(m_kw_arg, make<var_map_t>(map, false));
+		vars->stash(m_proto->kw_arg, make<var_map_t>(map, false));
+	}
+	if(m_proto->is_gen) {
+		// the arguments go in the generator's variables, the body runs on next()
+		vars->push_fn();
+		vars->blk_add(1);
+		vm.vm_stack->push(new var_gen_t(this, vars->pop_fn_detach(), src_id, idx), false);
+		vm.pop_src();
+		return true;
 	}
 	if(vm::exec(vm, nullptr, m_body.feral.begin, m_body.feral.end) == E_EXEC_FAIL) {
 		goto fail;
 	}
 	vm.pop_src();
-	return vm.nil;
+	return true;
 fail:
 	vars->unstash();
 	vm.pop_src();
-	return nullptr;
+	return false;
 }
 
 void var_fn_t::set(var_base_t *from)
@@ -158,11 +201,11 @@ void var_fn_t::set(var_base_t *from)
 
 	for(auto &aa : fn->m_assn_args) var_iref(aa.second);
 
+	proto_iref(fn->m_proto);
+	proto_dref(m_proto);
+
 	// no need to change fn id
-	m_src_name  = fn->m_src_name;
-	m_kw_arg    = fn->m_kw_arg;
-	m_var_arg   = fn->m_var_arg;
-	m_args	    = fn->m_args;
+	m_proto	    = fn->m_proto;
 	m_assn_args = fn->m_assn_args;
 	m_body	    = fn->m_body;
 	m_is_native = fn->m_is_native;
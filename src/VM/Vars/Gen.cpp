@@ -0,0 +1,87 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include "VM/Vars/Base.hpp"
+#include "VM/VM.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////// VAR_GEN //////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+var_gen_t::state_t::state_t(var_fn_t *fn, vars_stack_t *vars)
+	: fn(fn), vars(vars), pos(fn->body().feral.begin), running(false)
+{
+	var_iref(fn);
+}
+var_gen_t::state_t::~state_t()
+{
+	if(vars) delete vars;
+	var_dref(fn);
+}
+
+var_gen_t::var_gen_t(std::shared_ptr<state_t> state, const size_t &src_id, const size_t &idx)
+	: var_base_t(type_id<var_gen_t>(), src_id, idx, false, false), m_state(state)
+{}
+var_gen_t::var_gen_t(var_fn_t *fn, vars_stack_t *vars, const size_t &src_id, const size_t &idx)
+	: var_base_t(type_id<var_gen_t>(), src_id, idx, false, false),
+	  m_state(new state_t(fn, vars))
+{}
+
+var_base_t *var_gen_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_gen_t(m_state, src_id, idx);
+}
+void var_gen_t::set(var_base_t *from)
+{
+	m_state = GEN(from)->m_state;
+}
+
+var_base_t *var_gen_t::next(vm_state_t &vm, const size_t &src_id, const size_t &idx)
+{
+	state_t *st = m_state.get();
+	if(st->running.exchange(true)) {
+		vm.fail(src_id, idx, "generator is already running");
+		return nullptr;
+	}
+	if(st->vars == nullptr) {
+		st->running = false;
+		var_iref(vm.nil);
+		return vm.nil;
+	}
+	const fn_body_span_t &body = st->fn->body().feral;
+	gen_frame_t frame{st->vars, st->pos};
+	vm.push_src(st->fn->src_name());
+	int res = vm::exec(vm, nullptr, body.begin, body.end, &frame);
+	vm.pop_src();
+	st->vars    = frame.vars;
+	st->pos	    = frame.pos;
+	st->running = false;
+	if(res == E_EXEC_FAIL) return nullptr;
+	if(vm.exit_called) {
+		var_iref(vm.nil);
+		return vm.nil;
+	}
+	// the yielded value, or the return value which is not a part of the sequence
+	var_base_t *val = vm.vm_stack->pop(false);
+	if(st->vars == nullptr) {
+		var_dref(val);
+		var_iref(vm.nil);
+		return vm.nil;
+	}
+	return val;
+}
+
+bool var_gen_t::done() const
+{
+	return m_state->vars == nullptr;
+}
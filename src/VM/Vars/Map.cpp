@@ -13,46 +13,282 @@
 
 #include "VM/Vars/Base.hpp"
 
+#include <algorithm>
+#include <functional>
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////// VAR_MAP //////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xFE
+#define MAP_CAP_MIN 8
+
+static inline size_t mix(size_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static bool key_hash(vm_state_t &vm, var_base_t *key, size_t &hash, const size_t &src_id,
+		     const size_t &idx)
+{
+	if(key->istype<var_str_t>()) {
+		hash = std::hash<std::string>()(STR(key)->get());
+	} else if(key->istype<var_int_t>()) {
+		mpz_t &val = INT(key)->get();
+		if(mpz_fits_slong_p(val)) {
+			hash = mpz_get_si(val);
+		} else {
+			hash = mpz_sgn(val);
+			for(size_t i = 0; i < mpz_size(val); ++i) {
+				hash = hash * 31 + mpz_getlimbn(val, i);
+			}
+		}
+	} else if(key->istype<var_bool_t>()) {
+		hash = BOOL(key)->get();
+	} else if(key->istype<var_flt_t>()) {
+		hash = std::hash<double>()(mpfr_get_d(FLT(key)->get(), mpfr_get_default_rounding_mode()));
+	} else if(key->istype<var_nil_t>()) {
+		hash = 0;
+	} else if(key->istype<var_typeid_t>()) {
+		hash = TYPEID(key)->get();
+	} else {
+		std::string str;
+		if(!key->to_str(vm, str, src_id, idx)) return false;
+		hash = std::hash<std::string>()(str);
+	}
+	hash = mix(hash ^ key->type());
+	return true;
+}
+
+// keys of different types are never equal
+static bool key_eq(vm_state_t &vm, var_base_t *a, var_base_t *b, bool &eq, const size_t &src_id,
+		   const size_t &idx)
+{
+	if(a->type() != b->type()) eq = false;
+	else if(a->istype<var_str_t>()) eq = STR(a)->get() == STR(b)->get();
+	else if(a->istype<var_int_t>()) eq = mpz_cmp(INT(a)->get(), INT(b)->get()) == 0;
+	else if(a->istype<var_bool_t>()) eq = BOOL(a)->get() == BOOL(b)->get();
+	else if(a->istype<var_flt_t>()) eq = mpfr_cmp(FLT(a)->get(), FLT(b)->get()) == 0;
+	else if(a->istype<var_nil_t>()) eq = true;
+	else if(a->istype<var_typeid_t>()) eq = TYPEID(a)->get() == TYPEID(b)->get();
+	else {
+		std::string sa, sb;
+		if(!a->to_str(vm, sa, src_id, idx) || !b->to_str(vm, sb, src_id, idx)) return false;
+		eq = sa == sb;
+	}
+	return true;
+}
+
+var_map_t::var_map_t(const bool &refs, const bool &sorted, const size_t &src_id,
+		     const size_t &idx)
+	: var_base_t(type_id<var_map_t>(), src_id, idx, false, false), m_size(0), m_used(0),
+	  m_refs(refs), m_sorted(sorted)
+{}
 var_map_t::var_map_t(const std::map<std::string, var_base_t *> &val, const bool &refs,
 		     const size_t &src_id, const size_t &idx)
-	: var_base_t(type_id<var_map_t>(), src_id, idx, false, false), m_val(val), m_refs(refs)
-{}
+	: var_base_t(type_id<var_map_t>(), src_id, idx, false, false), m_size(0), m_used(0),
+	  m_refs(refs), m_sorted(false)
+{
+	// keys are unique and hashing strings cannot fail, so entries are added directly
+	if(!val.empty()) rehash(val.size() * 2);
+	for(auto &v : val) {
+		var_base_t *key = new var_str_t(v.first, src_id, idx);
+		size_t hash	= std::hash<std::string>()(v.first);
+		hash		= mix(hash ^ key->type());
+		size_t mask	= m_ctrl.size() - 1;
+		size_t slot	= (hash >> 7) & mask;
+		while(m_ctrl[slot] != CTRL_EMPTY) slot = (slot + 1) & mask;
+		m_ctrl[slot]  = hash & 0x7F;
+		m_slots[slot] = m_entries.size();
+		m_entries.push_back({key, v.second, hash});
+		++m_size;
+		++m_used;
+	}
+}
 var_map_t::~var_map_t()
 {
-	for(auto &v : m_val) var_dref(v.second);
+	for(auto &e : m_entries) {
+		if(!e.key) continue;
+		var_dref(e.key);
+		var_dref(e.val);
+	}
 }
 
 var_base_t *var_map_t::copy(const size_t &src_id, const size_t &idx)
 {
-	std::map<std::string, var_base_t *> new_map;
-	for(auto &v : m_val) {
-		new_map[v.first] = v.second->copy(src_id, idx);
+	var_map_t *res	= new var_map_t(m_refs, m_sorted, src_id, idx);
+	res->m_entries	= m_entries;
+	res->m_ctrl	= m_ctrl;
+	res->m_slots	= m_slots;
+	res->m_size	= m_size;
+	res->m_used	= m_used;
+	for(auto &e : res->m_entries) {
+		if(!e.key) continue;
+		// keys are never modified once inserted, so they can be shared
+		var_iref(e.key);
+		e.val = e.val->copy(src_id, idx);
 	}
-	return new var_map_t(new_map, m_refs, src_id, idx);
+	return res;
 }
 
 void var_map_t::set(var_base_t *from)
 {
-	for(auto &v : m_val) {
-		var_dref(v.second);
+	var_map_t *map = MAP(from);
+	for(auto &e : map->m_entries) {
+		if(!e.key) continue;
+		var_iref(e.key);
+		var_iref(e.val);
 	}
-	m_val.clear();
-	for(auto &v : MAP(from)->m_val) {
-		var_iref(v.second);
+	for(auto &e : m_entries) {
+		if(!e.key) continue;
+		var_dref(e.key);
+		var_dref(e.val);
 	}
-	m_val  = MAP(from)->m_val;
-	m_refs = MAP(from)->m_refs;
+	m_entries = map->m_entries;
+	m_ctrl	  = map->m_ctrl;
+	m_slots	  = map->m_slots;
+	m_size	  = map->m_size;
+	m_used	  = map->m_used;
+	m_refs	  = map->m_refs;
+	m_sorted  = map->m_sorted;
 }
 
-std::map<std::string, var_base_t *> &var_map_t::get()
+bool var_map_t::find_slot(vm_state_t &vm, var_base_t *key, const size_t &hash, size_t &slot,
+			  bool &found, const size_t &src_id, const size_t &idx)
 {
-	return m_val;
+	found = false;
+	if(m_ctrl.empty()) return true;
+	const size_t mask	    = m_ctrl.size() - 1;
+	const unsigned char tag	    = hash & 0x7F;
+	size_t deleted		    = m_ctrl.size();
+	for(slot = (hash >> 7) & mask;; slot = (slot + 1) & mask) {
+		const unsigned char ctrl = m_ctrl[slot];
+		if(ctrl == CTRL_EMPTY) break;
+		if(ctrl == CTRL_DELETED) {
+			if(deleted == m_ctrl.size()) deleted = slot;
+			continue;
+		}
+		if(ctrl != tag) continue;
+		map_entry_t &e = m_entries[m_slots[slot]];
+		if(e.hash != hash) continue;
+		bool eq = false;
+		if(!key_eq(vm, e.key, key, eq, src_id, idx)) return false;
+		if(eq) {
+			found = true;
+			return true;
+		}
+	}
+	if(deleted != m_ctrl.size()) slot = deleted;
+	return true;
 }
+
+void var_map_t::rehash(const size_t &cap)
+{
+	size_t new_cap = MAP_CAP_MIN;
+	while(new_cap < cap) new_cap <<= 1;
+	// drop erased entries
+	size_t live = 0;
+	for(size_t i = 0; i < m_entries.size(); ++i) {
+		if(m_entries[i].key) m_entries[live++] = m_entries[i];
+	}
+	m_entries.resize(live);
+	m_ctrl.assign(new_cap, CTRL_EMPTY);
+	m_slots.assign(new_cap, 0);
+	const size_t mask = new_cap - 1;
+	for(size_t i = 0; i < m_entries.size(); ++i) {
+		size_t slot = (m_entries[i].hash >> 7) & mask;
+		while(m_ctrl[slot] != CTRL_EMPTY) slot = (slot + 1) & mask;
+		m_ctrl[slot]  = m_entries[i].hash & 0x7F;
+		m_slots[slot] = i;
+	}
+	m_used = m_entries.size();
+}
+
+bool var_map_t::insert(vm_state_t &vm, var_base_t *key, var_base_t *val, const size_t &src_id,
+		       const size_t &idx)
+{
+	size_t hash = 0, slot = 0;
+	bool found  = false;
+	if(!key_hash(vm, key, hash, src_id, idx)) return false;
+	if(!find_slot(vm, key, hash, slot, found, src_id, idx)) return false;
+	if(m_refs) var_iref(val);
+	else val = val->copy(src_id, idx);
+	if(found) {
+		map_entry_t &e = m_entries[m_slots[slot]];
+		var_dref(e.val);
+		e.val = val;
+		return true;
+	}
+	// max load (including deleted slots) is 7/8
+	if((m_used + 1) * 8 > m_ctrl.size() * 7) {
+		rehash((m_size + 1) * 2);
+		// no deleted slots after rehash, and key is known to not exist
+		const size_t mask = m_ctrl.size() - 1;
+		slot		  = (hash >> 7) & mask;
+		while(m_ctrl[slot] != CTRL_EMPTY) slot = (slot + 1) & mask;
+	}
+	if(m_ctrl[slot] == CTRL_EMPTY) ++m_used;
+	m_ctrl[slot]  = hash & 0x7F;
+	m_slots[slot] = m_entries.size();
+	m_entries.push_back({key->copy(src_id, idx), val, hash});
+	++m_size;
+	return true;
+}
+
+bool var_map_t::find(vm_state_t &vm, var_base_t *key, var_base_t *&val, const size_t &src_id,
+		     const size_t &idx)
+{
+	size_t hash = 0, slot = 0;
+	bool found  = false;
+	val	    = nullptr;
+	if(!key_hash(vm, key, hash, src_id, idx)) return false;
+	if(!find_slot(vm, key, hash, slot, found, src_id, idx)) return false;
+	if(found) val = m_entries[m_slots[slot]].val;
+	return true;
+}
+
+bool var_map_t::erase(vm_state_t &vm, var_base_t *key, const size_t &src_id, const size_t &idx)
+{
+	size_t hash = 0, slot = 0;
+	bool found  = false;
+	if(!key_hash(vm, key, hash, src_id, idx)) return false;
+	if(!find_slot(vm, key, hash, slot, found, src_id, idx)) return false;
+	if(!found) return true;
+	size_t pos     = m_slots[slot];
+	map_entry_t &e = m_entries[pos];
+	var_dref(e.key);
+	var_dref(e.val);
+	e.key	     = nullptr;
+	m_ctrl[slot] = CTRL_DELETED;
+	--m_size;
+	if(pos == m_entries.size() - 1) m_entries.pop_back();
+	return true;
+}
+
+bool var_map_t::order(vm_state_t &vm, std::vector<size_t> &pos, const size_t &src_id,
+		      const size_t &idx)
+{
+	pos.clear();
+	for(size_t i = 0; i < m_entries.size(); ++i) {
+		if(m_entries[i].key) pos.push_back(i);
+	}
+	if(!m_sorted) return true;
+	std::vector<std::string> strs(m_entries.size());
+	for(auto &p : pos) {
+		if(!m_entries[p].key->to_str(vm, strs[p], src_id, idx)) return false;
+	}
+	std::stable_sort(pos.begin(), pos.end(),
+			 [&strs](const size_t &a, const size_t &b) { return strs[a] < strs[b]; });
+	return true;
+}
+
 bool var_map_t::is_ref_map()
 {
 	return m_refs;
-}
\ No newline at end of file
+}
@@ -0,0 +1,962 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include <cinttypes>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "std/array_type.hpp"
+#include "VM/VM.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////// Kernels /////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The reductions, counts and masks below are vectorized by hand with AVX2 (the build uses
+// -march=native) since the compiler cannot reorder floating point sums by itself or pack
+// wide comparison results into bytes efficiently. Each kernel handles the tail with the
+// scalar loop, which is also the whole implementation when AVX2 is not available.
+// Element wise operations (fill, scale, add) are plain loops which the compiler vectorizes.
+// Integer arithmetic wraps around on overflow.
+
+enum CmpOp
+{
+	CMP_LT,
+	CMP_LE,
+	CMP_GT,
+	CMP_GE,
+	CMP_EQ,
+	CMP_NE,
+};
+
+template<int OP, typename T> static inline bool cmp(const T &a, const T &b)
+{
+	switch(OP) {
+	case CMP_LT: return a < b;
+	case CMP_LE: return a <= b;
+	case CMP_GT: return a > b;
+	case CMP_GE: return a >= b;
+	case CMP_EQ: return a == b;
+	case CMP_NE: return a != b;
+	}
+	return false;
+}
+
+#if defined(__AVX2__)
+// spreads the lowest 4 bits of mask to 4 bytes of 0/1 (little endian)
+static inline uint32_t mask4_bytes(const int &mask)
+{
+	return (uint32_t)(((uint64_t)mask * 0x00204081u) & 0x01010101u);
+}
+
+static inline int64_t hsum_i64(const __m256i &v)
+{
+	alignas(32) uint64_t lanes[4];
+	_mm256_store_si256((__m256i *)lanes, v);
+	return (int64_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+static inline double hsum_f64(const __m256d &v)
+{
+	alignas(32) double lanes[4];
+	_mm256_store_pd(lanes, v);
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+#endif
+
+static int64_t sum_i64(const int64_t *a, const size_t &n)
+{
+	size_t i     = 0;
+	uint64_t res = 0;
+#if defined(__AVX2__)
+	__m256i acc = _mm256_setzero_si256();
+	for(; i + 4 <= n; i += 4) {
+		acc = _mm256_add_epi64(acc, _mm256_loadu_si256((const __m256i *)(a + i)));
+	}
+	res = hsum_i64(acc);
+#endif
+	for(; i < n; ++i) res += (uint64_t)a[i];
+	return (int64_t)res;
+}
+
+static double sum_f64(const double *a, const size_t &n)
+{
+	size_t i   = 0;
+	double res = 0.0;
+#if defined(__AVX2__)
+	// two accumulators to hide the latency of the additions
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	for(; i + 8 <= n; i += 8) {
+		acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+		acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(a + i + 4));
+	}
+	res = hsum_f64(_mm256_add_pd(acc0, acc1));
+#endif
+	for(; i < n; ++i) res += a[i];
+	return res;
+}
+
+static uint64_t sum_u8(const uint8_t *a, const size_t &n)
+{
+	size_t i     = 0;
+	uint64_t res = 0;
+#if defined(__AVX2__)
+	// sad against zero adds up each group of 8 bytes into a 64 bit lane
+	__m256i acc  = _mm256_setzero_si256();
+	__m256i zero = _mm256_setzero_si256();
+	for(; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(a + i));
+		acc	  = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+	}
+	res = hsum_i64(acc);
+#endif
+	for(; i < n; ++i) res += a[i];
+	return res;
+}
+
+// n must be > 0 for the min/max kernels
+template<bool MAX> static int64_t minmax_i64(const int64_t *a, const size_t &n)
+{
+	size_t i    = 0;
+	int64_t res = a[0];
+#if defined(__AVX2__)
+	if(n >= 4) {
+		__m256i acc = _mm256_loadu_si256((const __m256i *)a);
+		for(i = 4; i + 4 <= n; i += 4) {
+			__m256i v    = _mm256_loadu_si256((const __m256i *)(a + i));
+			__m256i take = MAX ? _mm256_cmpgt_epi64(v, acc) : _mm256_cmpgt_epi64(acc, v);
+			acc	     = _mm256_blendv_epi8(acc, v, take);
+		}
+		alignas(32) int64_t lanes[4];
+		_mm256_store_si256((__m256i *)lanes, acc);
+		for(size_t l = 0; l < 4; ++l) {
+			if(MAX ? lanes[l] > res : lanes[l] < res) res = lanes[l];
+		}
+	}
+#endif
+	for(; i < n; ++i) {
+		if(MAX ? a[i] > res : a[i] < res) res = a[i];
+	}
+	return res;
+}
+
+template<bool MAX> static double minmax_f64(const double *a, const size_t &n)
+{
+	size_t i   = 0;
+	double res = a[0];
+#if defined(__AVX2__)
+	if(n >= 4) {
+		__m256d acc = _mm256_loadu_pd(a);
+		for(i = 4; i + 4 <= n; i += 4) {
+			__m256d v = _mm256_loadu_pd(a + i);
+			acc	  = MAX ? _mm256_max_pd(acc, v) : _mm256_min_pd(acc, v);
+		}
+		alignas(32) double lanes[4];
+		_mm256_store_pd(lanes, acc);
+		for(size_t l = 0; l < 4; ++l) {
+			if(MAX ? lanes[l] > res : lanes[l] < res) res = lanes[l];
+		}
+	}
+#endif
+	for(; i < n; ++i) {
+		if(MAX ? a[i] > res : a[i] < res) res = a[i];
+	}
+	return res;
+}
+
+template<bool MAX> static uint8_t minmax_u8(const uint8_t *a, const size_t &n)
+{
+	size_t i    = 0;
+	uint8_t res = a[0];
+#if defined(__AVX2__)
+	if(n >= 32) {
+		__m256i acc = _mm256_loadu_si256((const __m256i *)a);
+		for(i = 32; i + 32 <= n; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(a + i));
+			acc	  = MAX ? _mm256_max_epu8(acc, v) : _mm256_min_epu8(acc, v);
+		}
+		alignas(32) uint8_t lanes[32];
+		_mm256_store_si256((__m256i *)lanes, acc);
+		for(size_t l = 0; l < 32; ++l) {
+			if(MAX ? lanes[l] > res : lanes[l] < res) res = lanes[l];
+		}
+	}
+#endif
+	for(; i < n; ++i) {
+		if(MAX ? a[i] > res : a[i] < res) res = a[i];
+	}
+	return res;
+}
+
+static int64_t dot_i64(const int64_t *a, const int64_t *b, const size_t &n)
+{
+	// AVX2 has no 64 bit multiply, this loop is left to the compiler
+	uint64_t res = 0;
+	for(size_t i = 0; i < n; ++i) res += (uint64_t)a[i] * (uint64_t)b[i];
+	return (int64_t)res;
+}
+
+static double dot_f64(const double *a, const double *b, const size_t &n)
+{
+	size_t i   = 0;
+	double res = 0.0;
+#if defined(__AVX2__)
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	for(; i + 8 <= n; i += 8) {
+#if defined(__FMA__)
+		acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc0);
+		acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4),
+				       acc1);
+#else
+		acc0 = _mm256_add_pd(acc0,
+				     _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		acc1 = _mm256_add_pd(
+		acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+#endif
+	}
+	res = hsum_f64(_mm256_add_pd(acc0, acc1));
+#endif
+	for(; i < n; ++i) res += a[i] * b[i];
+	return res;
+}
+
+static uint64_t dot_u8(const uint8_t *a, const uint8_t *b, const size_t &n)
+{
+	uint64_t res = 0;
+	for(size_t i = 0; i < n; ++i) res += (uint32_t)a[i] * b[i];
+	return res;
+}
+
+static size_t count_i64(const int64_t *a, const size_t &n, const int64_t &k)
+{
+	size_t i = 0, res = 0;
+#if defined(__AVX2__)
+	__m256i kv = _mm256_set1_epi64x(k);
+	for(; i + 4 <= n; i += 4) {
+		__m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(a + i)), kv);
+		res += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(eq)));
+	}
+#endif
+	for(; i < n; ++i) res += a[i] == k;
+	return res;
+}
+
+static size_t count_f64(const double *a, const size_t &n, const double &k)
+{
+	size_t i = 0, res = 0;
+#if defined(__AVX2__)
+	__m256d kv = _mm256_set1_pd(k);
+	for(; i + 4 <= n; i += 4) {
+		__m256d eq = _mm256_cmp_pd(_mm256_loadu_pd(a + i), kv, _CMP_EQ_OQ);
+		res += __builtin_popcount(_mm256_movemask_pd(eq));
+	}
+#endif
+	for(; i < n; ++i) res += a[i] == k;
+	return res;
+}
+
+static size_t count_u8(const uint8_t *a, const size_t &n, const uint8_t &k)
+{
+	size_t i = 0, res = 0;
+#if defined(__AVX2__)
+	__m256i kv = _mm256_set1_epi8((char)k);
+	for(; i + 32 <= n; i += 32) {
+		__m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)), kv);
+		res += __builtin_popcount((uint32_t)_mm256_movemask_epi8(eq));
+	}
+#endif
+	for(; i < n; ++i) res += a[i] == k;
+	return res;
+}
+
+template<int OP> static void mask_i64(const int64_t *a, const size_t &n, const int64_t &k,
+				      uint8_t *out)
+{
+	size_t i = 0;
+#if defined(__AVX2__)
+	__m256i kv   = _mm256_set1_epi64x(k);
+	__m256i ones = _mm256_set1_epi64x(-1);
+	for(; i + 4 <= n; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i m;
+		switch(OP) {
+		case CMP_LT: m = _mm256_cmpgt_epi64(kv, v); break;
+		case CMP_LE: m = _mm256_xor_si256(_mm256_cmpgt_epi64(v, kv), ones); break;
+		case CMP_GT: m = _mm256_cmpgt_epi64(v, kv); break;
+		case CMP_GE: m = _mm256_xor_si256(_mm256_cmpgt_epi64(kv, v), ones); break;
+		case CMP_EQ: m = _mm256_cmpeq_epi64(v, kv); break;
+		default: m = _mm256_xor_si256(_mm256_cmpeq_epi64(v, kv), ones); break;
+		}
+		uint32_t bytes = mask4_bytes(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+		memcpy(out + i, &bytes, 4);
+	}
+#endif
+	for(; i < n; ++i) out[i] = cmp<OP>(a[i], k);
+}
+
+template<int OP> static void mask_f64(const double *a, const size_t &n, const double &k,
+				      uint8_t *out)
+{
+	size_t i = 0;
+#if defined(__AVX2__)
+	__m256d kv = _mm256_set1_pd(k);
+	for(; i + 4 <= n; i += 4) {
+		__m256d v = _mm256_loadu_pd(a + i);
+		__m256d m;
+		switch(OP) {
+		case CMP_LT: m = _mm256_cmp_pd(v, kv, _CMP_LT_OQ); break;
+		case CMP_LE: m = _mm256_cmp_pd(v, kv, _CMP_LE_OQ); break;
+		case CMP_GT: m = _mm256_cmp_pd(v, kv, _CMP_GT_OQ); break;
+		case CMP_GE: m = _mm256_cmp_pd(v, kv, _CMP_GE_OQ); break;
+		case CMP_EQ: m = _mm256_cmp_pd(v, kv, _CMP_EQ_OQ); break;
+		default: m = _mm256_cmp_pd(v, kv, _CMP_NEQ_UQ); break;
+		}
+		uint32_t bytes = mask4_bytes(_mm256_movemask_pd(m));
+		memcpy(out + i, &bytes, 4);
+	}
+#endif
+	for(; i < n; ++i) out[i] = cmp<OP>(a[i], k);
+}
+
+template<int OP> static void mask_u8(const uint8_t *a, const size_t &n, const int64_t &k,
+				     uint8_t *out)
+{
+	for(size_t i = 0; i < n; ++i) out[i] = cmp<OP>((int64_t)a[i], k);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////// Helpers /////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+static var_int_t *make_i64(const int64_t &val)
+{
+	var_int_t *res = make<var_int_t>(0);
+	mpz_set_si(res->get(), val);
+	return res;
+}
+
+static var_base_t *array_box(vm_state_t &vm, var_array_t *arr, const size_t &pos)
+{
+	switch(arr->kind()) {
+	case AK_I64: return make_i64(arr->data<int64_t>()[pos]);
+	case AK_F64: return make<var_flt_t>(arr->data<double>()[pos]);
+	case AK_U8: return make<var_int_t>((int)arr->data<uint8_t>()[pos]);
+	case AK_BOOL: return make<var_bool_t>(arr->data<uint8_t>()[pos]);
+	default: break;
+	}
+	return vm.nil;
+}
+
+// a feral value converted for an array of the given kind
+// integer kinds use ival, f64 uses fval
+struct scalar_t
+{
+	int64_t ival;
+	double fval;
+};
+
+// elem is true when the value is to be stored in the array, which also checks that it
+// fits in the element type (only matters for u8)
+static bool get_scalar(vm_state_t &vm, const size_t &src_id, const size_t &idx,
+		       const ArrayKind &kind, var_base_t *val, const bool &elem, scalar_t &res)
+{
+	switch(kind) {
+	case AK_I64:
+	case AK_U8:
+		if(!val->istype<var_int_t>()) break;
+		if(!mpz_fits_slong_p(INT(val)->get())) {
+			vm.fail(src_id, idx, "integer does not fit in 64 bits for %s array",
+				ArrayKindStrs[kind]);
+			return false;
+		}
+		res.ival = mpz_get_si(INT(val)->get());
+		if(elem && kind == AK_U8 && (res.ival < 0 || res.ival > 255)) {
+			vm.fail(src_id, idx, "integer %" PRId64 " is out of range for u8 array",
+				res.ival);
+			return false;
+		}
+		return true;
+	case AK_F64:
+		if(val->istype<var_flt_t>()) {
+			res.fval = mpfr_get_d(FLT(val)->get(), mpfr_get_default_rounding_mode());
+			return true;
+		}
+		if(val->istype<var_int_t>()) {
+			res.fval = mpz_get_d(INT(val)->get());
+			return true;
+		}
+		break;
+	case AK_BOOL:
+		if(!val->istype<var_bool_t>()) break;
+		res.ival = BOOL(val)->get();
+		return true;
+	default: break;
+	}
+	vm.fail(src_id, idx, "expected a value for %s array, found: %s", ArrayKindStrs[kind],
+		vm.type_name(val).c_str());
+	return false;
+}
+
+static void array_store(var_array_t *arr, const size_t &pos, const scalar_t &val)
+{
+	switch(arr->kind()) {
+	case AK_I64: arr->data<int64_t>()[pos] = val.ival; break;
+	case AK_F64: arr->data<double>()[pos] = val.fval; break;
+	default: arr->data<uint8_t>()[pos] = (uint8_t)val.ival; break;
+	}
+}
+
+static bool get_pos(vm_state_t &vm, const fn_data_t &fd, var_base_t *val, size_t &pos,
+		    const char *fn_name)
+{
+	if(!val->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx,
+			"expected index to be of type 'int' for array.%s(), found: %s", fn_name,
+			vm.type_name(val).c_str());
+		return false;
+	}
+	mpz_t &v = INT(val)->get();
+	if(mpz_sgn(v) < 0 || !mpz_fits_ulong_p(v)) {
+		vm.fail(fd.src_id, fd.idx, "index for array.%s() must be a non negative int in range",
+			fn_name);
+		return false;
+	}
+	pos = mpz_get_ui(v);
+	return true;
+}
+
+// array with len zeroed elements, fails if it cannot be allocated
+static var_array_t *new_array(vm_state_t &vm, const fn_data_t &fd, const ArrayKind &kind,
+			      const size_t &len)
+{
+	var_array_t *res = make<var_array_t>(kind, 0);
+	if(res->resize(len)) return res;
+	delete res;
+	vm.fail(fd.src_id, fd.idx, "failed to allocate %s array of length %zu", ArrayKindStrs[kind],
+		len);
+	return nullptr;
+}
+
+static bool check_numeric(vm_state_t &vm, const fn_data_t &fd, var_array_t *arr,
+			  const char *fn_name)
+{
+	if(arr->kind() != AK_BOOL) return true;
+	vm.fail(fd.src_id, fd.idx, "array.%s() is not supported for bool arrays", fn_name);
+	return false;
+}
+
+// other must be an array of the same kind and length as arr
+static bool check_same_shape(vm_state_t &vm, const fn_data_t &fd, var_array_t *arr,
+			     var_base_t *other, const char *fn_name)
+{
+	if(!other->istype<var_array_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected an array argument for array.%s(), found: %s",
+			fn_name, vm.type_name(other).c_str());
+		return false;
+	}
+	var_array_t *oarr = ARRAY(other);
+	if(oarr->kind() != arr->kind()) {
+		vm.fail(fd.src_id, fd.idx, "array.%s() on %s array with %s array", fn_name,
+			ArrayKindStrs[arr->kind()], ArrayKindStrs[oarr->kind()]);
+		return false;
+	}
+	if(oarr->len() != arr->len()) {
+		vm.fail(fd.src_id, fd.idx, "array.%s() on arrays of length %zu and %zu", fn_name,
+			arr->len(), oarr->len());
+		return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////// Functions ////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+var_base_t *array_new_native(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for array kind, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	if(!fd.args[2]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for array length, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	mpz_t &kind = INT(fd.args[1])->get();
+	if(mpz_sgn(kind) < 0 || mpz_cmp_si(kind, _AK_LAST) >= 0) {
+		vm.fail(fd.src_id, fd.idx, "invalid array kind, expected one of array.I64 .. array.BOOL");
+		return nullptr;
+	}
+	mpz_t &len = INT(fd.args[2])->get();
+	if(mpz_sgn(len) < 0 || !mpz_fits_ulong_p(len)) {
+		vm.fail(fd.src_id, fd.idx, "array length must be a non negative int in range");
+		return nullptr;
+	}
+	return new_array(vm, fd, (ArrayKind)mpz_get_si(kind), mpz_get_ui(len));
+}
+
+var_base_t *array_from_native(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_vec_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected vec argument for array.from(), found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	if(!fd.args[2]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for array kind, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	std::vector<var_base_t *> &vec = VEC(fd.args[1])->get();
+	if(!mpz_fits_sint_p(INT(fd.args[2])->get())) {
+		vm.fail(fd.src_id, fd.idx, "invalid array kind, expected one of array.I64 .. array.BOOL");
+		return nullptr;
+	}
+	int kind = mpz_get_si(INT(fd.args[2])->get());
+	if(kind < 0) {
+		// infer: all bool -> bool, any flt -> f64, otherwise i64
+		kind = vec.empty() ? AK_I64 : AK_BOOL;
+		for(auto &e : vec) {
+			if(e->istype<var_bool_t>()) continue;
+			if(e->istype<var_flt_t>()) {
+				kind = AK_F64;
+				break;
+			}
+			kind = AK_I64;
+		}
+	} else if(kind >= _AK_LAST) {
+		vm.fail(fd.src_id, fd.idx, "invalid array kind: %d", kind);
+		return nullptr;
+	}
+	var_array_t *res = new_array(vm, fd, (ArrayKind)kind, vec.size());
+	if(!res) return nullptr;
+	scalar_t val;
+	for(size_t i = 0; i < vec.size(); ++i) {
+		if(!get_scalar(vm, fd.src_id, fd.idx, res->kind(), vec[i], true, val)) {
+			delete res;
+			return nullptr;
+		}
+		array_store(res, i, val);
+	}
+	return res;
+}
+
+var_base_t *array_to_vec(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	std::vector<var_base_t *> vec;
+	vec.reserve(arr->len());
+	for(size_t i = 0; i < arr->len(); ++i) {
+		var_base_t *e = array_box(vm, arr, i);
+		var_iref(e);
+		vec.push_back(e);
+	}
+	return make<var_vec_t>(vec, false);
+}
+
+var_base_t *array_len(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_int_t>(ARRAY(fd.args[0])->len());
+}
+
+var_base_t *array_kind(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_str_t>(ArrayKindStrs[ARRAY(fd.args[0])->kind()]);
+}
+
+var_base_t *array_at(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	size_t pos;
+	if(!get_pos(vm, fd, fd.args[1], pos, "at")) return nullptr;
+	if(pos >= arr->len()) return vm.nil;
+	return array_box(vm, arr, pos);
+}
+
+var_base_t *array_setat(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	size_t pos;
+	if(!get_pos(vm, fd, fd.args[1], pos, "set")) return nullptr;
+	if(pos >= arr->len()) {
+		vm.fail(fd.src_id, fd.idx, "position %zu is not within array of length %zu", pos,
+			arr->len());
+		return nullptr;
+	}
+	scalar_t val;
+	if(!get_scalar(vm, fd.src_id, fd.idx, arr->kind(), fd.args[2], true, val)) return nullptr;
+	array_store(arr, pos, val);
+	return fd.args[0];
+}
+
+var_base_t *array_push(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	scalar_t val;
+	if(!get_scalar(vm, fd.src_id, fd.idx, arr->kind(), fd.args[1], true, val)) return nullptr;
+	size_t len = arr->len();
+	// doubling is only a hint, growing by one is what must succeed
+	arr->reserve(len < 8 ? 8 : len * 2);
+	if(!arr->resize(len + 1)) {
+		vm.fail(fd.src_id, fd.idx, "failed to grow array of length %zu", len);
+		return nullptr;
+	}
+	array_store(arr, len, val);
+	return fd.args[0];
+}
+
+var_base_t *array_pop(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	if(arr->len() == 0) {
+		vm.fail(fd.src_id, fd.idx, "performed pop() on an empty array");
+		return nullptr;
+	}
+	arr->resize(arr->len() - 1);
+	return fd.args[0];
+}
+
+var_base_t *array_resize(vm_state_t &vm, const fn_data_t &fd)
+{
+	size_t len;
+	if(!get_pos(vm, fd, fd.args[1], len, "resize")) return nullptr;
+	if(!ARRAY(fd.args[0])->resize(len)) {
+		vm.fail(fd.src_id, fd.idx, "failed to resize array to length %zu", len);
+		return nullptr;
+	}
+	return fd.args[0];
+}
+
+var_base_t *array_each(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_array_iterable_t>(ARRAY(fd.args[0]));
+}
+
+var_base_t *array_iterable_next(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_iterable_t *it = ARRAY_ITERABLE(fd.args[0]);
+	size_t pos;
+	if(!it->next(pos)) return vm.nil;
+	return array_box(vm, it->get(), pos);
+}
+
+var_base_t *array_iterable_next_fast(vm_state_t &vm, var_base_t *iterable, var_base_t *reuse,
+				     const size_t &src_id, const size_t &idx)
+{
+	var_array_iterable_t *it = ARRAY_ITERABLE(iterable);
+	var_array_t *arr	 = it->get();
+	size_t pos;
+	if(!it->next(pos)) return nullptr;
+	if(reuse) {
+		if(arr->kind() == AK_I64 && reuse->istype<var_int_t>()) {
+			mpz_set_si(INT(reuse)->get(), arr->data<int64_t>()[pos]);
+			return reuse;
+		}
+		if(arr->kind() == AK_U8 && reuse->istype<var_int_t>()) {
+			mpz_set_ui(INT(reuse)->get(), arr->data<uint8_t>()[pos]);
+			return reuse;
+		}
+		if(arr->kind() == AK_F64 && reuse->istype<var_flt_t>()) {
+			mpfr_set_d(FLT(reuse)->get(), arr->data<double>()[pos],
+				   mpfr_get_default_rounding_mode());
+			return reuse;
+		}
+	}
+	return array_box(vm, arr, pos);
+}
+
+var_base_t *array_to_str(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	std::string res	 = "[";
+	for(size_t i = 0; i < arr->len(); ++i) {
+		var_base_t *e = array_box(vm, arr, i);
+		var_iref(e);
+		bool ok = e->append_str(vm, res, fd.src_id, fd.idx);
+		var_dref(e);
+		if(!ok) return nullptr;
+		if(i + 1 < arr->len()) res += ", ";
+	}
+	res += "]";
+	return make<var_str_t>(res);
+}
+
+var_base_t *array_sum(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	switch(arr->kind()) {
+	case AK_I64: return make_i64(sum_i64(arr->data<int64_t>(), arr->len()));
+	case AK_F64: return make<var_flt_t>(sum_f64(arr->data<double>(), arr->len()));
+	default: break;
+	}
+	var_int_t *res = make<var_int_t>(0);
+	mpz_set_ui(res->get(), sum_u8(arr->data<uint8_t>(), arr->len()));
+	return res;
+}
+
+template<bool MAX> var_base_t *array_minmax(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	if(arr->len() == 0) return vm.nil;
+	switch(arr->kind()) {
+	case AK_I64: return make_i64(minmax_i64<MAX>(arr->data<int64_t>(), arr->len()));
+	case AK_F64: return make<var_flt_t>(minmax_f64<MAX>(arr->data<double>(), arr->len()));
+	case AK_U8: return make<var_int_t>((int)minmax_u8<MAX>(arr->data<uint8_t>(), arr->len()));
+	default: break;
+	}
+	return minmax_u8<MAX>(arr->data<uint8_t>(), arr->len()) ? vm.tru : vm.fals;
+}
+
+var_base_t *array_dot(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	if(!check_numeric(vm, fd, arr, "dot")) return nullptr;
+	if(!check_same_shape(vm, fd, arr, fd.args[1], "dot")) return nullptr;
+	var_array_t *other = ARRAY(fd.args[1]);
+	switch(arr->kind()) {
+	case AK_I64:
+		return make_i64(dot_i64(arr->data<int64_t>(), other->data<int64_t>(), arr->len()));
+	case AK_F64:
+		return make<var_flt_t>(
+		dot_f64(arr->data<double>(), other->data<double>(), arr->len()));
+	default: break;
+	}
+	var_int_t *res = make<var_int_t>(0);
+	mpz_set_ui(res->get(), dot_u8(arr->data<uint8_t>(), other->data<uint8_t>(), arr->len()));
+	return res;
+}
+
+var_base_t *array_fill(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	scalar_t val;
+	if(!get_scalar(vm, fd.src_id, fd.idx, arr->kind(), fd.args[1], true, val)) return nullptr;
+	switch(arr->kind()) {
+	case AK_I64: {
+		int64_t *a = arr->data<int64_t>();
+		for(size_t i = 0; i < arr->len(); ++i) a[i] = val.ival;
+		break;
+	}
+	case AK_F64: {
+		double *a = arr->data<double>();
+		for(size_t i = 0; i < arr->len(); ++i) a[i] = val.fval;
+		break;
+	}
+	default: memset(arr->data<uint8_t>(), (int)val.ival, arr->len()); break;
+	}
+	return fd.args[0];
+}
+
+var_base_t *array_scale(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	if(!check_numeric(vm, fd, arr, "scale")) return nullptr;
+	scalar_t k;
+	if(!get_scalar(vm, fd.src_id, fd.idx, arr->kind(), fd.args[1], false, k)) return nullptr;
+	size_t n = arr->len();
+	switch(arr->kind()) {
+	case AK_I64: {
+		int64_t *a = arr->data<int64_t>();
+		for(size_t i = 0; i < n; ++i) a[i] = (int64_t)((uint64_t)a[i] * (uint64_t)k.ival);
+		break;
+	}
+	case AK_F64: {
+		double *a = arr->data<double>();
+		for(size_t i = 0; i < n; ++i) a[i] *= k.fval;
+		break;
+	}
+	default: {
+		uint8_t *a = arr->data<uint8_t>();
+		uint8_t m  = (uint8_t)k.ival;
+		for(size_t i = 0; i < n; ++i) a[i] = (uint8_t)(a[i] * m);
+		break;
+	}
+	}
+	return fd.args[0];
+}
+
+// adds either another array of the same shape element wise, or a scalar to each element
+var_base_t *array_add(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	if(!check_numeric(vm, fd, arr, "add")) return nullptr;
+	size_t n = arr->len();
+	if(fd.args[1]->istype<var_array_t>()) {
+		if(!check_same_shape(vm, fd, arr, fd.args[1], "add")) return nullptr;
+		var_array_t *other = ARRAY(fd.args[1]);
+		switch(arr->kind()) {
+		case AK_I64: {
+			int64_t *a	 = arr->data<int64_t>();
+			const int64_t *b = other->data<int64_t>();
+			for(size_t i = 0; i < n; ++i) a[i] = (int64_t)((uint64_t)a[i] + (uint64_t)b[i]);
+			break;
+		}
+		case AK_F64: {
+			double *a	= arr->data<double>();
+			const double *b = other->data<double>();
+			for(size_t i = 0; i < n; ++i) a[i] += b[i];
+			break;
+		}
+		default: {
+			uint8_t *a	 = arr->data<uint8_t>();
+			const uint8_t *b = other->data<uint8_t>();
+			for(size_t i = 0; i < n; ++i) a[i] = (uint8_t)(a[i] + b[i]);
+			break;
+		}
+		}
+		return fd.args[0];
+	}
+	scalar_t k;
+	if(!get_scalar(vm, fd.src_id, fd.idx, arr->kind(), fd.args[1], false, k)) return nullptr;
+	switch(arr->kind()) {
+	case AK_I64: {
+		int64_t *a = arr->data<int64_t>();
+		for(size_t i = 0; i < n; ++i) a[i] = (int64_t)((uint64_t)a[i] + (uint64_t)k.ival);
+		break;
+	}
+	case AK_F64: {
+		double *a = arr->data<double>();
+		for(size_t i = 0; i < n; ++i) a[i] += k.fval;
+		break;
+	}
+	default: {
+		uint8_t *a = arr->data<uint8_t>();
+		uint8_t m  = (uint8_t)k.ival;
+		for(size_t i = 0; i < n; ++i) a[i] = (uint8_t)(a[i] + m);
+		break;
+	}
+	}
+	return fd.args[0];
+}
+
+// without arguments: number of true/non zero elements, otherwise number of elements equal
+// to the argument
+var_base_t *array_count(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	size_t n	 = arr->len();
+	if(fd.args.size() == 1) {
+		switch(arr->kind()) {
+		case AK_I64: return make<var_int_t>(n - count_i64(arr->data<int64_t>(), n, 0));
+		case AK_F64: return make<var_int_t>(n - count_f64(arr->data<double>(), n, 0.0));
+		default: break;
+		}
+		return make<var_int_t>(n - count_u8(arr->data<uint8_t>(), n, 0));
+	}
+	scalar_t k;
+	if(!get_scalar(vm, fd.src_id, fd.idx, arr->kind(), fd.args[1], false, k)) return nullptr;
+	switch(arr->kind()) {
+	case AK_I64: return make<var_int_t>(count_i64(arr->data<int64_t>(), n, k.ival));
+	case AK_F64: return make<var_int_t>(count_f64(arr->data<double>(), n, k.fval));
+	default: break;
+	}
+	if(k.ival < 0 || k.ival > 255) return make<var_int_t>(0);
+	return make<var_int_t>(count_u8(arr->data<uint8_t>(), n, (uint8_t)k.ival));
+}
+
+// comparison of each element with a scalar, results in a bool array
+template<int OP> var_base_t *array_mask(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	scalar_t k;
+	if(!get_scalar(vm, fd.src_id, fd.idx, arr->kind(), fd.args[1], false, k)) return nullptr;
+	var_array_t *res = new_array(vm, fd, AK_BOOL, arr->len());
+	if(!res) return nullptr;
+	uint8_t *out = res->data<uint8_t>();
+	switch(arr->kind()) {
+	case AK_I64: mask_i64<OP>(arr->data<int64_t>(), arr->len(), k.ival, out); break;
+	case AK_F64: mask_f64<OP>(arr->data<double>(), arr->len(), k.fval, out); break;
+	default: mask_u8<OP>(arr->data<uint8_t>(), arr->len(), k.ival, out); break;
+	}
+	return res;
+}
+
+// elements for which the bool array mask is true
+var_base_t *array_filter(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_array_t *arr = ARRAY(fd.args[0]);
+	if(!fd.args[1]->istype<var_array_t>() || ARRAY(fd.args[1])->kind() != AK_BOOL) {
+		vm.fail(fd.src_id, fd.idx, "expected a bool array mask for array.filter()");
+		return nullptr;
+	}
+	var_array_t *mask = ARRAY(fd.args[1]);
+	if(mask->len() != arr->len()) {
+		vm.fail(fd.src_id, fd.idx, "array.filter() on array of length %zu with mask of %zu",
+			arr->len(), mask->len());
+		return nullptr;
+	}
+	const uint8_t *m = mask->data<uint8_t>();
+	size_t es	 = arr->elem_size();
+	var_array_t *res = new_array(vm, fd, arr->kind(), arr->len() - count_u8(m, mask->len(), 0));
+	if(!res) return nullptr;
+	size_t len = 0;
+	for(size_t i = 0; i < arr->len(); ++i) {
+		if(!m[i]) continue;
+		memcpy(res->data<unsigned char>() + len++ * es, arr->data<unsigned char>() + i * es,
+		       es);
+	}
+	return res;
+}
+
+INIT_MODULE(array)
+{
+	var_src_t *src = vm.current_source();
+
+	src->add_native_fn("new_native", array_new_native, 2);
+	src->add_native_fn("from_native", array_from_native, 2);
+
+	src->add_native_var("I64", make_all<var_int_t>(AK_I64, src_id, idx));
+	src->add_native_var("F64", make_all<var_int_t>(AK_F64, src_id, idx));
+	src->add_native_var("U8", make_all<var_int_t>(AK_U8, src_id, idx));
+	src->add_native_var("BOOL", make_all<var_int_t>(AK_BOOL, src_id, idx));
+
+	vm.register_type<var_array_t>("array", src_id, idx);
+
+	vm.add_native_typefn<var_array_t>("len", array_len, 0, src_id, idx);
+	vm.add_native_typefn<var_array_t>("kind", array_kind, 0, src_id, idx);
+	vm.add_native_typefn<var_array_t>("at", array_at, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("[]", array_at, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("set", array_setat, 2, src_id, idx);
+	vm.add_native_typefn<var_array_t>("push", array_push, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("pop", array_pop, 0, src_id, idx);
+	vm.add_native_typefn<var_array_t>("resize", array_resize, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("each", array_each, 0, src_id, idx);
+	vm.add_native_typefn<var_array_t>("vec", array_to_vec, 0, src_id, idx);
+	vm.add_native_typefn<var_array_t>("str", array_to_str, 0, src_id, idx);
+
+	vm.add_native_typefn<var_array_t>("sum", array_sum, 0, src_id, idx);
+	vm.add_native_typefn<var_array_t>("min", array_minmax<false>, 0, src_id, idx);
+	vm.add_native_typefn<var_array_t>("max", array_minmax<true>, 0, src_id, idx);
+	vm.add_native_typefn<var_array_t>("dot", array_dot, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("fill", array_fill, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("scale", array_scale, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("add", array_add, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("count", array_count, 0, src_id, idx, true);
+	vm.add_native_typefn<var_array_t>("lt", array_mask<CMP_LT>, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("le", array_mask<CMP_LE>, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("gt", array_mask<CMP_GT>, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("ge", array_mask<CMP_GE>, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("eq", array_mask<CMP_EQ>, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("ne", array_mask<CMP_NE>, 1, src_id, idx);
+	vm.add_native_typefn<var_array_t>("filter", array_filter, 1, src_id, idx);
+
+	vm.register_type<var_array_iterable_t>("array_iterable", src_id, idx);
+	vm.add_native_typefn<var_array_iterable_t>("next", array_iterable_next, 0, src_id, idx);
+	vm.set_iter_next_fn<var_array_iterable_t>(array_iterable_next_fast);
+
+	return true;
+}
@@ -0,0 +1,114 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include "std/array_type.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+const char *ArrayKindStrs[_AK_LAST] = {
+"i64",
+"f64",
+"u8",
+"bool",
+};
+
+var_array_t::var_array_t(const ArrayKind &kind, const size_t &len, const size_t &src_id,
+			 const size_t &idx)
+	: var_base_t(type_id<var_array_t>(), src_id, idx, false, false), m_data(nullptr), m_len(0),
+	  m_cap(0), m_kind(kind)
+{
+	resize(len);
+}
+var_array_t::~var_array_t()
+{
+	if(m_cap > 0) free(m_data);
+}
+
+var_base_t *var_array_t::copy(const size_t &src_id, const size_t &idx)
+{
+	var_array_t *newarr = new var_array_t(m_kind, 0, src_id, idx);
+	newarr->set(this);
+	return newarr;
+}
+
+void var_array_t::set(var_base_t *from)
+{
+	var_array_t *tmp = ARRAY(from);
+	// capacity is counted in elements, so it is invalid for another kind
+	if(m_kind != tmp->m_kind && m_cap > 0) {
+		free(m_data);
+		m_data = nullptr;
+		m_cap  = 0;
+	}
+	m_kind = tmp->m_kind;
+	m_len  = 0;
+	// an array which existed once can be allocated again - if not, this one is left empty
+	if(!reserve(tmp->m_len)) return;
+	if(tmp->m_len > 0) memcpy(m_data, tmp->m_data, tmp->m_len * elem_size());
+	m_len = tmp->m_len;
+}
+
+bool var_array_t::resize(const size_t &new_len)
+{
+	if(new_len > m_cap && !reserve(new_len)) return false;
+	if(new_len > m_len) {
+		memset(m_data + m_len * elem_size(), 0, (new_len - m_len) * elem_size());
+	}
+	m_len = new_len;
+	return true;
+}
+
+bool var_array_t::reserve(const size_t &new_cap)
+{
+	if(new_cap <= m_cap) return true;
+	if(new_cap > SIZE_MAX / elem_size()) return false;
+	unsigned char *data;
+	if(m_cap == 0) data = (unsigned char *)malloc(new_cap * elem_size());
+	else data = (unsigned char *)realloc(m_data, new_cap * elem_size());
+	if(data == nullptr) return false;
+	m_data = data;
+	m_cap  = new_cap;
+	return true;
+}
+
+var_array_iterable_t::var_array_iterable_t(var_array_t *arr, const size_t &src_id,
+					   const size_t &idx)
+	: var_base_t(type_id<var_array_iterable_t>(), src_id, idx, false, false), m_arr(arr),
+	  m_curr(0)
+{
+	var_iref(m_arr);
+}
+var_array_iterable_t::~var_array_iterable_t()
+{
+	var_dref(m_arr);
+}
+
+var_base_t *var_array_iterable_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_array_iterable_t(m_arr, src_id, idx);
+}
+void var_array_iterable_t::set(var_base_t *from)
+{
+	var_dref(m_arr);
+	m_arr = ARRAY_ITERABLE(from)->m_arr;
+	var_iref(m_arr);
+	m_curr = ARRAY_ITERABLE(from)->m_curr;
+}
+
+bool var_array_iterable_t::next(size_t &pos)
+{
+	if(m_curr >= m_arr->len()) return false;
+	pos = m_curr++;
+	return true;
+}
@@ -0,0 +1,311 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include "std/atomic_type.hpp"
+#include "VM/VM.hpp"
+
+// memory orders as exposed to feral
+enum AtomicOrder
+{
+	ORDER_RELAXED,
+	ORDER_ACQUIRE,
+	ORDER_RELEASE,
+	ORDER_ACQ_REL,
+	ORDER_SEQ_CST,
+};
+
+// what the order is used for - loads cannot release and stores cannot acquire
+enum AtomicAccess
+{
+	ACCESS_LOAD,
+	ACCESS_STORE,
+	ACCESS_RMW,
+};
+
+static var_base_t *make_i64(const int64_t &val)
+{
+	mpz_t tmp;
+	mpz_init_set_si(tmp, val);
+	var_int_t *res = make<var_int_t>(tmp);
+	mpz_clear(tmp);
+	return res;
+}
+
+static bool get_i64(vm_state_t &vm, const fn_data_t &fd, const size_t &pos, int64_t &val)
+{
+	if(!fd.args[pos]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for atomic int, found: %s",
+			vm.type_name(fd.args[pos]).c_str());
+		return false;
+	}
+	if(!mpz_fits_slong_p(INT(fd.args[pos])->get())) {
+		vm.fail(fd.src_id, fd.idx, "value does not fit in a 64 bit atomic int");
+		return false;
+	}
+	val = mpz_get_si(INT(fd.args[pos])->get());
+	return true;
+}
+
+// optional memory order argument, sequentially consistent if not given
+static bool get_order(vm_state_t &vm, const fn_data_t &fd, const size_t &pos, const AtomicAccess &op,
+		      std::memory_order &order)
+{
+	order = std::memory_order_seq_cst;
+	if(fd.args.size() <= pos) return true;
+	if(!fd.args[pos]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for memory order, found: %s",
+			vm.type_name(fd.args[pos]).c_str());
+		return false;
+	}
+	mpz_t &val = INT(fd.args[pos])->get();
+	if(mpz_cmp_si(val, ORDER_RELAXED) < 0 || mpz_cmp_si(val, ORDER_SEQ_CST) > 0) {
+		vm.fail(fd.src_id, fd.idx, "invalid memory order");
+		return false;
+	}
+	switch(mpz_get_si(val)) {
+	case ORDER_RELAXED: order = std::memory_order_relaxed; break;
+	case ORDER_ACQUIRE: order = std::memory_order_acquire; break;
+	case ORDER_RELEASE: order = std::memory_order_release; break;
+	case ORDER_ACQ_REL: order = std::memory_order_acq_rel; break;
+	}
+	if(op == ACCESS_LOAD &&
+	   (order == std::memory_order_release || order == std::memory_order_acq_rel)) {
+		vm.fail(fd.src_id, fd.idx, "a load cannot have release semantics");
+		return false;
+	}
+	if(op == ACCESS_STORE &&
+	   (order == std::memory_order_acquire || order == std::memory_order_acq_rel)) {
+		vm.fail(fd.src_id, fd.idx, "a store cannot have acquire semantics");
+		return false;
+	}
+	return true;
+}
+
+// read-modify-write operations wrap around on overflow
+
+// (value, [order]) -> previous value
+#define ATOMIC_FETCH_FUNC(name)                                                          \
+	var_base_t *atomic_int_fetch_##name(vm_state_t &vm, const fn_data_t &fd)         \
+	{                                                                                \
+		int64_t val;                                                             \
+		std::memory_order order;                                                 \
+		if(!get_i64(vm, fd, 1, val) || !get_order(vm, fd, 2, ACCESS_RMW, order)) { \
+			return nullptr;                                                  \
+		}                                                                        \
+		return make_i64(ATOMIC_INT(fd.args[0])->get().fetch_##name(val, order)); \
+	}
+
+// operator form of the above, returns the atomic itself
+#define ATOMIC_ASSN_FUNC(name)                                                   \
+	var_base_t *atomic_int_assn_##name(vm_state_t &vm, const fn_data_t &fd)  \
+	{                                                                        \
+		int64_t val;                                                     \
+		if(!get_i64(vm, fd, 1, val)) return nullptr;                     \
+		ATOMIC_INT(fd.args[0])->get().fetch_##name(val);                 \
+		return fd.args[0];                                               \
+	}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////// Atomic Int ////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+var_base_t *atomic_int_new_native(vm_state_t &vm, const fn_data_t &fd)
+{
+	int64_t val;
+	if(!get_i64(vm, fd, 1, val)) return nullptr;
+	return make<var_atomic_int_t>(
+	std::shared_ptr<std::atomic<int64_t>>(new std::atomic<int64_t>(val)));
+}
+
+var_base_t *atomic_int_load(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::memory_order order;
+	if(!get_order(vm, fd, 1, ACCESS_LOAD, order)) return nullptr;
+	return make_i64(ATOMIC_INT(fd.args[0])->get().load(order));
+}
+
+var_base_t *atomic_int_store(vm_state_t &vm, const fn_data_t &fd)
+{
+	int64_t val;
+	std::memory_order order;
+	if(!get_i64(vm, fd, 1, val) || !get_order(vm, fd, 2, ACCESS_STORE, order)) return nullptr;
+	ATOMIC_INT(fd.args[0])->get().store(val, order);
+	return vm.nil;
+}
+
+var_base_t *atomic_int_exchange(vm_state_t &vm, const fn_data_t &fd)
+{
+	int64_t val;
+	std::memory_order order;
+	if(!get_i64(vm, fd, 1, val) || !get_order(vm, fd, 2, ACCESS_RMW, order)) return nullptr;
+	return make_i64(ATOMIC_INT(fd.args[0])->get().exchange(val, order));
+}
+
+// (expected, desired, [order]) -> true if the value was expected and is now desired
+var_base_t *atomic_int_compare_exchange(vm_state_t &vm, const fn_data_t &fd)
+{
+	int64_t expected, desired;
+	std::memory_order order;
+	if(!get_i64(vm, fd, 1, expected) || !get_i64(vm, fd, 2, desired) ||
+	   !get_order(vm, fd, 3, ACCESS_RMW, order))
+	{
+		return nullptr;
+	}
+	return ATOMIC_INT(fd.args[0])->get().compare_exchange_strong(expected, desired, order)
+	       ? vm.tru
+	       : vm.fals;
+}
+
+ATOMIC_FETCH_FUNC(add)
+ATOMIC_FETCH_FUNC(sub)
+ATOMIC_FETCH_FUNC(and)
+ATOMIC_FETCH_FUNC(or)
+ATOMIC_FETCH_FUNC(xor)
+
+// (value, [order]) -> new value
+var_base_t *atomic_int_add(vm_state_t &vm, const fn_data_t &fd)
+{
+	int64_t val;
+	std::memory_order order;
+	if(!get_i64(vm, fd, 1, val) || !get_order(vm, fd, 2, ACCESS_RMW, order)) return nullptr;
+	return make_i64((int64_t)((uint64_t)ATOMIC_INT(fd.args[0])->get().fetch_add(val, order) +
+				  (uint64_t)val));
+}
+
+var_base_t *atomic_int_sub(vm_state_t &vm, const fn_data_t &fd)
+{
+	int64_t val;
+	std::memory_order order;
+	if(!get_i64(vm, fd, 1, val) || !get_order(vm, fd, 2, ACCESS_RMW, order)) return nullptr;
+	return make_i64((int64_t)((uint64_t)ATOMIC_INT(fd.args[0])->get().fetch_sub(val, order) -
+				  (uint64_t)val));
+}
+
+ATOMIC_ASSN_FUNC(add)
+ATOMIC_ASSN_FUNC(sub)
+ATOMIC_ASSN_FUNC(and)
+ATOMIC_ASSN_FUNC(or)
+ATOMIC_ASSN_FUNC(xor)
+
+var_base_t *atomic_int_preinc(vm_state_t &vm, const fn_data_t &fd)
+{
+	ATOMIC_INT(fd.args[0])->get().fetch_add(1);
+	return fd.args[0];
+}
+
+var_base_t *atomic_int_postinc(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make_i64(ATOMIC_INT(fd.args[0])->get().fetch_add(1));
+}
+
+var_base_t *atomic_int_predec(vm_state_t &vm, const fn_data_t &fd)
+{
+	ATOMIC_INT(fd.args[0])->get().fetch_sub(1);
+	return fd.args[0];
+}
+
+var_base_t *atomic_int_postdec(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make_i64(ATOMIC_INT(fd.args[0])->get().fetch_sub(1));
+}
+
+var_base_t *atomic_int_to_str(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_str_t>(std::to_string(ATOMIC_INT(fd.args[0])->get().load()));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////// Atomic Ref ////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+var_base_t *atomic_ref_new(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_base_t *val = fd.args[1]->copy(fd.src_id, fd.idx);
+	return make<var_atomic_ref_t>(std::shared_ptr<atomic_cell_t>(new atomic_cell_t(val)));
+}
+
+var_base_t *atomic_ref_load(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_base_t *val = ATOMIC_REF(fd.args[0])->get()->load(fd.src_id, fd.idx);
+	val->dref();
+	return val;
+}
+
+var_base_t *atomic_ref_store(vm_state_t &vm, const fn_data_t &fd)
+{
+	ATOMIC_REF(fd.args[0])->get()->store(fd.args[1]->copy(fd.src_id, fd.idx));
+	return vm.nil;
+}
+
+// the previous value is given away as it is, no one else can see it anymore
+var_base_t *atomic_ref_exchange(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_base_t *prev =
+	ATOMIC_REF(fd.args[0])->get()->exchange(fd.args[1]->copy(fd.src_id, fd.idx));
+	prev->dref();
+	return prev;
+}
+
+INIT_MODULE(atomic)
+{
+	var_src_t *src = vm.current_source();
+
+	src->add_native_fn("int_native", atomic_int_new_native, 1);
+	src->add_native_fn("ref", atomic_ref_new, 1);
+
+	vm.register_type<var_atomic_int_t>("atomic_int", src_id, idx);
+
+	vm.add_native_typefn<var_atomic_int_t>("load", atomic_int_load, 0, src_id, idx, true);
+	vm.add_native_typefn<var_atomic_int_t>("store", atomic_int_store, 1, src_id, idx, true);
+	vm.add_native_typefn<var_atomic_int_t>("exchange", atomic_int_exchange, 1, src_id, idx,
+					       true);
+	vm.add_native_typefn<var_atomic_int_t>("compare_exchange", atomic_int_compare_exchange, 2,
+					       src_id, idx, true);
+	vm.add_native_typefn<var_atomic_int_t>("fetch_add", atomic_int_fetch_add, 1, src_id, idx,
+					       true);
+	vm.add_native_typefn<var_atomic_int_t>("fetch_sub", atomic_int_fetch_sub, 1, src_id, idx,
+					       true);
+	vm.add_native_typefn<var_atomic_int_t>("fetch_and", atomic_int_fetch_and, 1, src_id, idx,
+					       true);
+	vm.add_native_typefn<var_atomic_int_t>("fetch_or", atomic_int_fetch_or, 1, src_id, idx,
+					       true);
+	vm.add_native_typefn<var_atomic_int_t>("fetch_xor", atomic_int_fetch_xor, 1, src_id, idx,
+					       true);
+	vm.add_native_typefn<var_atomic_int_t>("add", atomic_int_add, 1, src_id, idx, true);
+	vm.add_native_typefn<var_atomic_int_t>("sub", atomic_int_sub, 1, src_id, idx, true);
+
+	vm.add_native_typefn<var_atomic_int_t>("+=", atomic_int_assn_add, 1, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("-=", atomic_int_assn_sub, 1, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("&=", atomic_int_assn_and, 1, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("|=", atomic_int_assn_or, 1, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("^=", atomic_int_assn_xor, 1, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("++x", atomic_int_preinc, 0, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("x++", atomic_int_postinc, 0, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("--x", atomic_int_predec, 0, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("x--", atomic_int_postdec, 0, src_id, idx);
+	vm.add_native_typefn<var_atomic_int_t>("str", atomic_int_to_str, 0, src_id, idx);
+
+	vm.register_type<var_atomic_ref_t>("atomic_ref", src_id, idx);
+
+	vm.add_native_typefn<var_atomic_ref_t>("load", atomic_ref_load, 0, src_id, idx);
+	vm.add_native_typefn<var_atomic_ref_t>("store", atomic_ref_store, 1, src_id, idx);
+	vm.add_native_typefn<var_atomic_ref_t>("exchange", atomic_ref_exchange, 1, src_id, idx);
+
+	src->add_native_var("RELAXED", make_all<var_int_t>(ORDER_RELAXED, src_id, idx));
+	src->add_native_var("ACQUIRE", make_all<var_int_t>(ORDER_ACQUIRE, src_id, idx));
+	src->add_native_var("RELEASE", make_all<var_int_t>(ORDER_RELEASE, src_id, idx));
+	src->add_native_var("ACQ_REL", make_all<var_int_t>(ORDER_ACQ_REL, src_id, idx));
+	src->add_native_var("SEQ_CST", make_all<var_int_t>(ORDER_SEQ_CST, src_id, idx));
+
+	return true;
+}
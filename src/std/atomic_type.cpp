@@ -0,0 +1,75 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include "std/atomic_type.hpp"
+
+var_atomic_int_t::var_atomic_int_t(std::shared_ptr<std::atomic<int64_t>> val,
+				   const size_t &src_id, const size_t &idx)
+	: var_base_t(type_id<var_atomic_int_t>(), src_id, idx, false, false), m_val(val)
+{}
+
+var_base_t *var_atomic_int_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_atomic_int_t(m_val, src_id, idx);
+}
+void var_atomic_int_t::set(var_base_t *from)
+{
+	m_val = ATOMIC_INT(from)->m_val;
+}
+
+atomic_cell_t::atomic_cell_t(var_base_t *val) : m_lock(ATOMIC_FLAG_INIT), m_val(val) {}
+atomic_cell_t::~atomic_cell_t()
+{
+	var_dref(m_val);
+}
+
+var_base_t *atomic_cell_t::load(const size_t &src_id, const size_t &idx)
+{
+	lock();
+	var_base_t *val = m_val;
+	var_iref(val);
+	unlock();
+	// the held value is never modified, so it can be copied while others replace it
+	var_base_t *res = val->copy(src_id, idx);
+	var_dref(val);
+	return res;
+}
+
+void atomic_cell_t::store(var_base_t *val)
+{
+	var_base_t *prev = exchange(val);
+	var_dref(prev);
+}
+
+var_base_t *atomic_cell_t::exchange(var_base_t *val)
+{
+	lock();
+	var_base_t *prev = m_val;
+	m_val		 = val;
+	unlock();
+	return prev;
+}
+
+var_atomic_ref_t::var_atomic_ref_t(std::shared_ptr<atomic_cell_t> cell, const size_t &src_id,
+				   const size_t &idx)
+	: var_base_t(type_id<var_atomic_ref_t>(), src_id, idx, false, false), m_cell(cell)
+{}
+
+var_base_t *var_atomic_ref_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_atomic_ref_t(m_cell, src_id, idx);
+}
+void var_atomic_ref_t::set(var_base_t *from)
+{
+	m_cell = ATOMIC_REF(from)->m_cell;
+}
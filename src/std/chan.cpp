@@ -0,0 +1,171 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include "std/chan_type.hpp"
+#include "VM/VM.hpp"
+
+// optional timeout argument (milliseconds), -1 if not given
+static bool get_timeout(vm_state_t &vm, const fn_data_t &fd, const size_t &pos,
+			long long &timeout)
+{
+	timeout = -1;
+	if(fd.args.size() <= pos) return true;
+	if(!fd.args[pos]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected timeout to be an int, found: %s",
+			vm.type_name(fd.args[pos]).c_str());
+		return false;
+	}
+	if(!mpz_fits_slong_p(INT(fd.args[pos])->get())) {
+		vm.fail(fd.src_id, fd.idx, "timeout is too large");
+		return false;
+	}
+	timeout = mpz_get_si(INT(fd.args[pos])->get());
+	return true;
+}
+
+var_base_t *chan_new_native(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected capacity to be an int, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	mpz_t &cap = INT(fd.args[1])->get();
+	if(mpz_sgn(cap) < 0 || !mpz_fits_ulong_p(cap)) {
+		vm.fail(fd.src_id, fd.idx, "capacity must be a non negative int (0 for unbounded)");
+		return nullptr;
+	}
+	return make<var_chan_t>(std::shared_ptr<chan_t>(new chan_t(mpz_get_ui(cap))));
+}
+
+// the channel always gets a copy so that the threads never share a mutable object - a refcount
+// of 1 doesn't make the value a temporary since register operands are passed without a reference
+var_base_t *chan_send(vm_state_t &vm, const fn_data_t &fd)
+{
+	long long timeout;
+	if(!get_timeout(vm, fd, 2, timeout)) return nullptr;
+	var_base_t *val	  = fd.args[1]->copy(fd.src_id, fd.idx);
+	ChanStatus status = CHAN(fd.args[0])->get()->send(val, timeout);
+	if(status == CHAN_OK) return vm.nil;
+	var_dref(val);
+	if(status == CHAN_CLOSED) vm.fail(fd.src_id, fd.idx, "channel is closed");
+	else vm.fail(fd.src_id, fd.idx, "send timed out after %lld ms", timeout);
+	return nullptr;
+}
+
+var_base_t *chan_try_send(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_base_t *val	  = fd.args[1]->copy(fd.src_id, fd.idx);
+	ChanStatus status = CHAN(fd.args[0])->get()->try_send(val);
+	if(status == CHAN_OK) return vm.tru;
+	var_dref(val);
+	if(status == CHAN_CLOSED) {
+		vm.fail(fd.src_id, fd.idx, "channel is closed");
+		return nullptr;
+	}
+	return vm.fals;
+}
+
+// the received value is not copied again - it is given away with the channel's reference
+// dropped (like make<>() does) for the caller to take over
+var_base_t *chan_recv(vm_state_t &vm, const fn_data_t &fd)
+{
+	long long timeout;
+	if(!get_timeout(vm, fd, 1, timeout)) return nullptr;
+	var_base_t *val	  = nullptr;
+	ChanStatus status = CHAN(fd.args[0])->get()->recv(val, timeout);
+	if(status == CHAN_OK) {
+		val->dref();
+		return val;
+	}
+	if(status == CHAN_CLOSED) vm.fail(fd.src_id, fd.idx, "channel is closed");
+	else vm.fail(fd.src_id, fd.idx, "recv timed out after %lld ms", timeout);
+	return nullptr;
+}
+
+// nil if the channel is empty
+var_base_t *chan_try_recv(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_base_t *val = nullptr;
+	if(CHAN(fd.args[0])->get()->try_recv(val) != CHAN_OK) return vm.nil;
+	val->dref();
+	return val;
+}
+
+var_base_t *chan_close(vm_state_t &vm, const fn_data_t &fd)
+{
+	CHAN(fd.args[0])->get()->close();
+	return vm.nil;
+}
+
+var_base_t *chan_closed(vm_state_t &vm, const fn_data_t &fd)
+{
+	return CHAN(fd.args[0])->get()->closed() ? vm.tru : vm.fals;
+}
+
+var_base_t *chan_len(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_int_t>(CHAN(fd.args[0])->get()->len());
+}
+
+var_base_t *chan_cap(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_int_t>(CHAN(fd.args[0])->get()->cap());
+}
+
+var_base_t *chan_each(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_chan_iterable_t>(CHAN(fd.args[0])->get());
+}
+
+var_base_t *chan_iterable_next(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_base_t *val = nullptr;
+	if(CHAN_ITERABLE(fd.args[0])->get()->recv(val, -1) != CHAN_OK) return vm.nil;
+	val->dref();
+	return val;
+}
+
+var_base_t *chan_iterable_next_fast(vm_state_t &vm, var_base_t *iterable, var_base_t *reuse,
+				    const size_t &src_id, const size_t &idx)
+{
+	var_base_t *val = nullptr;
+	if(CHAN_ITERABLE(iterable)->get()->recv(val, -1) != CHAN_OK) return nullptr;
+	val->dref();
+	return val;
+}
+
+INIT_MODULE(chan)
+{
+	var_src_t *src = vm.current_source();
+
+	src->add_native_fn("new_native", chan_new_native, 1);
+
+	vm.register_type<var_chan_t>("chan", src_id, idx);
+
+	vm.add_native_typefn<var_chan_t>("send", chan_send, 1, src_id, idx, true);
+	vm.add_native_typefn<var_chan_t>("try_send", chan_try_send, 1, src_id, idx);
+	vm.add_native_typefn<var_chan_t>("recv", chan_recv, 0, src_id, idx, true);
+	vm.add_native_typefn<var_chan_t>("try_recv", chan_try_recv, 0, src_id, idx);
+	vm.add_native_typefn<var_chan_t>("close", chan_close, 0, src_id, idx);
+	vm.add_native_typefn<var_chan_t>("closed", chan_closed, 0, src_id, idx);
+	vm.add_native_typefn<var_chan_t>("len", chan_len, 0, src_id, idx);
+	vm.add_native_typefn<var_chan_t>("cap", chan_cap, 0, src_id, idx);
+	vm.add_native_typefn<var_chan_t>("each", chan_each, 0, src_id, idx);
+
+	vm.register_type<var_chan_iterable_t>("chan_iterable", src_id, idx);
+	vm.add_native_typefn<var_chan_iterable_t>("next", chan_iterable_next, 0, src_id, idx);
+	vm.set_iter_next_fn<var_chan_iterable_t>(chan_iterable_next_fast);
+
+	return true;
+}
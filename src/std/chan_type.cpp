@@ -0,0 +1,225 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include "std/chan_type.hpp"
+
+#include <chrono>
+
+chan_t::chan_t(const size_t &cap)
+	: m_cap(cap), m_slots(nullptr), m_send_pos(0), m_recv_pos(0), m_closed(false),
+	  m_send_waiters(0), m_recv_waiters(0)
+{
+	if(m_cap == 0) return;
+	m_slots = new slot_t[m_cap];
+	for(size_t i = 0; i < m_cap; ++i) {
+		m_slots[i].seq.store(i, std::memory_order_relaxed);
+		m_slots[i].val = nullptr;
+	}
+}
+chan_t::~chan_t()
+{
+	var_base_t *val = nullptr;
+	while(pop(val)) var_dref(val);
+	delete[] m_slots;
+}
+
+// a slot is free for the sender at pos when its seq is pos, and holds a value for the receiver
+// at pos when its seq is pos + 1 - see Dmitry Vyukov's bounded MPMC queue
+bool chan_t::push(var_base_t *val)
+{
+	if(m_cap == 0) {
+		std::lock_guard<std::mutex> lock(m_queue_mtx);
+		m_queue.push_back(val);
+		return true;
+	}
+	size_t pos = m_send_pos.load(std::memory_order_relaxed);
+	slot_t *slot;
+	while(true) {
+		slot	      = &m_slots[pos % m_cap];
+		size_t seq    = slot->seq.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if(diff == 0) {
+			if(m_send_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if(diff < 0) {
+			return false;
+		} else {
+			pos = m_send_pos.load(std::memory_order_relaxed);
+		}
+	}
+	slot->val = val;
+	slot->seq.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+bool chan_t::pop(var_base_t *&val)
+{
+	if(m_cap == 0) {
+		std::lock_guard<std::mutex> lock(m_queue_mtx);
+		if(m_queue.empty()) return false;
+		val = m_queue.front();
+		m_queue.pop_front();
+		return true;
+	}
+	size_t pos = m_recv_pos.load(std::memory_order_relaxed);
+	slot_t *slot;
+	while(true) {
+		slot	      = &m_slots[pos % m_cap];
+		size_t seq    = slot->seq.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+		if(diff == 0) {
+			if(m_recv_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if(diff < 0) {
+			return false;
+		} else {
+			pos = m_recv_pos.load(std::memory_order_relaxed);
+		}
+	}
+	val = slot->val;
+	slot->seq.store(pos + m_cap, std::memory_order_release);
+	return true;
+}
+
+// the fence pairs with the one in a waiter between registering itself and checking the queue
+// again, so either the waiter sees the change or this sees the waiter
+void chan_t::wake(std::atomic<size_t> &waiters, std::condition_variable &cv)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(waiters.load(std::memory_order_relaxed) == 0) return;
+	// the waiter holds the mutex from its check until it waits
+	{
+		std::lock_guard<std::mutex> lock(m_wait_mtx);
+	}
+	cv.notify_one();
+}
+
+ChanStatus chan_t::try_send(var_base_t *val)
+{
+	if(m_closed) return CHAN_CLOSED;
+	if(!push(val)) return CHAN_WOULD_BLOCK;
+	wake(m_recv_waiters, m_not_empty);
+	return CHAN_OK;
+}
+
+ChanStatus chan_t::send(var_base_t *val, const long long &timeout)
+{
+	std::chrono::steady_clock::time_point deadline;
+	if(timeout >= 0) {
+		deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	}
+	while(true) {
+		ChanStatus status = try_send(val);
+		if(status != CHAN_WOULD_BLOCK) return status;
+		std::unique_lock<std::mutex> lock(m_wait_mtx);
+		++m_send_waiters;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		// a receiver may have made space since the attempt above
+		status = m_closed ? CHAN_CLOSED : (push(val) ? CHAN_OK : CHAN_WOULD_BLOCK);
+		if(status == CHAN_WOULD_BLOCK) {
+			if(timeout < 0) {
+				m_not_full.wait(lock);
+			} else if(m_not_full.wait_until(lock, deadline) == std::cv_status::timeout) {
+				status = m_closed ? CHAN_CLOSED
+						  : (push(val) ? CHAN_OK : CHAN_TIMEOUT);
+			}
+		}
+		--m_send_waiters;
+		lock.unlock();
+		if(status == CHAN_OK) wake(m_recv_waiters, m_not_empty);
+		if(status != CHAN_WOULD_BLOCK) return status;
+	}
+}
+
+ChanStatus chan_t::try_recv(var_base_t *&val)
+{
+	if(!pop(val)) return m_closed ? CHAN_CLOSED : CHAN_WOULD_BLOCK;
+	if(m_cap > 0) wake(m_send_waiters, m_not_full);
+	return CHAN_OK;
+}
+
+ChanStatus chan_t::recv(var_base_t *&val, const long long &timeout)
+{
+	std::chrono::steady_clock::time_point deadline;
+	if(timeout >= 0) {
+		deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	}
+	while(true) {
+		ChanStatus status = try_recv(val);
+		if(status != CHAN_WOULD_BLOCK) return status;
+		std::unique_lock<std::mutex> lock(m_wait_mtx);
+		++m_recv_waiters;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		// a sender may have sent (or closed) since the attempt above
+		status = pop(val) ? CHAN_OK : (m_closed ? CHAN_CLOSED : CHAN_WOULD_BLOCK);
+		if(status == CHAN_WOULD_BLOCK) {
+			if(timeout < 0) {
+				m_not_empty.wait(lock);
+			} else if(m_not_empty.wait_until(lock, deadline) == std::cv_status::timeout) {
+				status = pop(val) ? CHAN_OK : (m_closed ? CHAN_CLOSED : CHAN_TIMEOUT);
+			}
+		}
+		--m_recv_waiters;
+		lock.unlock();
+		if(status == CHAN_OK && m_cap > 0) wake(m_send_waiters, m_not_full);
+		if(status != CHAN_WOULD_BLOCK) return status;
+	}
+}
+
+void chan_t::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wait_mtx);
+		m_closed = true;
+	}
+	m_not_full.notify_all();
+	m_not_empty.notify_all();
+}
+
+size_t chan_t::len()
+{
+	if(m_cap == 0) {
+		std::lock_guard<std::mutex> lock(m_queue_mtx);
+		return m_queue.size();
+	}
+	size_t recv = m_recv_pos.load();
+	size_t send = m_send_pos.load();
+	return send > recv ? send - recv : 0;
+}
+
+var_chan_t::var_chan_t(std::shared_ptr<chan_t> chan, const size_t &src_id, const size_t &idx)
+	: var_base_t(type_id<var_chan_t>(), src_id, idx, false, false), m_chan(chan)
+{}
+
+var_base_t *var_chan_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_chan_t(m_chan, src_id, idx);
+}
+void var_chan_t::set(var_base_t *from)
+{
+	m_chan = CHAN(from)->m_chan;
+}
+
+var_chan_iterable_t::var_chan_iterable_t(std::shared_ptr<chan_t> chan, const size_t &src_id,
+					 const size_t &idx)
+	: var_base_t(type_id<var_chan_iterable_t>(), src_id, idx, false, false), m_chan(chan)
+{}
+
+var_base_t *var_chan_iterable_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_chan_iterable_t(m_chan, src_id, idx);
+}
+void var_chan_iterable_t::set(var_base_t *from)
+{
+	m_chan = CHAN_ITERABLE(from)->m_chan;
+}
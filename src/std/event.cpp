@@ -0,0 +1,369 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "std/bytebuffer_type.hpp"
+#include "std/event_type.hpp"
+#include "std/multiproc_type.hpp"
+#include "VM/VM.hpp"
+
+static bool get_fd(vm_state_t &vm, const fn_data_t &fd, const size_t &pos, int &res)
+{
+	if(!fd.args[pos]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for file descriptor, found: %s",
+			vm.type_name(fd.args[pos]).c_str());
+		return false;
+	}
+	if(!mpz_fits_sint_p(INT(fd.args[pos])->get())) {
+		vm.fail(fd.src_id, fd.idx, "invalid file descriptor");
+		return false;
+	}
+	res = mpz_get_si(INT(fd.args[pos])->get());
+	return true;
+}
+
+static bool get_handler(vm_state_t &vm, const fn_data_t &fd, const size_t &pos)
+{
+	if(fd.args[pos]->callable() || fd.args[pos]->istype<var_gen_t>()) return true;
+	vm.fail(fd.src_id, fd.idx, "expected a function or generator as handler, found: %s",
+		vm.type_name(fd.args[pos]).c_str());
+	return false;
+}
+
+static bool get_ms(vm_state_t &vm, const fn_data_t &fd, const size_t &pos, uint64_t &ms)
+{
+	if(!fd.args[pos]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for milliseconds, found: %s",
+			vm.type_name(fd.args[pos]).c_str());
+		return false;
+	}
+	mpz_t &val = INT(fd.args[pos])->get();
+	if(mpz_sgn(val) < 0 || !mpz_fits_ulong_p(val)) {
+		vm.fail(fd.src_id, fd.idx, "milliseconds must be a non negative int");
+		return false;
+	}
+	ms = mpz_get_ui(val);
+	return true;
+}
+
+static bool set_nonblock(const int &fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
+
+static bool set_cloexec(const int &fd)
+{
+	int flags = fcntl(fd, F_GETFD, 0);
+	return flags >= 0 && fcntl(fd, F_SETFD, flags | FD_CLOEXEC) >= 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////// Loop ///////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+var_base_t *event_loop_new(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_event_loop_t>(std::shared_ptr<event_loop_t>(new event_loop_t()));
+}
+
+var_base_t *event_loop_watch(vm_state_t &vm, const fn_data_t &fd)
+{
+	int file;
+	if(!get_fd(vm, fd, 1, file)) return nullptr;
+	if(!fd.args[2]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for events, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	if(!get_handler(vm, fd, 3)) return nullptr;
+	std::string err;
+	int events = mpz_get_si(INT(fd.args[2])->get());
+	if(!EVENT_LOOP(fd.args[0])->get()->watch(file, events, fd.args[3], err)) {
+		vm.fail(fd.src_id, fd.idx, "%s", err.c_str());
+		return nullptr;
+	}
+	return vm.nil;
+}
+
+var_base_t *event_loop_unwatch(vm_state_t &vm, const fn_data_t &fd)
+{
+	int file;
+	if(!get_fd(vm, fd, 1, file)) return nullptr;
+	std::string err;
+	if(!EVENT_LOOP(fd.args[0])->get()->unwatch(file, err)) {
+		vm.fail(fd.src_id, fd.idx, "%s", err.c_str());
+		return nullptr;
+	}
+	return vm.nil;
+}
+
+var_base_t *event_loop_after(vm_state_t &vm, const fn_data_t &fd)
+{
+	uint64_t ms;
+	if(!get_ms(vm, fd, 1, ms) || !get_handler(vm, fd, 2)) return nullptr;
+	return make<var_int_t>(EVENT_LOOP(fd.args[0])->get()->add_timer(ms, fd.args[2], false));
+}
+
+var_base_t *event_loop_every(vm_state_t &vm, const fn_data_t &fd)
+{
+	uint64_t ms;
+	if(!get_ms(vm, fd, 1, ms) || !get_handler(vm, fd, 2)) return nullptr;
+	if(ms == 0) {
+		vm.fail(fd.src_id, fd.idx, "interval of a repeating timer must be at least 1 ms");
+		return nullptr;
+	}
+	return make<var_int_t>(EVENT_LOOP(fd.args[0])->get()->add_timer(ms, fd.args[2], true));
+}
+
+// false if the timer had already fired (one shot) or been cancelled
+var_base_t *event_loop_cancel(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for timer id, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	if(mpz_sgn(INT(fd.args[1])->get()) < 0 || !mpz_fits_ulong_p(INT(fd.args[1])->get())) {
+		return vm.fals;
+	}
+	size_t id = mpz_get_ui(INT(fd.args[1])->get());
+	return EVENT_LOOP(fd.args[0])->get()->cancel(id) ? vm.tru : vm.fals;
+}
+
+var_base_t *event_loop_run(vm_state_t &vm, const fn_data_t &fd)
+{
+	// the loop must outlive the run even if the handlers drop every other reference to it
+	std::shared_ptr<event_loop_t> loop = EVENT_LOOP(fd.args[0])->get();
+	if(!loop->run(vm, fd.src_id, fd.idx)) {
+		vm.fail(fd.src_id, fd.idx, "event handler failed, look at error above");
+		return nullptr;
+	}
+	return vm.nil;
+}
+
+var_base_t *event_loop_stop(vm_state_t &vm, const fn_data_t &fd)
+{
+	EVENT_LOOP(fd.args[0])->get()->stop();
+	return vm.nil;
+}
+
+var_base_t *event_loop_pending(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_int_t>(EVENT_LOOP(fd.args[0])->get()->pending());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// Non Blocking Descriptors /////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// [read end, write end] - both non blocking and closed on exec
+var_base_t *event_pipe(vm_state_t &vm, const fn_data_t &fd)
+{
+	int fds[2];
+	if(pipe(fds) < 0) {
+		vm.fail(fd.src_id, fd.idx, "failed to create pipe, error: %s", strerror(errno));
+		return nullptr;
+	}
+	for(auto &f : fds) {
+		if(set_nonblock(f) && set_cloexec(f)) continue;
+		vm.fail(fd.src_id, fd.idx, "failed to set pipe flags, error: %s", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return nullptr;
+	}
+	return make<var_vec_t>(std::vector<var_base_t *>{new var_int_t(fds[0], fd.src_id, fd.idx),
+							  new var_int_t(fds[1], fd.src_id, fd.idx)},
+			       false);
+}
+
+var_base_t *event_set_nonblock(vm_state_t &vm, const fn_data_t &fd)
+{
+	int file;
+	if(!get_fd(vm, fd, 1, file)) return nullptr;
+	if(!set_nonblock(file)) {
+		vm.fail(fd.src_id, fd.idx, "failed to set file descriptor: '%d' non blocking, error: %s",
+			file, strerror(errno));
+		return nullptr;
+	}
+	return vm.nil;
+}
+
+// reads at most the buffer's capacity - returns the bytes read (0 at end of file),
+// or nil if nothing is available right now
+var_base_t *event_read(vm_state_t &vm, const fn_data_t &fd)
+{
+	int file;
+	if(!get_fd(vm, fd, 1, file)) return nullptr;
+	if(!fd.args[2]->istype<var_bytebuffer_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected bytebuffer to read into, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	var_bytebuffer_t *bb = BYTEBUFFER(fd.args[2]);
+	ssize_t res;
+	do {
+		res = read(file, bb->get_buf(), bb->get_size());
+	} while(res < 0 && errno == EINTR);
+	if(res < 0) {
+		if(errno == EAGAIN || errno == EWOULDBLOCK) return vm.nil;
+		vm.fail(fd.src_id, fd.idx, "failed to read from file descriptor: '%d', error: %s",
+			file, strerror(errno));
+		return nullptr;
+	}
+	bb->set_len(res);
+	return make<var_int_t>(res);
+}
+
+// writes a string or the contents of a bytebuffer - returns the bytes written (which may be
+// fewer than given), or nil if the descriptor cannot take any right now
+var_base_t *event_write(vm_state_t &vm, const fn_data_t &fd)
+{
+	int file;
+	if(!get_fd(vm, fd, 1, file)) return nullptr;
+	const char *data;
+	size_t len;
+	if(fd.args[2]->istype<var_str_t>()) {
+		data = STR(fd.args[2])->get().c_str();
+		len  = STR(fd.args[2])->get().size();
+	} else if(fd.args[2]->istype<var_bytebuffer_t>()) {
+		data = BYTEBUFFER(fd.args[2])->get_buf();
+		len  = BYTEBUFFER(fd.args[2])->get_len();
+	} else {
+		vm.fail(fd.src_id, fd.idx, "expected string or bytebuffer to write, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	ssize_t res;
+	do {
+		res = write(file, data, len);
+	} while(res < 0 && errno == EINTR);
+	if(res < 0) {
+		if(errno == EAGAIN || errno == EWOULDBLOCK) return vm.nil;
+		vm.fail(fd.src_id, fd.idx, "failed to write to file descriptor: '%d', error: %s",
+			file, strerror(errno));
+		return nullptr;
+	}
+	return make<var_int_t>(res);
+}
+
+var_base_t *event_close(vm_state_t &vm, const fn_data_t &fd)
+{
+	int file;
+	if(!get_fd(vm, fd, 1, file)) return nullptr;
+	event_loop_t::fd_closed(file);
+	if(close(file) < 0) {
+		vm.fail(fd.src_id, fd.idx, "failed to close file descriptor: '%d', error: %s", file,
+			strerror(errno));
+		return nullptr;
+	}
+	return vm.nil;
+}
+
+// runs the command with the shell and returns [pid, fd] where fd is the (non blocking) read end
+// of a pipe connected to the command's standard output
+var_base_t *event_spawn(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_str_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected string argument for command, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	int fds[2];
+	if(pipe(fds) < 0) {
+		vm.fail(fd.src_id, fd.idx, "failed to create pipe, error: %s", strerror(errno));
+		return nullptr;
+	}
+	set_cloexec(fds[0]);
+	set_cloexec(fds[1]);
+	const std::string &cmd = STR(fd.args[1])->get();
+	pid_t pid;
+	int res = spawn_shell(cmd, fds[1], -1, pid);
+	close(fds[1]);
+	if(res != 0) {
+		close(fds[0]);
+		vm.fail(fd.src_id, fd.idx, "failed to spawn command: '%s', error: %s", cmd.c_str(),
+			strerror(res));
+		return nullptr;
+	}
+	set_nonblock(fds[0]);
+	return make<var_vec_t>(std::vector<var_base_t *>{new var_int_t(pid, fd.src_id, fd.idx),
+							  new var_int_t(fds[0], fd.src_id, fd.idx)},
+			       false);
+}
+
+// waits for a spawned process to exit and returns its exit code (128 + signal number if it was
+// killed by a signal, like multiproc)
+var_base_t *event_wait(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for process id, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	// 0 and negative ids would wait for any child (or process group)
+	mpz_t &id = INT(fd.args[1])->get();
+	if(mpz_sgn(id) <= 0 || !mpz_fits_sint_p(id)) {
+		vm.fail(fd.src_id, fd.idx, "invalid process id, expected a positive int");
+		return nullptr;
+	}
+	pid_t pid = mpz_get_si(id);
+	int status;
+	pid_t res;
+	do {
+		res = waitpid(pid, &status, 0);
+	} while(res < 0 && errno == EINTR);
+	if(res < 0) {
+		vm.fail(fd.src_id, fd.idx, "failed to wait for process: '%d', error: %s", (int)pid,
+			strerror(errno));
+		return nullptr;
+	}
+	return make<var_int_t>(exit_code_of(status));
+}
+
+INIT_MODULE(event)
+{
+	var_src_t *src = vm.current_source();
+
+	src->add_native_fn("loop", event_loop_new, 0);
+	src->add_native_fn("pipe", event_pipe, 0);
+	src->add_native_fn("set_nonblock", event_set_nonblock, 1);
+	src->add_native_fn("read", event_read, 2);
+	src->add_native_fn("write", event_write, 2);
+	src->add_native_fn("close", event_close, 1);
+	src->add_native_fn("spawn", event_spawn, 1);
+	src->add_native_fn("wait", event_wait, 1);
+
+	vm.register_type<var_event_loop_t>("loop", src_id, idx);
+
+	vm.add_native_typefn<var_event_loop_t>("watch", event_loop_watch, 3, src_id, idx);
+	vm.add_native_typefn<var_event_loop_t>("unwatch", event_loop_unwatch, 1, src_id, idx);
+	vm.add_native_typefn<var_event_loop_t>("after", event_loop_after, 2, src_id, idx);
+	vm.add_native_typefn<var_event_loop_t>("every", event_loop_every, 2, src_id, idx);
+	vm.add_native_typefn<var_event_loop_t>("cancel", event_loop_cancel, 1, src_id, idx);
+	vm.add_native_typefn<var_event_loop_t>("run", event_loop_run, 0, src_id, idx);
+	vm.add_native_typefn<var_event_loop_t>("stop", event_loop_stop, 0, src_id, idx);
+	vm.add_native_typefn<var_event_loop_t>("pending", event_loop_pending, 0, src_id, idx);
+
+	src->add_native_var("READ", make_all<var_int_t>(EV_READ, src_id, idx));
+	src->add_native_var("WRITE", make_all<var_int_t>(EV_WRITE, src_id, idx));
+	src->add_native_var("HUP", make_all<var_int_t>(EV_HUP, src_id, idx));
+	src->add_native_var("ERR", make_all<var_int_t>(EV_ERR, src_id, idx));
+
+	return true;
+}
@@ -0,0 +1,312 @@
+/*
+	MIT License
+
+	Copyright (c) 2021 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include "std/event_type.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#if __linux__
+#include <sys/epoll.h>
+#endif
+
+// events handled in one go by the epoll backend
+#define EVENT_BATCH 64
+
+// loops in run() on this thread, innermost last
+static thread_local std::vector<event_loop_t *> running_loops;
+
+static uint64_t now_ms()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+	       std::chrono::steady_clock::now().time_since_epoch())
+	.count();
+}
+
+event_loop_t::event_loop_t() : m_poll_fd(-1), m_next_timer(0), m_stop(false)
+{
+#if __linux__
+	m_poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+}
+event_loop_t::~event_loop_t()
+{
+	for(auto &w : m_watches) var_dref(w.second.fn);
+	for(auto &t : m_timers) var_dref(t.second.fn);
+	if(m_poll_fd >= 0) close(m_poll_fd);
+}
+
+bool event_loop_t::watch(const int &fd, const int &events, var_base_t *fn, std::string &err)
+{
+	if(fd < 0) {
+		err = "invalid file descriptor: " + std::to_string(fd);
+		return false;
+	}
+	if(!(events & (EV_READ | EV_WRITE))) {
+		err = "events must contain READ and/or WRITE";
+		return false;
+	}
+	auto loc    = m_watches.find(fd);
+	bool exists = loc != m_watches.end();
+#if __linux__
+	if(m_poll_fd >= 0) {
+		struct epoll_event ev;
+		ev.events  = (events & EV_READ ? EPOLLIN : 0) | (events & EV_WRITE ? EPOLLOUT : 0);
+		ev.data.fd = fd;
+		if(epoll_ctl(m_poll_fd, exists ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0) {
+			err = "failed to watch file descriptor " + std::to_string(fd) + ": " +
+			      strerror(errno);
+			return false;
+		}
+	}
+#endif
+	var_iref(fn);
+	if(exists) {
+		var_dref(loc->second.fn);
+		loc->second = {events, fn};
+		return true;
+	}
+	m_watches[fd] = {events, fn};
+	return true;
+}
+
+bool event_loop_t::unwatch(const int &fd, std::string &err)
+{
+	auto loc = m_watches.find(fd);
+	if(loc == m_watches.end()) {
+		err = "file descriptor " + std::to_string(fd) + " is not being watched";
+		return false;
+	}
+#if __linux__
+	// the fd may have been closed already, which removes it from the epoll set anyway
+	if(m_poll_fd >= 0) epoll_ctl(m_poll_fd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+	var_dref(loc->second.fn);
+	m_watches.erase(loc);
+	return true;
+}
+
+size_t event_loop_t::add_timer(const uint64_t &ms, var_base_t *fn, const bool &repeat)
+{
+	size_t id	= m_next_timer++;
+	uint64_t when	= now_ms() + ms;
+	m_timers[id]	= {when, repeat ? ms : 0, fn};
+	var_iref(fn);
+	m_timer_queue.push({when, id});
+	return id;
+}
+
+bool event_loop_t::cancel(const size_t &id)
+{
+	auto loc = m_timers.find(id);
+	if(loc == m_timers.end()) return false;
+	var_dref(loc->second.fn);
+	m_timers.erase(loc);
+	return true;
+}
+
+bool event_loop_t::call(vm_state_t &vm, var_base_t *fn, const std::vector<var_base_t *> &args,
+			bool &done, const size_t &src_id, const size_t &idx)
+{
+	var_base_t *res = nullptr;
+	done		= false;
+	if(fn->istype<var_gen_t>()) {
+		res  = GEN(fn)->next(vm, src_id, idx);
+		done = GEN(fn)->done();
+	} else {
+		res = var_call(vm, fn, args, src_id, idx);
+	}
+	if(!res) return false;
+	var_dref(res);
+	return true;
+}
+
+// only the timers which are due on entry are run, so a timer scheduling another for right now
+// cannot keep the loop from polling
+bool event_loop_t::run_timers(vm_state_t &vm, const size_t &src_id, const size_t &idx)
+{
+	uint64_t now = now_ms();
+	while(!m_stop && !m_timer_queue.empty() && m_timer_queue.top().first <= now) {
+		timer_pos_t pos = m_timer_queue.top();
+		m_timer_queue.pop();
+		auto loc = m_timers.find(pos.second);
+		if(loc == m_timers.end() || loc->second.when != pos.first) continue;
+		var_base_t *fn = loc->second.fn;
+		var_iref(fn);
+		if(loc->second.interval > 0) {
+			// a late timer is not fired again for each interval it missed
+			timer_entry_t &t = loc->second;
+			t.when += t.interval;
+			if(t.when <= now) t.when = now + t.interval;
+			m_timer_queue.push({t.when, pos.second});
+		} else {
+			var_dref(fn);
+			m_timers.erase(loc);
+		}
+		bool done = false;
+		bool ok	  = call(vm, fn, {nullptr}, done, src_id, idx);
+		var_dref(fn);
+		if(!ok) return false;
+		if(done) cancel(pos.second);
+	}
+	return true;
+}
+
+bool event_loop_t::poll(vm_state_t &vm, const int &timeout, const size_t &src_id,
+			const size_t &idx)
+{
+	std::vector<std::pair<int, int>> ready; // fd, events
+	// fds which poll() reports as not open, dropped after their handlers are called
+	std::vector<int> invalid;
+#if __linux__
+	if(m_poll_fd >= 0) {
+		struct epoll_event evs[EVENT_BATCH];
+		int count = epoll_wait(m_poll_fd, evs, EVENT_BATCH, timeout);
+		if(count < 0) {
+			if(errno == EINTR) return true;
+			vm.fail(src_id, idx, "failed to wait for events: %s", strerror(errno));
+			return false;
+		}
+		for(int i = 0; i < count; ++i) {
+			uint32_t e = evs[i].events;
+			int fd	   = evs[i].data.fd;
+			ready.push_back({fd,
+					 (e & EPOLLIN ? EV_READ : 0) | (e & EPOLLOUT ? EV_WRITE : 0) |
+					 (e & EPOLLHUP ? EV_HUP : 0) | (e & EPOLLERR ? EV_ERR : 0)});
+		}
+	}
+#endif
+	if(m_poll_fd < 0) {
+		std::vector<struct pollfd> fds;
+		fds.reserve(m_watches.size());
+		for(auto &w : m_watches) {
+			short e = (w.second.events & EV_READ ? POLLIN : 0) |
+				  (w.second.events & EV_WRITE ? POLLOUT : 0);
+			fds.push_back({w.first, e, 0});
+		}
+		int count = ::poll(fds.data(), fds.size(), timeout);
+		if(count < 0) {
+			if(errno == EINTR) return true;
+			vm.fail(src_id, idx, "failed to wait for events: %s", strerror(errno));
+			return false;
+		}
+		for(auto &p : fds) {
+			if(!p.revents) continue;
+			if(p.revents & POLLNVAL) invalid.push_back(p.fd);
+			ready.push_back({p.fd, (p.revents & POLLIN ? EV_READ : 0) |
+					       (p.revents & POLLOUT ? EV_WRITE : 0) |
+					       (p.revents & POLLHUP ? EV_HUP : 0) |
+					       (p.revents & (POLLERR | POLLNVAL) ? EV_ERR : 0)});
+		}
+	}
+	for(auto &r : ready) {
+		if(m_stop) break;
+		// an earlier handler may have unwatched (or replaced) this one
+		auto loc = m_watches.find(r.first);
+		if(loc == m_watches.end()) continue;
+		var_base_t *fn = loc->second.fn;
+		var_iref(fn);
+		var_base_t *fd_var = new var_int_t(r.first, src_id, idx);
+		var_base_t *ev_var = new var_int_t(r.second, src_id, idx);
+		bool done	   = false;
+		bool ok		   = call(vm, fn, {nullptr, fd_var, ev_var}, done, src_id, idx);
+		var_dref(ev_var);
+		var_dref(fd_var);
+		if(done) {
+			loc = m_watches.find(r.first);
+			std::string err;
+			if(loc != m_watches.end() && loc->second.fn == fn) unwatch(r.first, err);
+		}
+		var_dref(fn);
+		if(!ok) return false;
+	}
+	// which would otherwise be reported again by every poll()
+	for(auto &fd : invalid) {
+		std::string err;
+		if(m_watches.find(fd) != m_watches.end()) unwatch(fd, err);
+	}
+	return true;
+}
+
+void event_loop_t::fd_closed(const int &fd)
+{
+	std::string err;
+	for(auto &loop : running_loops) {
+		if(loop->m_watches.find(fd) != loop->m_watches.end()) loop->unwatch(fd, err);
+	}
+}
+
+bool event_loop_t::run(vm_state_t &vm, const size_t &src_id, const size_t &idx)
+{
+	struct running_t
+	{
+		running_t(event_loop_t *loop)
+		{
+			running_loops.push_back(loop);
+		}
+		~running_t()
+		{
+			running_loops.pop_back();
+		}
+	} running(this);
+
+	std::vector<int> closed;
+	for(auto &w : m_watches) {
+		if(fcntl(w.first, F_GETFD) < 0 && errno == EBADF) closed.push_back(w.first);
+	}
+	for(auto &fd : closed) {
+		std::string err;
+		unwatch(fd, err);
+	}
+
+	m_stop = false;
+	while(!m_stop) {
+		if(!run_timers(vm, src_id, idx)) return false;
+		if(m_stop || (m_watches.empty() && m_timers.empty())) break;
+		int timeout = -1;
+		// drop the cancelled timers at the front so they don't cut the wait short
+		while(!m_timer_queue.empty()) {
+			const timer_pos_t &top = m_timer_queue.top();
+			auto loc	       = m_timers.find(top.second);
+			if(loc != m_timers.end() && loc->second.when == top.first) break;
+			m_timer_queue.pop();
+		}
+		if(!m_timer_queue.empty()) {
+			uint64_t now  = now_ms();
+			uint64_t when = m_timer_queue.top().first;
+			// a timer ~25 days away would not fit, and a negative timeout waits forever
+			timeout = when <= now ? 0 : (when - now > INT_MAX ? INT_MAX : when - now);
+		}
+		if(!poll(vm, timeout, src_id, idx)) return false;
+	}
+	m_stop = false;
+	return true;
+}
+
+var_event_loop_t::var_event_loop_t(std::shared_ptr<event_loop_t> loop, const size_t &src_id,
+				   const size_t &idx)
+	: var_base_t(type_id<var_event_loop_t>(), src_id, idx, false, false), m_loop(loop)
+{}
+
+var_base_t *var_event_loop_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_event_loop_t(m_loop, src_id, idx);
+}
+void var_event_loop_t::set(var_base_t *from)
+{
+	m_loop = EVENT_LOOP(from)->m_loop;
+}
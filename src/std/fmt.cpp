@@ -12,80 +12,197 @@
 */
 
 #include <dirent.h>
+#include <list>
+#include <memory>
 #include <regex>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <unordered_map>
 
 #include "Compiler/Parser.hpp"
 #include "VM/VM.hpp"
 
-bool eval(vm_state_t &vm, const std::string &data, std::string &res, const size_t &src_id,
-	  const size_t &idx);
+#define TEMPLATE_CACHE_MAX 128
+
+// a template is compiled into a list of parts: literal text, or an expression
+struct templ_part_t
+{
+	std::string lit;
+	// nullptr for literal parts
+	std::unique_ptr<bcode_t> expr;
+	// source of the expression for error messages
+	std::string expr_str;
+};
+
+struct templ_prog_t
+{
+	std::vector<templ_part_t> parts;
+};
+
+// the code generated for an expression depends on the source file (__SRC_PATH__ etc.), the
+// location of the template (which is set for all the instructions) and the vm's exec flags
+struct templ_key_t
+{
+	std::string fmt;
+	std::string src_path;
+	size_t src_id;
+	size_t idx;
+	size_t flags;
+
+	inline bool operator==(const templ_key_t &other) const
+	{
+		return src_id == other.src_id && idx == other.idx && flags == other.flags &&
+		       fmt == other.fmt && src_path == other.src_path;
+	}
+};
+
+struct templ_key_hash_t
+{
+	inline size_t operator()(const templ_key_t &key) const
+	{
+		size_t h = std::hash<std::string>()(key.fmt);
+		h ^= std::hash<std::string>()(key.src_path) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		return h ^ ((key.src_id * 31 + key.idx) * 31 + key.flags);
+	}
+};
+
+// least recently used compiled templates, most recent at the front of the list
+// programs are shared so that one being executed stays alive even if a nested template
+// evicts it from the cache
+class templ_cache_t
+{
+	typedef std::list<std::pair<templ_key_t, std::shared_ptr<templ_prog_t>>> lru_t;
+	lru_t m_lru;
+	std::unordered_map<templ_key_t, lru_t::iterator, templ_key_hash_t> m_index;
+
+public:
+	std::shared_ptr<templ_prog_t> get(const templ_key_t &key)
+	{
+		auto it = m_index.find(key);
+		if(it == m_index.end()) return nullptr;
+		m_lru.splice(m_lru.begin(), m_lru, it->second);
+		return it->second->second;
+	}
+	void add(const templ_key_t &key, const std::shared_ptr<templ_prog_t> &prog)
+	{
+		if(m_lru.size() >= TEMPLATE_CACHE_MAX) {
+			m_index.erase(m_lru.back().first);
+			m_lru.pop_back();
+		}
+		m_lru.emplace_front(key, prog);
+		m_index[key] = m_lru.begin();
+	}
+};
+
+// each vm (and thread copy) has its own cache - a vm is not used by multiple threads at once,
+// so it needs no locking
+static inline templ_cache_t *templ_cache(vm_state_t &vm)
+{
+	return vm.mod_data<templ_cache_t>("fmt.templ_cache");
+}
+
+// compiles the expression in data into bc
+static bool compile_expr(vm_state_t &vm, const std::string &data, bcode_t &bc,
+			 const size_t &src_id, const size_t &idx);
+
+// evaluates compiled expression bc and appends the string form of its result to res
+static bool eval(vm_state_t &vm, const bcode_t &bc, const std::string &data, std::string &res,
+		 const size_t &src_id, const size_t &idx);
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////// Functions ////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
-var_base_t *templ(vm_state_t &vm, const fn_data_t &fd)
+// single pass over the template - literal text is collected as is and each {expression} is
+// compiled into a separate part
+// \{ is a literal brace, nested braces are a part of the expression
+static bool templ_compile(vm_state_t &vm, const std::string &fmt_str, templ_prog_t &prog,
+			  const size_t &src_id, const size_t &idx)
 {
-	if(!fd.args[1]->istype<var_str_t>()) {
-		vm.fail(fd.args[1]->src_id(), fd.args[1]->idx(),
-			"expected a string for format string parameter, found: %s",
-			vm.type_name(fd.args[1]).c_str());
-		return nullptr;
-	}
-
-	std::string fmt_str = STR(fd.args[1])->get();
-	std::string tmp;
+	std::string lit;
+	std::string expr;
 	bool prev_back_slash = false;
 	int brace_count	     = 0;
 
-	for(size_t i = 0; i < fmt_str.size(); ++i) {
-		if(fmt_str[i] == '{') {
+	for(auto &c : fmt_str) {
+		if(c == '{') {
 			if(prev_back_slash) {
-				fmt_str.erase(fmt_str.begin() + i - 1);
-				--i;
+				lit.back()	= '{';
 				prev_back_slash = false;
 				continue;
 			}
-			++brace_count;
-			if(brace_count > 1) {
-				goto capture;
-			}
-			fmt_str.erase(fmt_str.begin() + i--);
+			if(++brace_count > 1) expr += c;
 			continue;
 		}
-		if(fmt_str[i] == '}' && brace_count > 0) {
-			--brace_count;
-			if(brace_count > 0) {
-				goto capture;
+		if(c == '}' && brace_count > 0) {
+			if(--brace_count > 0) {
+				expr += c;
+				continue;
 			}
-			std::string res;
-			if(!eval(vm, tmp, res, fd.args[1]->src_id(), fd.args[1]->idx())) {
-				return nullptr;
+			if(!lit.empty()) {
+				prog.parts.emplace_back();
+				prog.parts.back().lit.swap(lit);
 			}
-			tmp.clear();
-			fmt_str.erase(fmt_str.begin() + i);
-			fmt_str.insert(fmt_str.begin() + i, res.begin(), res.end());
-			i += res.size();
-			--i;
+			prog.parts.emplace_back();
+			templ_part_t &part = prog.parts.back();
+			part.expr.reset(new bcode_t);
+			if(!compile_expr(vm, expr, *part.expr, src_id, idx)) return false;
+			part.expr_str.swap(expr);
 			continue;
 		}
-	capture:
 		if(brace_count > 0) {
-			tmp += fmt_str[i];
-			fmt_str.erase(fmt_str.begin() + i--);
+			expr += c;
 			continue;
 		}
-		prev_back_slash = fmt_str[i] == '\\';
+		prev_back_slash = c == '\\';
+		lit += c;
 	}
 	if(brace_count > 0) {
+		vm.fail(src_id, idx, "invalid template: mismatched braces found (brace count: %d)",
+			brace_count);
+		return false;
+	}
+	if(!lit.empty()) {
+		prog.parts.emplace_back();
+		prog.parts.back().lit.swap(lit);
+	}
+	return true;
+}
+
+var_base_t *templ(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_str_t>()) {
 		vm.fail(fd.args[1]->src_id(), fd.args[1]->idx(),
-			"invalid template: mismatched braces found (brace count: %d)", brace_count);
+			"expected a string for format string parameter, found: %s",
+			vm.type_name(fd.args[1]).c_str());
 		return nullptr;
 	}
 
-	return make<var_str_t>(fmt_str);
+	const size_t &src_id = fd.args[1]->src_id();
+	const size_t &idx    = fd.args[1]->idx();
+	templ_key_t key{STR(fd.args[1])->get(), vm.current_source_file()->path(), src_id, idx,
+			vm.exec_flags};
+
+	templ_cache_t *cache		   = templ_cache(vm);
+	std::shared_ptr<templ_prog_t> prog = cache->get(key);
+	if(!prog) {
+		prog = std::make_shared<templ_prog_t>();
+		if(!templ_compile(vm, key.fmt, *prog, src_id, idx)) return nullptr;
+		cache->add(key, prog);
+	}
+
+	std::string res;
+	for(auto &part : prog->parts) {
+		if(!part.expr) {
+			res += part.lit;
+			continue;
+		}
+		if(!eval(vm, *part.expr, part.expr_str, res, src_id, idx)) return nullptr;
+	}
+
+	var_str_t *res_var = make<var_str_t>("");
+	res_var->get().swap(res);
+	return res_var;
 }
 
 INIT_MODULE(fmt)
@@ -94,13 +211,10 @@ INIT_MODULE(fmt)
 	return true;
 }
 
-bool eval(vm_state_t &vm, const std::string &data, std::string &res, const size_t &src_id,
-	  const size_t &idx)
+static bool compile_expr(vm_state_t &vm, const std::string &data, bcode_t &bc,
+			 const size_t &src_id, const size_t &idx)
 {
-	srcfile_t *src	      = vm.current_source_file();
-	size_t begin_stack_sz = vm.vm_stack->size();
-	static size_t i	      = 0;
-	bcode_t bc;
+	srcfile_t *src = vm.current_source_file();
 	Errors err = vm.fmod_read_code_fn()(data, src->dir(), src->path(), bc, vm.exec_flags, false,
 					    true, 0, -1);
 	if(err != E_OK) {
@@ -112,7 +226,14 @@ bool eval(vm_state_t &vm, const std::string &data, std::string &res, const size_
 		b.src_id = src_id;
 		b.idx	 = idx;
 	}
-	int res_int = vm::exec(vm, &bc);
+	return true;
+}
+
+static bool eval(vm_state_t &vm, const bcode_t &bc, const std::string &data, std::string &res,
+		 const size_t &src_id, const size_t &idx)
+{
+	size_t begin_stack_sz = vm.vm_stack->size();
+	int res_int	      = vm::exec(vm, &bc);
 	if(res_int != E_OK) {
 		vm.fail(src_id, idx, "failed while evaluating expression '%s' in string at",
 			data.c_str());
@@ -128,7 +249,7 @@ bool eval(vm_state_t &vm, const std::string &data, std::string &res, const size_
 			" found less or equal\nwhile evaluating '%s' in string at",
 			data.c_str());
 	} else {
-		if(!vm.vm_stack->back()->to_str(vm, res, src_id, idx)) {
+		if(!vm.vm_stack->back()->append_str(vm, res, src_id, idx)) {
 			return false;
 		}
 		vm.vm_stack->pop();
@@ -243,6 +243,14 @@ var_base_t *fs_file_iterable_next(vm_state_t &vm, const fn_data_t &fd)
 	return res;
 }
 
+var_base_t *fs_file_iterable_next_fast(vm_state_t &vm, var_base_t *iterable, var_base_t *reuse,
+				       const size_t &src_id, const size_t &idx)
+{
+	var_base_t *res = nullptr;
+	if(!FILE_ITERABLE(iterable)->next(res)) return nullptr;
+	return res;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////// File Descriptor Functions //////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -372,6 +380,7 @@ INIT_MODULE(fs)
 	vm.add_native_typefn<var_file_t>("seek", fs_file_seek, 2, src_id, idx);
 
 	vm.add_native_typefn<var_file_iterable_t>("next", fs_file_iterable_next, 0, src_id, idx);
+	vm.set_iter_next_fn<var_file_iterable_t>(fs_file_iterable_next_fast);
 
 	// file descriptor
 	src->add_native_fn("open_native", fs_fd_open, 2);
@@ -28,26 +28,26 @@ int apply_colors(std::string &str);
 
 var_base_t *print(vm_state_t &vm, const fn_data_t &fd)
 {
+	std::string str;
 	for(size_t i = 1; i < fd.args.size(); ++i) {
-		std::string str;
-		if(!fd.args[i]->to_str(vm, str, fd.src_id, fd.idx)) {
+		if(!fd.args[i]->append_str(vm, str, fd.src_id, fd.idx)) {
 			return nullptr;
 		}
-		fprintf(stdout, "%s", str.c_str());
 	}
+	fwrite(str.data(), 1, str.size(), stdout);
 	return vm.nil;
 }
 
 var_base_t *println(vm_state_t &vm, const fn_data_t &fd)
 {
+	std::string str;
 	for(size_t i = 1; i < fd.args.size(); ++i) {
-		std::string str;
-		if(!fd.args[i]->to_str(vm, str, fd.src_id, fd.idx)) {
+		if(!fd.args[i]->append_str(vm, str, fd.src_id, fd.idx)) {
 			return nullptr;
 		}
-		fprintf(stdout, "%s", str.c_str());
 	}
-	fprintf(stdout, "\n");
+	str += '\n';
+	fwrite(str.data(), 1, str.size(), stdout);
 	return vm.nil;
 }
 
@@ -64,13 +64,13 @@ var_base_t *fprint(vm_state_t &vm, const fn_data_t &fd)
 			"file has probably been closed already", vm.type_name(fd.args[1]).c_str());
 		return nullptr;
 	}
+	std::string str;
 	for(size_t i = 2; i < fd.args.size(); ++i) {
-		std::string str;
-		if(!fd.args[i]->to_str(vm, str, fd.src_id, fd.idx)) {
+		if(!fd.args[i]->append_str(vm, str, fd.src_id, fd.idx)) {
 			return nullptr;
 		}
-		fprintf(FILE(fd.args[1])->get(), "%s", str.c_str());
 	}
+	fwrite(str.data(), 1, str.size(), FILE(fd.args[1])->get());
 	return vm.nil;
 }
 
@@ -87,14 +87,14 @@ var_base_t *fprintln(vm_state_t &vm, const fn_data_t &fd)
 			"file has probably been closed already", vm.type_name(fd.args[1]).c_str());
 		return nullptr;
 	}
+	std::string str;
 	for(size_t i = 2; i < fd.args.size(); ++i) {
-		std::string str;
-		if(!fd.args[i]->to_str(vm, str, fd.src_id, fd.idx)) {
+		if(!fd.args[i]->append_str(vm, str, fd.src_id, fd.idx)) {
 			return nullptr;
 		}
-		fprintf(FILE(fd.args[1])->get(), "%s", str.c_str());
 	}
-	fprintf(FILE(fd.args[1])->get(), "\n");
+	str += '\n';
+	fwrite(str.data(), 1, str.size(), FILE(fd.args[1])->get());
 	return vm.nil;
 }
 
@@ -18,44 +18,46 @@
 /////////////////////////////////////////// Functions ////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+// reads an optional bool named argument of map.new()
+static bool bool_assn_arg(vm_state_t &vm, const fn_data_t &fd, const std::string &name,
+			  bool &val)
+{
+	auto loc = fd.assn_args_loc.find(name);
+	if(loc == fd.assn_args_loc.end()) return true;
+	var_base_t *var = fd.assn_args[loc->second].val;
+	if(!var->istype<var_bool_t>()) {
+		vm.fail(fd.src_id, fd.idx,
+			"expected '%s' named argument to be of type bool for map.new(), found: %s",
+			name.c_str(), vm.type_name(var).c_str());
+		return false;
+	}
+	val = BOOL(var)->get();
+	return true;
+}
+
 var_base_t *map_new(vm_state_t &vm, const fn_data_t &fd)
 {
 	if((fd.args.size() - 1) % 2 != 0) {
 		vm.fail(fd.src_id, fd.idx, "argument count must be even to create a map");
 		return nullptr;
 	}
-	bool refs = false;
-	if(fd.assn_args_loc.find("refs") != fd.assn_args_loc.end()) {
-		var_base_t *refs_var = fd.assn_args[fd.assn_args_loc.at("refs")].val;
-		if(!refs_var->istype<var_bool_t>()) {
-			vm.fail(fd.src_id, fd.idx,
-				"expected 'refs' named argument to be of type bool for map.new(), "
-				"found: %s",
-				vm.type_name(refs_var).c_str());
-			return nullptr;
-		}
-		refs = BOOL(refs_var)->get();
+	bool refs = false, sorted = false;
+	if(!bool_assn_arg(vm, fd, "refs", refs) || !bool_assn_arg(vm, fd, "sorted", sorted)) {
+		return nullptr;
 	}
-	std::map<std::string, var_base_t *> map_val;
-	for(size_t i = 1; i < fd.args.size(); ++i) {
-		std::string key;
-		if(!fd.args[i]->to_str(vm, key, fd.src_id, fd.idx)) {
+	var_map_t *map = make<var_map_t>(refs, sorted);
+	for(size_t i = 1; i < fd.args.size(); i += 2) {
+		if(!map->insert(vm, fd.args[i], fd.args[i + 1], fd.src_id, fd.idx)) {
+			delete map;
 			return nullptr;
 		}
-		if(map_val.find(key) != map_val.end()) var_dref(map_val[key]);
-		if(refs) {
-			var_iref(fd.args[++i]);
-			map_val[key] = fd.args[i];
-		} else {
-			map_val[key] = fd.args[++i]->copy(fd.src_id, fd.idx);
-		}
 	}
-	return make<var_map_t>(map_val, refs);
+	return map;
 }
 
 var_base_t *map_len(vm_state_t &vm, const fn_data_t &fd)
 {
-	return make<var_int_t>(MAP(fd.args[0])->get().size());
+	return make<var_int_t>(MAP(fd.args[0])->size());
 }
 
 var_base_t *map_is_ref(vm_state_t &vm, const fn_data_t &fd)
@@ -63,71 +65,58 @@ var_base_t *map_is_ref(vm_state_t &vm, const fn_data_t &fd)
 	return MAP(fd.args[0])->is_ref_map() ? vm.tru : vm.fals;
 }
 
+var_base_t *map_is_sorted(vm_state_t &vm, const fn_data_t &fd)
+{
+	return MAP(fd.args[0])->is_sorted() ? vm.tru : vm.fals;
+}
+
 var_base_t *map_empty(vm_state_t &vm, const fn_data_t &fd)
 {
-	return MAP(fd.args[0])->get().empty() ? vm.tru : vm.fals;
+	return MAP(fd.args[0])->empty() ? vm.tru : vm.fals;
 }
 
 var_base_t *map_insert(vm_state_t &vm, const fn_data_t &fd)
 {
-	std::map<std::string, var_base_t *> &map = MAP(fd.args[0])->get();
-	std::string key;
-	if(!fd.args[1]->to_str(vm, key, fd.src_id, fd.idx)) {
+	if(!MAP(fd.args[0])->insert(vm, fd.args[1], fd.args[2], fd.src_id, fd.idx)) {
 		return nullptr;
 	}
-	if(map.find(key) != map.end()) {
-		var_dref(map[key]);
-	}
-	if(MAP(fd.args[0])->is_ref_map()) {
-		var_iref(fd.args[2]);
-		map[key] = fd.args[2];
-	} else {
-		map[key] = fd.args[2]->copy(fd.src_id, fd.idx);
-	}
 	return fd.args[0];
 }
 
 var_base_t *map_erase(vm_state_t &vm, const fn_data_t &fd)
 {
-	std::map<std::string, var_base_t *> &map = MAP(fd.args[0])->get();
-	std::string key;
-	if(!fd.args[1]->to_str(vm, key, fd.src_id, fd.idx)) {
+	if(!MAP(fd.args[0])->erase(vm, fd.args[1], fd.src_id, fd.idx)) {
 		return nullptr;
 	}
-	auto key_it = map.find(key);
-	if(key_it != map.end()) {
-		var_dref(key_it->second);
-		map.erase(key_it);
-	}
 	return fd.args[0];
 }
 
 var_base_t *map_get(vm_state_t &vm, const fn_data_t &fd)
 {
-	std::map<std::string, var_base_t *> &map = MAP(fd.args[0])->get();
-	std::string key;
-	if(!fd.args[1]->to_str(vm, key, fd.src_id, fd.idx)) {
+	var_base_t *val = nullptr;
+	if(!MAP(fd.args[0])->find(vm, fd.args[1], val, fd.src_id, fd.idx)) {
 		return nullptr;
 	}
-	if(map.find(key) == map.end()) {
-		return vm.nil;
-	}
-	return map[key];
+	return val ? val : vm.nil;
 }
 
 var_base_t *map_find(vm_state_t &vm, const fn_data_t &fd)
 {
-	std::map<std::string, var_base_t *> &map = MAP(fd.args[0])->get();
-	std::string key;
-	if(!fd.args[1]->to_str(vm, key, fd.src_id, fd.idx)) {
+	var_base_t *val = nullptr;
+	if(!MAP(fd.args[0])->find(vm, fd.args[1], val, fd.src_id, fd.idx)) {
 		return nullptr;
 	}
-	return map.find(key) != map.end() ? vm.tru : vm.fals;
+	return val ? vm.tru : vm.fals;
 }
 
 var_base_t *map_each(vm_state_t &vm, const fn_data_t &fd)
 {
-	return make<var_map_iterable_t>(MAP(fd.args[0]));
+	var_map_t *map = MAP(fd.args[0]);
+	std::vector<size_t> order;
+	if(map->is_sorted() && !map->order(vm, order, fd.src_id, fd.idx)) {
+		return nullptr;
+	}
+	return make<var_map_iterable_t>(map, order);
 }
 
 var_base_t *map_iterable_next(vm_state_t &vm, const fn_data_t &fd)
@@ -139,6 +128,14 @@ var_base_t *map_iterable_next(vm_state_t &vm, const fn_data_t &fd)
 	return res;
 }
 
+var_base_t *map_iterable_next_fast(vm_state_t &vm, var_base_t *iterable, var_base_t *reuse,
+				   const size_t &src_id, const size_t &idx)
+{
+	var_base_t *res = nullptr;
+	if(!MAP_ITERABLE(iterable)->next(res, src_id, idx)) return nullptr;
+	return res;
+}
+
 INIT_MODULE(map)
 {
 	var_src_t *src = vm.current_source();
@@ -147,6 +144,7 @@ INIT_MODULE(map)
 
 	vm.add_native_typefn<var_map_t>("len", map_len, 0, src_id, idx);
 	vm.add_native_typefn<var_map_t>("is_ref", map_is_ref, 0, src_id, idx);
+	vm.add_native_typefn<var_map_t>("is_sorted", map_is_sorted, 0, src_id, idx);
 	vm.add_native_typefn<var_map_t>("empty", map_empty, 0, src_id, idx);
 	vm.add_native_typefn<var_map_t>("insert", map_insert, 2, src_id, idx);
 	vm.add_native_typefn<var_map_t>("erase", map_erase, 1, src_id, idx);
@@ -156,6 +154,7 @@ INIT_MODULE(map)
 	vm.add_native_typefn<var_map_t>("each", map_each, 0, src_id, idx);
 
 	vm.add_native_typefn<var_map_iterable_t>("next", map_iterable_next, 0, src_id, idx);
+	vm.set_iter_next_fn<var_map_iterable_t>(map_iterable_next_fast);
 
 	return true;
 }
@@ -15,9 +15,10 @@
 
 #include "std/struct_type.hpp"
 
-var_map_iterable_t::var_map_iterable_t(var_map_t *map, const size_t &src_id, const size_t &idx)
+var_map_iterable_t::var_map_iterable_t(var_map_t *map, const std::vector<size_t> &order,
+				       const size_t &src_id, const size_t &idx)
 	: var_base_t(type_id<var_map_iterable_t>(), src_id, idx, false, false), m_map(map),
-	  m_curr(map->get().begin())
+	  m_order(order), m_curr(0)
 {
 	var_iref(m_map);
 }
@@ -28,24 +29,40 @@ var_map_iterable_t::~var_map_iterable_t()
 
 var_base_t *var_map_iterable_t::copy(const size_t &src_id, const size_t &idx)
 {
-	return new var_map_iterable_t(m_map, src_id, idx);
+	var_map_iterable_t *res = new var_map_iterable_t(m_map, m_order, src_id, idx);
+	res->m_curr		= m_curr;
+	return res;
 }
 void var_map_iterable_t::set(var_base_t *from)
 {
 	var_dref(m_map);
 	m_map = MAP_ITERABLE(from)->m_map;
 	var_iref(m_map);
-	m_curr = MAP_ITERABLE(from)->m_curr;
+	m_order = MAP_ITERABLE(from)->m_order;
+	m_curr	= MAP_ITERABLE(from)->m_curr;
 }
 
 bool var_map_iterable_t::next(var_base_t *&val, const size_t &src_id, const size_t &idx)
 {
-	if(m_curr == m_map->get().end()) return false;
+	const std::vector<map_entry_t> &entries = m_map->entries();
+	const map_entry_t *e			= nullptr;
+	// entries may be erased (or the map modified otherwise) while iterating
+	while(!e) {
+		if(m_map->is_sorted()) {
+			if(m_curr >= m_order.size()) return false;
+			if(m_order[m_curr] < entries.size()) e = &entries[m_order[m_curr]];
+		} else {
+			if(m_curr >= entries.size()) return false;
+			e = &entries[m_curr];
+		}
+		++m_curr;
+		if(e && !e->key) e = nullptr;
+	}
 	std::unordered_map<std::string, var_base_t *> attrs;
-	var_iref(m_curr->second);
-	attrs["0"] = new var_str_t(m_curr->first, src_id, idx);
-	attrs["1"] = m_curr->second;
+	var_iref(e->val);
+	// the key is copied as keys must not be modified while they are in the map
+	attrs["0"] = e->key->copy(src_id, idx);
+	attrs["1"] = e->val;
 	val	   = make<var_struct_t>(type_id<var_map_iterable_t>(), attrs, nullptr);
-	++m_curr;
 	return true;
-}
\ No newline at end of file
+}
@@ -11,12 +11,53 @@
 	furnished to do so.
 */
 
-#include <sys/wait.h>
+#include <atomic>
+#include <cstring>
+#include <thread>
 
+#include "std/bytebuffer_type.hpp"
 #include "std/multiproc_type.hpp"
 #include "VM/VM.hpp"
 
-int exec_command(const std::string &cmd);
+static std::atomic<size_t> proc_id(0);
+
+// the processes of a vec of multiproc handles
+static bool get_procs(vm_state_t &vm, const fn_data_t &fd, std::vector<proc_t *> &procs)
+{
+	if(!fd.args[1]->istype<var_vec_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected a vec of multiproc handles, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return false;
+	}
+	for(auto &h : VEC(fd.args[1])->get()) {
+		if(!h->istype<var_multiproc_t>()) {
+			vm.fail(fd.src_id, fd.idx, "expected a vec of multiproc handles, found: %s",
+				vm.type_name(h).c_str());
+			return false;
+		}
+		procs.push_back(MULTIPROC(h)->get());
+	}
+	return true;
+}
+
+static var_base_t *make_bytebuffer(const std::string &data)
+{
+	var_bytebuffer_t *bb = make<var_bytebuffer_t>(data.size());
+	if(!data.empty()) memcpy(bb->get_buf(), data.data(), data.size());
+	bb->set_len(data.size());
+	return bb;
+}
+
+static var_base_t *make_usecs(const struct timeval &tv)
+{
+	mpz_t tmp;
+	mpz_init_set_si(tmp, tv.tv_sec);
+	mpz_mul_ui(tmp, tmp, 1000000);
+	mpz_add_ui(tmp, tmp, tv.tv_usec);
+	var_int_t *res = make<var_int_t>(tmp);
+	mpz_clear(tmp);
+	return res;
+}
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////// Functions ////////////////////////////////////////////
@@ -27,7 +68,8 @@ var_base_t *multiproc_nproc(vm_state_t &vm, const fn_data_t &fd)
 	return make<var_int_t>(std::thread::hardware_concurrency());
 }
 
-var_base_t *multiproc_new(vm_state_t &vm, const fn_data_t &fd)
+// (command, capture) - output streams which are not captured are inherited
+var_base_t *multiproc_new_native(vm_state_t &vm, const fn_data_t &fd)
 {
 	if(!fd.args[1]->istype<var_str_t>()) {
 		vm.fail(fd.src_id, fd.idx,
@@ -35,30 +77,106 @@ var_base_t *multiproc_new(vm_state_t &vm, const fn_data_t &fd)
 			vm.type_name(fd.args[1]).c_str());
 		return nullptr;
 	}
-	std::packaged_task<int(std::string)> task(exec_command);
-	std::shared_future<int> *fut = new std::shared_future<int>(task.get_future());
-	return make<var_multiproc_t>(new std::thread(std::move(task), STR(fd.args[1])->get()), fut);
+	if(!fd.args[2]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for capture, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	std::shared_ptr<proc_t> proc(new proc_t(proc_id++));
+	int err = proc->spawn(STR(fd.args[1])->get(), mpz_get_si(INT(fd.args[2])->get()));
+	if(err != 0) {
+		vm.fail(fd.src_id, fd.idx, "failed to spawn command: '%s', error: %s",
+			STR(fd.args[1])->get().c_str(), strerror(err));
+		return nullptr;
+	}
+	return make<var_multiproc_t>(proc);
+}
+
+// blocks until one of the processes is done and returns its index in the vec
+var_base_t *multiproc_wait_any(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::vector<proc_t *> procs;
+	if(!get_procs(vm, fd, procs)) return nullptr;
+	if(procs.empty()) {
+		vm.fail(fd.src_id, fd.idx, "no processes to wait for");
+		return nullptr;
+	}
+	return make<var_int_t>(proc_t::wait(procs, false));
+}
+
+var_base_t *multiproc_wait_all(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::vector<proc_t *> procs;
+	if(!get_procs(vm, fd, procs)) return nullptr;
+	proc_t::wait(procs, true);
+	return vm.nil;
 }
 
 var_base_t *multiproc_get_id(vm_state_t &vm, const fn_data_t &fd)
 {
-	return make<var_int_t>(MULTIPROC(fd.args[0])->get_id());
+	return make<var_int_t>(MULTIPROC(fd.args[0])->get()->id());
+}
+
+var_base_t *multiproc_get_pid(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_int_t>(MULTIPROC(fd.args[0])->get()->pid());
 }
 
 var_base_t *multiproc_is_done(vm_state_t &vm, const fn_data_t &fd)
 {
-	std::shared_future<int> *&fut = MULTIPROC(fd.args[0])->get_future();
-	if(!fut->valid()) return vm.fals;
-	return fut->wait_for(std::chrono::seconds(0)) == std::future_status::ready ? vm.tru
-										   : vm.fals;
+	return MULTIPROC(fd.args[0])->get()->update() ? vm.tru : vm.fals;
 }
 
+// exit code, nil if the process is still running
 var_base_t *multiproc_get_res(vm_state_t &vm, const fn_data_t &fd)
 {
-	std::shared_future<int> *&fut = MULTIPROC(fd.args[0])->get_future();
-	if(!fut->valid() || fut->wait_for(std::chrono::seconds(0)) != std::future_status::ready)
-		return vm.nil;
-	return make<var_int_t>(fut->get());
+	proc_t *proc = MULTIPROC(fd.args[0])->get();
+	if(!proc->update()) return vm.nil;
+	return make<var_int_t>(proc->exit_code());
+}
+
+// blocks until the process is done and returns its exit code
+var_base_t *multiproc_wait(vm_state_t &vm, const fn_data_t &fd)
+{
+	proc_t *proc = MULTIPROC(fd.args[0])->get();
+	proc_t::wait({proc}, true);
+	return make<var_int_t>(proc->exit_code());
+}
+
+// captured output (so far, if the process is still running)
+var_base_t *multiproc_out(vm_state_t &vm, const fn_data_t &fd)
+{
+	proc_t *proc = MULTIPROC(fd.args[0])->get();
+	proc->update();
+	return make_bytebuffer(proc->out());
+}
+
+var_base_t *multiproc_err(vm_state_t &vm, const fn_data_t &fd)
+{
+	proc_t *proc = MULTIPROC(fd.args[0])->get();
+	proc->update();
+	return make_bytebuffer(proc->err());
+}
+
+// resource usage, all zero until the process is done
+// user_time and sys_time are in microseconds, max_rss in kilobytes (bytes on macOS)
+var_base_t *multiproc_user_time(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make_usecs(MULTIPROC(fd.args[0])->get()->usage().ru_utime);
+}
+
+var_base_t *multiproc_sys_time(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make_usecs(MULTIPROC(fd.args[0])->get()->usage().ru_stime);
+}
+
+var_base_t *multiproc_max_rss(vm_state_t &vm, const fn_data_t &fd)
+{
+	mpz_t tmp;
+	mpz_init_set_si(tmp, MULTIPROC(fd.args[0])->get()->usage().ru_maxrss);
+	var_int_t *res = make<var_int_t>(tmp);
+	mpz_clear(tmp);
+	return res;
 }
 
 INIT_MODULE(multiproc)
@@ -66,39 +184,24 @@ INIT_MODULE(multiproc)
 	var_src_t *src = vm.current_source();
 
 	src->add_native_fn("nproc", multiproc_nproc, 0);
-	src->add_native_fn("new", multiproc_new, 1);
+	src->add_native_fn("new_native", multiproc_new_native, 2);
+	src->add_native_fn("wait_any", multiproc_wait_any, 1);
+	src->add_native_fn("wait_all", multiproc_wait_all, 1);
+
+	vm.register_type<var_multiproc_t>("multiproc", src_id, idx);
 
 	vm.add_native_typefn<var_multiproc_t>("id", multiproc_get_id, 0, src_id, idx);
+	vm.add_native_typefn<var_multiproc_t>("pid", multiproc_get_pid, 0, src_id, idx);
 	vm.add_native_typefn<var_multiproc_t>("done", multiproc_is_done, 0, src_id, idx);
 	vm.add_native_typefn<var_multiproc_t>("res", multiproc_get_res, 0, src_id, idx);
+	vm.add_native_typefn<var_multiproc_t>("wait", multiproc_wait, 0, src_id, idx);
+	vm.add_native_typefn<var_multiproc_t>("out", multiproc_out, 0, src_id, idx);
+	vm.add_native_typefn<var_multiproc_t>("err", multiproc_err, 0, src_id, idx);
+	vm.add_native_typefn<var_multiproc_t>("user_time", multiproc_user_time, 0, src_id, idx);
+	vm.add_native_typefn<var_multiproc_t>("sys_time", multiproc_sys_time, 0, src_id, idx);
+	vm.add_native_typefn<var_multiproc_t>("max_rss", multiproc_max_rss, 0, src_id, idx);
+
+	src->add_native_var("CAPTURE_OUT", make_all<var_int_t>(CAPTURE_OUT, src_id, idx));
+	src->add_native_var("CAPTURE_ERR", make_all<var_int_t>(CAPTURE_ERR, src_id, idx));
 	return true;
 }
-
-// Required because popen() and pclose() are seemingly not threadsafe
-static std::mutex pipe_mtx;
-
-int exec_command(const std::string &cmd)
-{
-	FILE *pipe = NULL;
-	{
-		std::lock_guard<std::mutex> lock(pipe_mtx);
-		pipe = popen(cmd.c_str(), "r");
-	}
-	if(!pipe) return 1;
-	char *line = NULL;
-	size_t len = 0;
-	ssize_t nread;
-
-	while((nread = getline(&line, &len, pipe)) != -1) {
-		fprintf(stdout, "%s", line);
-	}
-
-	free(line);
-	int res = 0;
-	{
-		std::lock_guard<std::mutex> lock(pipe_mtx);
-		res = pclose(pipe);
-	}
-	int exit_code = WEXITSTATUS(res);
-	return WEXITSTATUS(res);
-}
\ No newline at end of file
@@ -13,39 +13,193 @@
 
 #include "std/multiproc_type.hpp"
 
-static size_t thread_id = 0;
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if __linux__
+#include <sys/syscall.h>
+#endif
 
-var_multiproc_t::var_multiproc_t(std::thread *thread, std::shared_future<int> *res,
-				 const size_t &src_id, const size_t &idx, const bool &owner)
-	: var_base_t(type_id<var_multiproc_t>(), src_id, idx, false, false), m_thread(thread),
-	  m_res(res), m_id(thread_id++), m_owner(owner)
-{}
-var_multiproc_t::var_multiproc_t(std::thread *thread, std::shared_future<int> *res,
-				 const size_t &id, const size_t &src_id, const size_t &idx,
-				 const bool &owner)
-	: var_base_t(type_id<var_multiproc_t>(), src_id, idx, false, false), m_thread(thread),
-	  m_res(res), m_id(id), m_owner(owner)
+extern char **environ;
+
+// how long to sleep between checks for processes which cannot be waited on with a pidfd
+#define PROC_POLL_MS 10
+
+// both ends are closed on exec - dup2() in the child clears that for the end it takes
+static bool make_pipe(int fds[2])
+{
+#if __linux__
+	return pipe2(fds, O_CLOEXEC) == 0;
+#else
+	if(pipe(fds) < 0) return false;
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	return true;
+#endif
+}
+
+static void close_fd(int &fd)
+{
+	if(fd < 0) return;
+	close(fd);
+	fd = -1;
+}
+
+int spawn_shell(const std::string &cmd, const int &out_fd, const int &err_fd, pid_t &pid)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if(out_fd >= 0) posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+	if(err_fd >= 0) posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+	char *argv[] = {(char *)"sh", (char *)"-c", (char *)cmd.c_str(), nullptr};
+	int res	     = posix_spawn(&pid, "/bin/sh", &actions, nullptr, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	return res;
+}
+
+int exit_code_of(const int &status)
+{
+	if(WIFEXITED(status)) return WEXITSTATUS(status);
+	if(WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+	return -1;
+}
+
+proc_t::proc_t(const size_t &id)
+	: m_id(id), m_pid(-1), m_pidfd(-1), m_out_fd(-1), m_err_fd(-1), m_done(false),
+	  m_exit_code(-1), m_usage()
 {}
-var_multiproc_t::~var_multiproc_t()
+proc_t::~proc_t()
+{
+	// like joining a thread, a process is not left behind as a zombie
+	if(m_pid > 0 && !m_done) wait({this}, true);
+	close_fd(m_out_fd);
+	close_fd(m_err_fd);
+	close_fd(m_pidfd);
+}
+
+int proc_t::spawn(const std::string &cmd, const int &capture)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	int out[2] = {-1, -1}, err[2] = {-1, -1};
+	if((capture & CAPTURE_OUT) && !make_pipe(out)) return errno;
+	if((capture & CAPTURE_ERR) && !make_pipe(err)) {
+		int res = errno;
+		close_fd(out[0]);
+		close_fd(out[1]);
+		return res;
+	}
+	int res = spawn_shell(cmd, out[1], err[1], m_pid);
+	close_fd(out[1]);
+	close_fd(err[1]);
+	if(res != 0) {
+		m_pid = -1;
+		close_fd(out[0]);
+		close_fd(err[0]);
+		return res;
+	}
+	m_out_fd = out[0];
+	m_err_fd = err[0];
+	if(m_out_fd >= 0) fcntl(m_out_fd, F_SETFL, fcntl(m_out_fd, F_GETFL) | O_NONBLOCK);
+	if(m_err_fd >= 0) fcntl(m_err_fd, F_SETFL, fcntl(m_err_fd, F_GETFL) | O_NONBLOCK);
+#if defined(__linux__) && defined(SYS_pidfd_open)
+	// fails on kernels older than 5.3, which fall back to checking periodically
+	m_pidfd = syscall(SYS_pidfd_open, m_pid, 0);
+#endif
+	return 0;
+}
+
+void proc_t::drain()
 {
-	if(m_owner) {
-		if(m_thread != nullptr) {
-			m_thread->join();
-			delete m_thread;
+	char buf[4096];
+	int *fds[]	   = {&m_out_fd, &m_err_fd};
+	std::string *dst[] = {&m_out, &m_err};
+	for(size_t i = 0; i < 2; ++i) {
+		int &fd = *fds[i];
+		while(fd >= 0) {
+			ssize_t len = read(fd, buf, sizeof(buf));
+			if(len > 0) {
+				dst[i]->append(buf, len);
+				continue;
+			}
+			if(len < 0 && errno == EINTR) continue;
+			if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+			close_fd(fd);
 		}
-		if(m_res != nullptr) delete m_res;
 	}
 }
 
+bool proc_t::update()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return update_locked();
+}
+
+bool proc_t::update_locked()
+{
+	if(m_done) return true;
+	if(m_pid <= 0) {
+		// never started - wait4() must not be given a pid which means any child
+		m_done = true;
+		return true;
+	}
+	drain();
+	int status = 0;
+	pid_t res;
+	do {
+		res = wait4(m_pid, &status, WNOHANG, &m_usage);
+	} while(res < 0 && errno == EINTR);
+	if(res == 0) return false;
+	m_done = true;
+	m_exit_code = res < 0 ? -1 : exit_code_of(status); // -1 if reaped by someone else
+	// what was written before exiting is still in the pipes, but the pipes are not waited on
+	// any further as a background child of the command may hold them open
+	drain();
+	close_fd(m_out_fd);
+	close_fd(m_err_fd);
+	return true;
+}
+
+size_t proc_t::wait(const std::vector<proc_t *> &procs, const bool &all)
+{
+	std::vector<struct pollfd> fds;
+	while(true) {
+		size_t done_idx = procs.size();
+		bool all_done	= true;
+		bool no_pidfd	= false;
+		fds.clear();
+		for(size_t i = 0; i < procs.size(); ++i) {
+			proc_t *p = procs[i];
+			// the lock is not held while polling - another thread may close the pipes
+			// meanwhile, which only wakes poll() early, and the pidfd stays open
+			std::lock_guard<std::mutex> lock(p->m_mtx);
+			if(p->update_locked()) {
+				if(done_idx == procs.size()) done_idx = i;
+				continue;
+			}
+			all_done = false;
+			if(p->m_pidfd >= 0) fds.push_back({p->m_pidfd, POLLIN, 0});
+			else no_pidfd = true;
+			if(p->m_out_fd >= 0) fds.push_back({p->m_out_fd, POLLIN, 0});
+			if(p->m_err_fd >= 0) fds.push_back({p->m_err_fd, POLLIN, 0});
+		}
+		if(all ? all_done : done_idx < procs.size()) return done_idx;
+		poll(fds.data(), fds.size(), no_pidfd ? PROC_POLL_MS : -1);
+	}
+}
+
+var_multiproc_t::var_multiproc_t(std::shared_ptr<proc_t> proc, const size_t &src_id,
+				 const size_t &idx)
+	: var_base_t(type_id<var_multiproc_t>(), src_id, idx, false, false), m_proc(proc)
+{}
+
 var_base_t *var_multiproc_t::copy(const size_t &src_id, const size_t &idx)
 {
-	return new var_multiproc_t(m_thread, m_res, m_id, src_id, idx, false);
+	return new var_multiproc_t(m_proc, src_id, idx);
 }
 void var_multiproc_t::set(var_base_t *from)
 {
-	var_multiproc_t *t = MULTIPROC(from);
-	m_owner		   = false;
-	m_thread	   = t->m_thread;
-	m_res		   = t->m_res;
-	m_id		   = t->m_id;
-}
\ No newline at end of file
+	m_proc = MULTIPROC(from)->m_proc;
+}
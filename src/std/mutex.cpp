@@ -16,6 +16,30 @@
 
 int exec_command(const std::string &cmd);
 
+// optional timeout argument (milliseconds) for the try_* functions, 0 (don't wait) if not given
+static bool get_timeout(vm_state_t &vm, const fn_data_t &fd, const size_t &pos,
+			long long &timeout)
+{
+	timeout = 0;
+	if(fd.args.size() <= pos) return true;
+	if(!fd.args[pos]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected timeout to be an int, found: %s",
+			vm.type_name(fd.args[pos]).c_str());
+		return false;
+	}
+	if(!mpz_fits_slong_p(INT(fd.args[pos])->get())) {
+		vm.fail(fd.src_id, fd.idx, "timeout is too large");
+		return false;
+	}
+	timeout = mpz_get_si(INT(fd.args[pos])->get());
+	return true;
+}
+
+static var_base_t *make_guard(var_base_t *lock, const LockKind &kind)
+{
+	return make<var_lock_guard_t>(std::shared_ptr<lock_guard_t>(new lock_guard_t(lock, kind)));
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////// Functions ////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -37,13 +61,163 @@ var_base_t *mutex_unlock(vm_state_t &vm, const fn_data_t &fd)
 	return vm.nil;
 }
 
+// ([timeout]) -> true if the lock was taken
+var_base_t *mutex_try_lock(vm_state_t &vm, const fn_data_t &fd)
+{
+	long long timeout;
+	if(!get_timeout(vm, fd, 1, timeout)) return nullptr;
+	std::timed_mutex &mtx = MUTEX(fd.args[0])->get();
+	bool locked =
+	timeout <= 0 ? mtx.try_lock() : mtx.try_lock_for(std::chrono::milliseconds(timeout));
+	return locked ? vm.tru : vm.fals;
+}
+
+// locks the mutex and returns a guard which unlocks it at the end of the scope
+var_base_t *mutex_guard(vm_state_t &vm, const fn_data_t &fd)
+{
+	MUTEX(fd.args[0])->get().lock();
+	return make_guard(fd.args[0], LOCK_MUTEX);
+}
+
+var_base_t *cond_new(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_cond_t>(
+	std::shared_ptr<std::condition_variable_any>(new std::condition_variable_any()));
+}
+
+// the mutex must be locked by the caller - it is unlocked while waiting and locked again before
+// returning; wake ups may be spurious, so the awaited condition must be checked again
+var_base_t *cond_wait(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_mutex_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected a mutex to wait with, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	COND(fd.args[0])->get().wait(MUTEX(fd.args[1])->get());
+	return vm.nil;
+}
+
+// (mutex, timeout) -> false if the wait timed out
+var_base_t *cond_wait_for(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_mutex_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected a mutex to wait with, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	long long timeout;
+	if(!get_timeout(vm, fd, 2, timeout)) return nullptr;
+	std::cv_status status = COND(fd.args[0])->get().wait_for(
+	MUTEX(fd.args[1])->get(), std::chrono::milliseconds(timeout < 0 ? 0 : timeout));
+	return status == std::cv_status::no_timeout ? vm.tru : vm.fals;
+}
+
+var_base_t *cond_notify_one(vm_state_t &vm, const fn_data_t &fd)
+{
+	COND(fd.args[0])->get().notify_one();
+	return vm.nil;
+}
+
+var_base_t *cond_notify_all(vm_state_t &vm, const fn_data_t &fd)
+{
+	COND(fd.args[0])->get().notify_all();
+	return vm.nil;
+}
+
+var_base_t *rwlock_new(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_rwlock_t>(std::shared_ptr<rwlock_t>(new rwlock_t()));
+}
+
+var_base_t *rwlock_rlock(vm_state_t &vm, const fn_data_t &fd)
+{
+	RWLOCK(fd.args[0])->get().rlock(-1);
+	return vm.nil;
+}
+
+var_base_t *rwlock_runlock(vm_state_t &vm, const fn_data_t &fd)
+{
+	RWLOCK(fd.args[0])->get().runlock();
+	return vm.nil;
+}
+
+var_base_t *rwlock_wlock(vm_state_t &vm, const fn_data_t &fd)
+{
+	RWLOCK(fd.args[0])->get().wlock(-1);
+	return vm.nil;
+}
+
+var_base_t *rwlock_wunlock(vm_state_t &vm, const fn_data_t &fd)
+{
+	RWLOCK(fd.args[0])->get().wunlock();
+	return vm.nil;
+}
+
+var_base_t *rwlock_try_rlock(vm_state_t &vm, const fn_data_t &fd)
+{
+	long long timeout;
+	if(!get_timeout(vm, fd, 1, timeout)) return nullptr;
+	return RWLOCK(fd.args[0])->get().rlock(timeout < 0 ? 0 : timeout) ? vm.tru : vm.fals;
+}
+
+var_base_t *rwlock_try_wlock(vm_state_t &vm, const fn_data_t &fd)
+{
+	long long timeout;
+	if(!get_timeout(vm, fd, 1, timeout)) return nullptr;
+	return RWLOCK(fd.args[0])->get().wlock(timeout < 0 ? 0 : timeout) ? vm.tru : vm.fals;
+}
+
+var_base_t *rwlock_rguard(vm_state_t &vm, const fn_data_t &fd)
+{
+	RWLOCK(fd.args[0])->get().rlock(-1);
+	return make_guard(fd.args[0], LOCK_READ);
+}
+
+var_base_t *rwlock_wguard(vm_state_t &vm, const fn_data_t &fd)
+{
+	RWLOCK(fd.args[0])->get().wlock(-1);
+	return make_guard(fd.args[0], LOCK_WRITE);
+}
+
+// releases the lock before the guard goes away, does nothing if it already has been released
+var_base_t *lock_guard_unlock(vm_state_t &vm, const fn_data_t &fd)
+{
+	LOCK_GUARD(fd.args[0])->get().unlock();
+	return vm.nil;
+}
+
 INIT_MODULE(mutex)
 {
 	var_src_t *src = vm.current_source();
 
 	src->add_native_fn("new", mutex_new, 0);
+	src->add_native_fn("cond", cond_new, 0);
+	src->add_native_fn("rwlock", rwlock_new, 0);
 
+	vm.register_type<var_mutex_t>("mutex", src_id, idx);
 	vm.add_native_typefn<var_mutex_t>("lock", mutex_lock, 0, src_id, idx);
 	vm.add_native_typefn<var_mutex_t>("unlock", mutex_unlock, 0, src_id, idx);
+	vm.add_native_typefn<var_mutex_t>("try_lock", mutex_try_lock, 0, src_id, idx, true);
+	vm.add_native_typefn<var_mutex_t>("guard", mutex_guard, 0, src_id, idx);
+
+	vm.register_type<var_cond_t>("cond", src_id, idx);
+	vm.add_native_typefn<var_cond_t>("wait", cond_wait, 1, src_id, idx);
+	vm.add_native_typefn<var_cond_t>("wait_for", cond_wait_for, 2, src_id, idx);
+	vm.add_native_typefn<var_cond_t>("notify_one", cond_notify_one, 0, src_id, idx);
+	vm.add_native_typefn<var_cond_t>("notify_all", cond_notify_all, 0, src_id, idx);
+
+	vm.register_type<var_rwlock_t>("rwlock", src_id, idx);
+	vm.add_native_typefn<var_rwlock_t>("rlock", rwlock_rlock, 0, src_id, idx);
+	vm.add_native_typefn<var_rwlock_t>("runlock", rwlock_runlock, 0, src_id, idx);
+	vm.add_native_typefn<var_rwlock_t>("wlock", rwlock_wlock, 0, src_id, idx);
+	vm.add_native_typefn<var_rwlock_t>("wunlock", rwlock_wunlock, 0, src_id, idx);
+	vm.add_native_typefn<var_rwlock_t>("try_rlock", rwlock_try_rlock, 0, src_id, idx, true);
+	vm.add_native_typefn<var_rwlock_t>("try_wlock", rwlock_try_wlock, 0, src_id, idx, true);
+	vm.add_native_typefn<var_rwlock_t>("rguard", rwlock_rguard, 0, src_id, idx);
+	vm.add_native_typefn<var_rwlock_t>("wguard", rwlock_wguard, 0, src_id, idx);
+
+	vm.register_type<var_lock_guard_t>("lock_guard", src_id, idx);
+	vm.add_native_typefn<var_lock_guard_t>("unlock", lock_guard_unlock, 0, src_id, idx);
 	return true;
 }
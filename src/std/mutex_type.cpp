@@ -13,6 +13,8 @@
 
 #include "std/mutex_type.hpp"
 
+#include <chrono>
+
 var_mutex_t::var_mutex_t(const size_t &src_id, const size_t &idx)
 	: var_base_t(type_id<var_mutex_t>(), src_id, idx, false, false)
 {}
@@ -24,4 +26,117 @@ var_base_t *var_mutex_t::copy(const size_t &src_id, const size_t &idx)
 void var_mutex_t::set(var_base_t *from)
 {
 	// nothing to reassign in a mutex
-}
\ No newline at end of file
+}
+var_cond_t::var_cond_t(std::shared_ptr<std::condition_variable_any> cv, const size_t &src_id,
+		       const size_t &idx)
+	: var_base_t(type_id<var_cond_t>(), src_id, idx, false, false), m_cv(cv)
+{}
+
+var_base_t *var_cond_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_cond_t(m_cv, src_id, idx);
+}
+void var_cond_t::set(var_base_t *from)
+{
+	m_cv = COND(from)->m_cv;
+}
+
+rwlock_t::rwlock_t() : m_readers(0), m_writers_waiting(0), m_writer(false) {}
+
+bool rwlock_t::rlock(const long long &timeout)
+{
+	std::unique_lock<std::mutex> lock(m_mtx);
+	auto can_read = [this]() { return !m_writer && m_writers_waiting == 0; };
+	if(timeout < 0) {
+		m_readers_cv.wait(lock, can_read);
+	} else if(!m_readers_cv.wait_for(lock, std::chrono::milliseconds(timeout), can_read)) {
+		return false;
+	}
+	++m_readers;
+	return true;
+}
+
+void rwlock_t::runlock()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if(--m_readers == 0 && m_writers_waiting > 0) m_writers_cv.notify_one();
+}
+
+bool rwlock_t::wlock(const long long &timeout)
+{
+	std::unique_lock<std::mutex> lock(m_mtx);
+	auto can_write = [this]() { return !m_writer && m_readers == 0; };
+	++m_writers_waiting;
+	bool ok = true;
+	if(timeout < 0) {
+		m_writers_cv.wait(lock, can_write);
+	} else {
+		ok = m_writers_cv.wait_for(lock, std::chrono::milliseconds(timeout), can_write);
+	}
+	--m_writers_waiting;
+	if(ok) {
+		m_writer = true;
+	} else if(m_writers_waiting == 0 && !m_writer) {
+		// the readers held back for this writer can go ahead
+		m_readers_cv.notify_all();
+	}
+	return ok;
+}
+
+void rwlock_t::wunlock()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_writer = false;
+	if(m_writers_waiting > 0) m_writers_cv.notify_one();
+	else m_readers_cv.notify_all();
+}
+
+var_rwlock_t::var_rwlock_t(std::shared_ptr<rwlock_t> lock, const size_t &src_id,
+			   const size_t &idx)
+	: var_base_t(type_id<var_rwlock_t>(), src_id, idx, false, false), m_lock(lock)
+{}
+
+var_base_t *var_rwlock_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_rwlock_t(m_lock, src_id, idx);
+}
+void var_rwlock_t::set(var_base_t *from)
+{
+	m_lock = RWLOCK(from)->m_lock;
+}
+
+lock_guard_t::lock_guard_t(var_base_t *lock, const LockKind &kind)
+	: m_lock(lock), m_kind(kind), m_held(true)
+{
+	var_iref(m_lock);
+}
+lock_guard_t::~lock_guard_t()
+{
+	unlock();
+	var_dref(m_lock);
+}
+
+void lock_guard_t::unlock()
+{
+	if(!m_held) return;
+	m_held = false;
+	switch(m_kind) {
+	case LOCK_MUTEX: MUTEX(m_lock)->get().unlock(); break;
+	case LOCK_READ: RWLOCK(m_lock)->get().runlock(); break;
+	case LOCK_WRITE: RWLOCK(m_lock)->get().wunlock(); break;
+	}
+}
+
+var_lock_guard_t::var_lock_guard_t(std::shared_ptr<lock_guard_t> guard, const size_t &src_id,
+				   const size_t &idx)
+	: var_base_t(type_id<var_lock_guard_t>(), src_id, idx, false, false), m_guard(guard)
+{}
+
+var_base_t *var_lock_guard_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_lock_guard_t(m_guard, src_id, idx);
+}
+void var_lock_guard_t::set(var_base_t *from)
+{
+	m_guard = LOCK_GUARD(from)->m_guard;
+}
@@ -13,6 +13,7 @@
 
 #include <algorithm>
 
+#include "std/str_type.hpp"
 #include "VM/VM.hpp"
 
 std::vector<var_base_t *> _str_split(const std::string &data, const char delim,
@@ -385,6 +386,117 @@ var_base_t *chr(vm_state_t &vm, const fn_data_t &fd)
 	return make<var_str_t>(std::string(1, (unsigned char)mpz_get_si(INT(fd.args[0])->get())));
 }
 
+// capacity of a builder from fd.args[1], false if it is not a size a string can have
+static bool get_capacity(vm_state_t &vm, const fn_data_t &fd, size_t &cap)
+{
+	if(!fd.args[1]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected int argument for builder capacity, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return false;
+	}
+	mpz_t &v = INT(fd.args[1])->get();
+	if(mpz_sgn(v) < 0 || !mpz_fits_ulong_p(v) || mpz_get_ui(v) > std::string().max_size()) {
+		vm.fail(fd.src_id, fd.idx, "builder capacity must be a non negative int in range");
+		return false;
+	}
+	cap = mpz_get_ui(v);
+	return true;
+}
+
+var_base_t *builder_native(vm_state_t &vm, const fn_data_t &fd)
+{
+	size_t cap;
+	if(!get_capacity(vm, fd, cap)) return nullptr;
+	return make<var_str_builder_t>(cap);
+}
+
+// appends the string form of each argument
+var_base_t *builder_append(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::string &buf = STR_BUILDER(fd.args[0])->get();
+	for(size_t i = 1; i < fd.args.size(); ++i) {
+		if(!fd.args[i]->append_str(vm, buf, fd.src_id, fd.idx)) return nullptr;
+	}
+	return fd.args[0];
+}
+
+var_base_t *builder_append_line(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!builder_append(vm, fd)) return nullptr;
+	STR_BUILDER(fd.args[0])->get() += '\n';
+	return fd.args[0];
+}
+
+// appends the format string with each {} replaced by the next argument, \{ is a literal brace
+var_base_t *builder_append_fmt(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_str_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected a string for format string parameter, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	std::string &buf	   = STR_BUILDER(fd.args[0])->get();
+	const std::string &fmt_str = STR(fd.args[1])->get();
+	size_t arg		   = 2;
+	for(size_t i = 0; i < fmt_str.size(); ++i) {
+		if(fmt_str[i] == '\\' && i + 1 < fmt_str.size() && fmt_str[i + 1] == '{') {
+			buf += '{';
+			++i;
+			continue;
+		}
+		if(fmt_str[i] != '{' || i + 1 >= fmt_str.size() || fmt_str[i + 1] != '}') {
+			buf += fmt_str[i];
+			continue;
+		}
+		if(arg >= fd.args.size()) {
+			vm.fail(fd.src_id, fd.idx, "too few arguments for format string, found: %zu",
+				fd.args.size() - 2);
+			return nullptr;
+		}
+		if(!fd.args[arg++]->append_str(vm, buf, fd.src_id, fd.idx)) return nullptr;
+		++i;
+	}
+	if(arg < fd.args.size()) {
+		vm.fail(fd.src_id, fd.idx, "too many arguments for format string, used: %zu of %zu",
+			arg - 2, fd.args.size() - 2);
+		return nullptr;
+	}
+	return fd.args[0];
+}
+
+var_base_t *builder_reserve(vm_state_t &vm, const fn_data_t &fd)
+{
+	size_t cap;
+	if(!get_capacity(vm, fd, cap)) return nullptr;
+	STR_BUILDER(fd.args[0])->get().reserve(cap);
+	return fd.args[0];
+}
+
+var_base_t *builder_len(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_int_t>(STR_BUILDER(fd.args[0])->get().size());
+}
+
+var_base_t *builder_clear(vm_state_t &vm, const fn_data_t &fd)
+{
+	STR_BUILDER(fd.args[0])->get().clear();
+	return fd.args[0];
+}
+
+// copy of the built string, the builder is left as is
+var_base_t *builder_to_str(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_str_t>(STR_BUILDER(fd.args[0])->get());
+}
+
+// moves the built string out without copying it - the builder is empty afterwards
+var_base_t *builder_take(vm_state_t &vm, const fn_data_t &fd)
+{
+	var_str_t *res = make<var_str_t>("");
+	res->get().swap(STR_BUILDER(fd.args[0])->get());
+	return res;
+}
+
 INIT_MODULE(str)
 {
 	var_src_t *src = vm.current_source();
@@ -416,6 +528,21 @@ INIT_MODULE(str)
 	vm.add_native_typefn<var_str_t>("byt", byt, 0, src_id, idx);
 	vm.add_native_typefn<var_int_t>("chr", chr, 0, src_id, idx);
 
+	src->add_native_fn("builder_native", builder_native, 1);
+
+	vm.register_type<var_str_builder_t>("str_builder", src_id, idx);
+
+	vm.add_native_typefn<var_str_builder_t>("append", builder_append, 0, src_id, idx, true);
+	vm.add_native_typefn<var_str_builder_t>("append_line", builder_append_line, 0, src_id, idx,
+						true);
+	vm.add_native_typefn<var_str_builder_t>("append_fmt", builder_append_fmt, 1, src_id, idx,
+						true);
+	vm.add_native_typefn<var_str_builder_t>("reserve", builder_reserve, 1, src_id, idx);
+	vm.add_native_typefn<var_str_builder_t>("len", builder_len, 0, src_id, idx);
+	vm.add_native_typefn<var_str_builder_t>("clear", builder_clear, 0, src_id, idx);
+	vm.add_native_typefn<var_str_builder_t>("str", builder_to_str, 0, src_id, idx);
+	vm.add_native_typefn<var_str_builder_t>("take", builder_take, 0, src_id, idx);
+
 	return true;
 }
 
@@ -0,0 +1,32 @@
+/*
+	MIT License
+
+	Copyright (c) 2020 Feral Language repositories
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so.
+*/
+
+#include "std/str_type.hpp"
+
+var_str_builder_t::var_str_builder_t(const size_t &cap, const size_t &src_id, const size_t &idx)
+	: var_base_t(type_id<var_str_builder_t>(), src_id, idx, false, false)
+{
+	m_buf.reserve(cap);
+}
+
+var_base_t *var_str_builder_t::copy(const size_t &src_id, const size_t &idx)
+{
+	var_str_builder_t *res = new var_str_builder_t(0, src_id, idx);
+	res->set(this);
+	return res;
+}
+
+void var_str_builder_t::set(var_base_t *from)
+{
+	m_buf = STR_BUILDER(from)->m_buf;
+}
@@ -78,4 +78,281 @@ void var_thread_t::set(var_base_t *from)
 void var_thread_t::init_id()
 {
 	m_id = thread_id++;
-}
\ No newline at end of file
+}
+pool_snap_t::pool_snap_t(vm_state_t *vm, const size_t &seq) : vm(vm), seq(seq), users(0) {}
+pool_snap_t::~pool_snap_t()
+{
+	delete vm;
+}
+
+pool_task_t::pool_task_t(var_base_t *fn, const std::vector<var_base_t *> &args,
+			 const size_t &argc, const size_t &src_id, const size_t &idx, const bool &fold)
+	: fn(fn), args(args), argc(argc),
+	  calls(fold ? args.size() - 1 : (argc > 0 ? args.size() / argc : 1)), fold(fold),
+	  src_id(src_id), idx(idx), snap(nullptr), done(false), err(nullptr)
+{}
+pool_task_t::~pool_task_t()
+{
+	for(auto &r : res) var_dref(r);
+	if(err) var_dref(err);
+	for(auto &a : args) var_dref(a);
+	var_dref(fn);
+}
+
+bool pool_task_t::run(vm_state_t &vm)
+{
+	std::vector<var_base_t *> fnargs(fold ? 3 : argc + 1, nullptr); // [0] is 'self'
+	std::vector<var_base_t *> fnres;
+	var_base_t *fnerr = nullptr;
+	var_base_t *acc	  = nullptr;
+	size_t fails	  = vm.fails.size();
+	if(fold) {
+		acc = args[0];
+		var_iref(acc);
+	}
+	vm.fails.blka();
+	vm.fails.set_named();
+	for(size_t i = 0; i < calls; ++i) {
+		if(fold) {
+			fnargs[1] = acc;
+			fnargs[2] = args[i + 1];
+		} else {
+			for(size_t j = 0; j < argc; ++j) fnargs[j + 1] = args[i * argc + j];
+		}
+		var_base_t *r = var_call(vm, fn, fnargs, src_id, idx);
+		if(r == nullptr) {
+			// discard any 'or' blocks left behind by the failed function
+			while(vm.fails.size() > fails + 1) vm.fails.blkr();
+			fnerr = vm.fails.pop(false);
+			if(fnerr == nullptr) fnerr = new var_str_t("pool function failed", src_id, idx);
+			break;
+		}
+		if(fold) {
+			var_dref(acc);
+			acc = r;
+		} else {
+			fnres.push_back(r);
+		}
+	}
+	vm.fails.blkr();
+	if(acc) {
+		if(fnerr) var_dref(acc);
+		else fnres.push_back(acc);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		res  = std::move(fnres);
+		err  = fnerr;
+		done = true;
+	}
+	cv.notify_all();
+	return fnerr == nullptr;
+}
+
+void pool_task_t::wait()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	cv.wait(lock, [this]() { return done; });
+}
+
+bool pool_task_t::is_done()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return done;
+}
+
+static thread_local pool_t *worker_pool = nullptr;
+static thread_local size_t worker_id	 = 0;
+
+pool_t::pool_t(const size_t &count)
+	: m_pending(0), m_next(0), m_stop(false), m_snap_from(nullptr), m_snap_gen(0),
+	  m_snap_seq(0)
+{
+	for(size_t i = 0; i < count; ++i) {
+		m_workers.push_back(new worker_t);
+		m_workers.back()->vm  = nullptr;
+		m_workers.back()->seq = 0;
+	}
+	for(size_t i = 0; i < count; ++i) {
+		m_workers[i]->thread = std::thread(&pool_t::work, this, i);
+	}
+}
+pool_t::~pool_t()
+{
+	shutdown();
+	for(auto &w : m_workers) delete w;
+}
+
+bool pool_t::submit(vm_state_t &vm, std::shared_ptr<pool_task_t> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_snap_mtx);
+		size_t gen = vm.mod_gen();
+		if(m_snaps.empty() || m_snap_from != &vm || m_snap_gen != gen) {
+			m_snaps.push_back(
+			new pool_snap_t(vm.thread_copy(task->src_id, task->idx), ++m_snap_seq));
+			m_snap_from = &vm;
+			m_snap_gen  = gen;
+		}
+		collect();
+		task->snap = m_snaps.back();
+		++task->snap->users;
+	}
+	{
+		// the task is pushed before m_pending counts it, so a worker woken for it always
+		// finds it - holding m_sleep_mtx meanwhile keeps shutdown() and the sleeping workers
+		// from seeing the count before it is updated (take() may already have decremented it)
+		std::lock_guard<std::mutex> lock(m_sleep_mtx);
+		if(m_stop) {
+			--task->snap->users;
+			task->snap = nullptr;
+			return false;
+		}
+		worker_t *w = m_workers[m_next++ % m_workers.size()];
+		{
+			std::lock_guard<std::mutex> lock(w->mtx);
+			w->tasks.push_back(task);
+		}
+		++m_pending;
+	}
+	m_sleep_cv.notify_one();
+	return true;
+}
+
+void pool_t::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mtx);
+		if(m_stop) return;
+		m_stop = true;
+	}
+	m_sleep_cv.notify_all();
+	for(auto &w : m_workers) w->thread.join();
+	std::lock_guard<std::mutex> lock(m_snap_mtx);
+	for(auto &w : m_workers) {
+		if(w->vm) m_retired.push_back(w->vm);
+		w->vm = nullptr;
+	}
+	for(auto &vm : m_retired) delete vm;
+	m_retired.clear();
+	for(auto &snap : m_snaps) delete snap;
+	m_snaps.clear();
+}
+
+bool pool_t::in_worker() const
+{
+	return worker_pool == this;
+}
+
+void pool_t::run_until(vm_state_t &vm, pool_task_t *task)
+{
+	while(!task->is_done()) {
+		std::shared_ptr<pool_task_t> next = take(worker_id);
+		if(!next) {
+			// task has been taken by another worker
+			task->wait();
+			return;
+		}
+		// like the tasks pool_run() runs in a worker, it runs on the vm of this one
+		--next->snap->users;
+		next->snap = nullptr;
+		next->run(vm);
+	}
+}
+
+std::shared_ptr<pool_task_t> pool_t::take(const size_t &id)
+{
+	std::shared_ptr<pool_task_t> task;
+	size_t count = m_workers.size();
+	for(size_t i = 0; i < count && !task; ++i) {
+		worker_t *w = m_workers[(id + i) % count];
+		std::lock_guard<std::mutex> lock(w->mtx);
+		if(w->tasks.empty()) continue;
+		if(i == 0) {
+			task = w->tasks.back();
+			w->tasks.pop_back();
+		} else {
+			task = w->tasks.front();
+			w->tasks.pop_front();
+		}
+	}
+	if(task) --m_pending;
+	return task;
+}
+
+void pool_t::retire(vm_state_t *vm)
+{
+	std::lock_guard<std::mutex> lock(m_snap_mtx);
+	m_retired.push_back(vm);
+}
+
+void pool_t::collect()
+{
+	for(auto &vm : m_retired) delete vm;
+	m_retired.clear();
+	// only the current snapshot can gain users
+	for(size_t i = 0; i + 1 < m_snaps.size();) {
+		if(m_snaps[i]->users > 0) {
+			++i;
+			continue;
+		}
+		delete m_snaps[i];
+		m_snaps.erase(m_snaps.begin() + i);
+	}
+}
+
+void pool_t::work(const size_t id)
+{
+	worker_pool = this;
+	worker_id   = id;
+	worker_t *w = m_workers[id];
+	while(true) {
+		std::shared_ptr<pool_task_t> task = take(id);
+		if(!task) {
+			std::unique_lock<std::mutex> lock(m_sleep_mtx);
+			if(m_stop && m_pending == 0) break;
+			m_sleep_cv.wait(lock, [this]() { return m_pending > 0 || m_stop; });
+			continue;
+		}
+		// an older snapshot never has anything that a newer one does not
+		if(!w->vm || task->snap->seq > w->seq) {
+			if(w->vm) retire(w->vm);
+			w->vm  = task->snap->vm->thread_copy(task->src_id, task->idx);
+			w->seq = task->snap->seq;
+		}
+		--task->snap->users;
+		task->snap = nullptr;
+		// the vm may be in any state after a failure, start afresh for the next task
+		if(!task->run(*w->vm)) {
+			retire(w->vm);
+			w->vm = nullptr;
+		}
+	}
+}
+
+var_pool_t::var_pool_t(std::shared_ptr<pool_t> pool, const size_t &src_id, const size_t &idx)
+	: var_base_t(type_id<var_pool_t>(), src_id, idx, false, false), m_pool(pool)
+{}
+
+var_base_t *var_pool_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_pool_t(m_pool, src_id, idx);
+}
+void var_pool_t::set(var_base_t *from)
+{
+	m_pool = POOL(from)->m_pool;
+}
+
+var_pool_task_t::var_pool_task_t(std::shared_ptr<pool_task_t> task, const size_t &src_id,
+				 const size_t &idx)
+	: var_base_t(type_id<var_pool_task_t>(), src_id, idx, false, false), m_task(task)
+{}
+
+var_base_t *var_pool_task_t::copy(const size_t &src_id, const size_t &idx)
+{
+	return new var_pool_task_t(m_task, src_id, idx);
+}
+void var_pool_task_t::set(var_base_t *from)
+{
+	m_task = POOL_TASK(from)->m_task;
+}
@@ -14,6 +14,132 @@
 #include "std/thread_type.hpp"
 #include "VM/VM.hpp"
 
+// tasks per worker that the elements are split into when no chunk size is given
+#define POOL_TASKS_PER_WORKER 4
+
+// all live pools - shut down by threads_exit() if still running when the vm exits
+static std::mutex pools_mtx;
+static std::vector<std::weak_ptr<pool_t>> pools;
+// used by the parallel_* functions, created on first use
+static std::shared_ptr<pool_t> default_pool;
+
+static std::shared_ptr<pool_t> get_default_pool()
+{
+	std::lock_guard<std::mutex> lock(pools_mtx);
+	if(!default_pool) {
+		size_t count = std::thread::hardware_concurrency();
+		default_pool.reset(new pool_t(count > 0 ? count : 1));
+		pools.push_back(default_pool);
+	}
+	return default_pool;
+}
+
+// all the elements of a vec, or of any other iterable (which is consumed), with a reference held
+static bool collect_items(vm_state_t &vm, var_base_t *from, std::vector<var_base_t *> &items,
+			  const size_t &src_id, const size_t &idx)
+{
+	if(from->istype<var_vec_t>()) {
+		std::vector<var_base_t *> &vec = VEC(from)->get();
+		items.reserve(vec.size());
+		for(auto &e : vec) {
+			var_iref(e);
+			items.push_back(e);
+		}
+		return true;
+	}
+	iter_next_fn_t next_fast = vm.get_iter_next_fn(from->type());
+	if(next_fast) {
+		var_base_t *e = nullptr;
+		while((e = next_fast(vm, from, nullptr, src_id, idx))) {
+			var_iref(e);
+			items.push_back(e);
+		}
+		return true;
+	}
+	var_base_t *next = nullptr;
+	if(from->attr_based()) next = from->attr_get("next");
+	if(next == nullptr) next = vm.get_typefn(from, "next");
+	if(next == nullptr) {
+		vm.fail(src_id, idx, "expected a vec or an iterable, found: %s",
+			vm.type_name(from).c_str());
+		return false;
+	}
+	while(true) {
+		var_base_t *e = var_call(vm, next, {from}, src_id, idx);
+		if(e == nullptr) {
+			for(auto &i : items) var_dref(i);
+			items.clear();
+			return false;
+		}
+		if(e->istype<var_nil_t>()) {
+			var_dref(e);
+			break;
+		}
+		items.push_back(e);
+	}
+	return true;
+}
+
+// splits items (whose references are taken over) into tasks of chunk elements - 0 for a few
+// tasks per worker - and waits for all of them
+// when init is given, each task folds fn over its elements starting from a copy of init
+// the tasks run right away on the calling vm if it is one of the pool's workers, since waiting
+// there could leave no worker to run them
+static bool pool_run(vm_state_t &vm, pool_t &pool, var_base_t *fn,
+		     std::vector<var_base_t *> &items, size_t chunk, var_base_t *init,
+		     std::vector<std::shared_ptr<pool_task_t>> &tasks, const size_t &src_id,
+		     const size_t &idx)
+{
+	if(chunk == 0) chunk = items.size() / (pool.size() * POOL_TASKS_PER_WORKER);
+	if(chunk == 0) chunk = 1;
+	bool in_worker = pool.in_worker();
+	for(size_t begin = 0; begin < items.size(); begin += chunk) {
+		size_t end = begin + chunk < items.size() ? begin + chunk : items.size();
+		std::vector<var_base_t *> args;
+		if(init) args.push_back(init->copy(src_id, idx));
+		args.insert(args.end(), items.begin() + begin, items.begin() + end);
+		var_iref(fn);
+		tasks.emplace_back(new pool_task_t(fn, args, 1, src_id, idx, init != nullptr));
+		if(in_worker) {
+			if(tasks.back()->run(vm)) continue;
+			for(size_t i = end; i < items.size(); ++i) var_dref(items[i]);
+			break;
+		}
+		if(!pool.submit(vm, tasks.back())) {
+			tasks.pop_back();
+			for(size_t i = end; i < items.size(); ++i) var_dref(items[i]);
+			for(auto &t : tasks) t->wait();
+			vm.fail(src_id, idx, "cannot submit to a pool which has been shut down");
+			return false;
+		}
+	}
+	var_base_t *err = nullptr;
+	for(auto &t : tasks) {
+		t->wait();
+		if(!err) err = t->err;
+	}
+	if(err) {
+		vm.fail(src_id, idx, err, "parallel function failed");
+		return false;
+	}
+	return true;
+}
+
+// results of all tasks, in order
+static var_base_t *tasks_results(std::vector<std::shared_ptr<pool_task_t>> &tasks,
+				 const size_t &count)
+{
+	std::vector<var_base_t *> res;
+	res.reserve(count);
+	for(auto &t : tasks) {
+		for(auto &r : t->res) {
+			var_iref(r);
+			res.push_back(r);
+		}
+	}
+	return make<var_vec_t>(res, false);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////// Functions ////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -105,17 +231,234 @@ var_base_t *thread_join(vm_state_t &vm, const fn_data_t &fd)
 	return fut->get().res;
 }
 
+var_base_t *pool_new_native(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_int_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected worker count to be an integer, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	if(mpz_sgn(INT(fd.args[1])->get()) <= 0) {
+		vm.fail(fd.src_id, fd.idx, "expected worker count to be greater than zero");
+		return nullptr;
+	}
+	std::shared_ptr<pool_t> pool(new pool_t(mpz_get_ui(INT(fd.args[1])->get())));
+	std::lock_guard<std::mutex> lock(pools_mtx);
+	for(size_t i = 0; i < pools.size();) {
+		if(pools[i].expired()) pools.erase(pools.begin() + i);
+		else ++i;
+	}
+	pools.push_back(pool);
+	return make<var_pool_t>(pool);
+}
+
+// the arguments are copied since the caller continues (and may modify them, like a loop
+// counter) while the function waits for a worker
+var_base_t *pool_submit(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_fn_t>()) {
+		vm.fail(fd.src_id, fd.idx,
+			"expected function to be executed as first parameter, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	std::vector<var_base_t *> args;
+	for(size_t i = 2; i < fd.args.size(); ++i) {
+		args.push_back(fd.args[i]->copy(fd.src_id, fd.idx));
+	}
+	var_iref(fd.args[1]);
+	std::shared_ptr<pool_task_t> task(
+	new pool_task_t(fd.args[1], args, args.size(), fd.src_id, fd.idx));
+	task->pool = POOL(fd.args[0])->get();
+	if(!POOL(fd.args[0])->get()->submit(vm, task)) {
+		vm.fail(fd.src_id, fd.idx, "cannot submit to a pool which has been shut down");
+		return nullptr;
+	}
+	return make<var_pool_task_t>(task);
+}
+
+var_base_t *pool_map(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_fn_t>()) {
+		vm.fail(fd.src_id, fd.idx,
+			"expected function to be executed as first parameter, found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	if(!fd.args[2]->istype<var_vec_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected a vec to map over, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	std::vector<var_base_t *> items;
+	collect_items(vm, fd.args[2], items, fd.src_id, fd.idx);
+	size_t count = items.size();
+	std::vector<std::shared_ptr<pool_task_t>> tasks;
+	if(!pool_run(vm, *POOL(fd.args[0])->get(), fd.args[1], items, 0, nullptr, tasks,
+		     fd.src_id, fd.idx))
+	{
+		return nullptr;
+	}
+	return tasks_results(tasks, count);
+}
+
+var_base_t *pool_size(vm_state_t &vm, const fn_data_t &fd)
+{
+	return make<var_int_t>(POOL(fd.args[0])->get()->size());
+}
+
+var_base_t *pool_shutdown(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::shared_ptr<pool_t> &pool = POOL(fd.args[0])->get();
+	if(pool->in_worker()) {
+		vm.fail(fd.src_id, fd.idx, "a pool cannot be shut down by one of its own workers");
+		return nullptr;
+	}
+	pool->shutdown();
+	return vm.nil;
+}
+
+var_base_t *pool_task_is_done(vm_state_t &vm, const fn_data_t &fd)
+{
+	return POOL_TASK(fd.args[0])->get()->is_done() ? vm.tru : vm.fals;
+}
+
+var_base_t *pool_task_join(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::shared_ptr<pool_task_t> &task = POOL_TASK(fd.args[0])->get();
+	// a worker blocking on a task of its own pool may be all that is left to run it
+	std::shared_ptr<pool_t> pool = task->pool.lock();
+	if(pool && pool->in_worker()) pool->run_until(vm, task.get());
+	else task->wait();
+	if(task->err) {
+		vm.fail(fd.src_id, fd.idx, task->err, "pool function failed");
+		return nullptr;
+	}
+	return task->res[0];
+}
+
+var_base_t *parallel_for_native(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[2]->istype<var_fn_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected function to be executed, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	if(!fd.args[3]->istype<var_int_t>() || mpz_sgn(INT(fd.args[3])->get()) < 0) {
+		vm.fail(fd.src_id, fd.idx, "expected chunk size to be a non negative integer");
+		return nullptr;
+	}
+	std::vector<var_base_t *> items;
+	if(!collect_items(vm, fd.args[1], items, fd.src_id, fd.idx)) return nullptr;
+	std::vector<std::shared_ptr<pool_task_t>> tasks;
+	if(!pool_run(vm, *get_default_pool(), fd.args[2], items,
+		     mpz_get_ui(INT(fd.args[3])->get()), nullptr, tasks, fd.src_id, fd.idx))
+	{
+		return nullptr;
+	}
+	return vm.nil;
+}
+
+var_base_t *parallel_map(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[2]->istype<var_fn_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected function to be executed, found: %s",
+			vm.type_name(fd.args[2]).c_str());
+		return nullptr;
+	}
+	std::vector<var_base_t *> items;
+	if(!collect_items(vm, fd.args[1], items, fd.src_id, fd.idx)) return nullptr;
+	size_t count = items.size();
+	std::vector<std::shared_ptr<pool_task_t>> tasks;
+	if(!pool_run(vm, *get_default_pool(), fd.args[2], items, 0, nullptr, tasks, fd.src_id,
+		     fd.idx))
+	{
+		return nullptr;
+	}
+	return tasks_results(tasks, count);
+}
+
+// each chunk is folded with fn(acc, elem) starting from a copy of init, and then the results of
+// the chunks are folded in order with combine(acc, chunk_result) on the calling thread
+var_base_t *parallel_reduce(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[3]->istype<var_fn_t>() || !fd.args[4]->istype<var_fn_t>()) {
+		vm.fail(fd.src_id, fd.idx,
+			"expected reduce and combine functions to be functions, found: %s, %s",
+			vm.type_name(fd.args[3]).c_str(), vm.type_name(fd.args[4]).c_str());
+		return nullptr;
+	}
+	std::vector<var_base_t *> items;
+	if(!collect_items(vm, fd.args[1], items, fd.src_id, fd.idx)) return nullptr;
+	if(items.empty()) return fd.args[2];
+	std::vector<std::shared_ptr<pool_task_t>> tasks;
+	if(!pool_run(vm, *get_default_pool(), fd.args[3], items, 0, fd.args[2], tasks, fd.src_id,
+		     fd.idx))
+	{
+		return nullptr;
+	}
+	var_base_t *res = tasks[0]->res[0];
+	var_iref(res);
+	for(size_t i = 1; i < tasks.size(); ++i) {
+		var_base_t *next = var_call(vm, fd.args[4], {nullptr, res, tasks[i]->res[0]},
+					    fd.src_id, fd.idx);
+		var_dref(res);
+		if(next == nullptr) {
+			vm.fail(fd.src_id, fd.idx, "parallel combine function failed");
+			return nullptr;
+		}
+		res = next;
+	}
+	// the tasks may hold the last other reference to res
+	tasks.clear();
+	res->dref();
+	return res;
+}
+
+// workers use the vm (typefns, sources) - finish everything while it is still intact
+void threads_exit(vm_state_t &vm)
+{
+	std::vector<std::shared_ptr<pool_t>> live;
+	{
+		std::lock_guard<std::mutex> lock(pools_mtx);
+		for(auto &p : pools) {
+			std::shared_ptr<pool_t> pool = p.lock();
+			if(pool) live.push_back(pool);
+		}
+		pools.clear();
+		default_pool.reset();
+	}
+	for(auto &pool : live) pool->shutdown();
+}
+
 INIT_MODULE(threads)
 {
 	var_src_t *src = vm.current_source();
 
 	src->add_native_fn("max", threads_max, 0);
 	src->add_native_fn("new", threads_new, 1);
+	src->add_native_fn("pool_native", pool_new_native, 1);
+	src->add_native_fn("parallel_for_native", parallel_for_native, 3);
+	src->add_native_fn("parallel_map", parallel_map, 2);
+	src->add_native_fn("parallel_reduce", parallel_reduce, 4);
 
 	vm.add_native_typefn<var_thread_t>("start", thread_start, 0, src_id, idx, true);
 	vm.add_native_typefn<var_thread_t>("id", thread_get_id, 0, src_id, idx);
 	vm.add_native_typefn<var_thread_t>("done", thread_is_done, 0, src_id, idx);
 	vm.add_native_typefn<var_thread_t>("join", thread_join, 0, src_id, idx);
 
+	vm.register_type<var_pool_t>("pool", src_id, idx);
+	vm.register_type<var_pool_task_t>("pool_task", src_id, idx);
+
+	vm.add_native_typefn<var_pool_t>("submit", pool_submit, 1, src_id, idx, true);
+	vm.add_native_typefn<var_pool_t>("map", pool_map, 2, src_id, idx);
+	vm.add_native_typefn<var_pool_t>("size", pool_size, 0, src_id, idx);
+	vm.add_native_typefn<var_pool_t>("shutdown", pool_shutdown, 0, src_id, idx);
+
+	vm.add_native_typefn<var_pool_task_t>("done", pool_task_is_done, 0, src_id, idx);
+	vm.add_native_typefn<var_pool_task_t>("join", pool_task_join, 0, src_id, idx);
+
+	vm.add_exit_fn(threads_exit);
+
 	return true;
 }
\ No newline at end of file
@@ -11,6 +11,9 @@
 	furnished to do so.
 */
 
+#include <algorithm>
+#include <thread>
+
 #include "std/vec_type.hpp"
 #include "VM/VM.hpp"
 
@@ -219,6 +222,14 @@ var_base_t *vec_iterable_next(vm_state_t &vm, const fn_data_t &fd)
 	return res;
 }
 
+var_base_t *vec_iterable_next_fast(vm_state_t &vm, var_base_t *iterable, var_base_t *reuse,
+				   const size_t &src_id, const size_t &idx)
+{
+	var_base_t *res = nullptr;
+	if(!VEC_ITERABLE(iterable)->next(res)) return nullptr;
+	return res;
+}
+
 var_base_t *vec_sub(vm_state_t &vm, const fn_data_t &fd)
 {
 	if(!fd.args[1]->istype<var_int_t>()) {
@@ -274,6 +285,542 @@ var_base_t *vec_slice(vm_state_t &vm, const fn_data_t &fd)
 	return make<var_vec_t>(newvec, true);
 }
 
+// string form of the elements separated by sep (empty if not given)
+var_base_t *vec_join(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(fd.args.size() > 2) {
+		vm.fail(fd.src_id, fd.idx, "expected at most one argument for vec.join(), found: %zu",
+			fd.args.size() - 1);
+		return nullptr;
+	}
+	if(fd.args.size() > 1 && !fd.args[1]->istype<var_str_t>()) {
+		vm.fail(fd.src_id, fd.idx, "expected separator to be of type 'str', found: %s",
+			vm.type_name(fd.args[1]).c_str());
+		return nullptr;
+	}
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	var_str_t *res		       = make<var_str_t>("");
+	std::string &str	       = res->get();
+	for(size_t i = 0; i < vec.size(); ++i) {
+		if(i > 0 && fd.args.size() > 1) str += STR(fd.args[1])->get();
+		if(!vec[i]->append_str(vm, str, fd.src_id, fd.idx)) {
+			delete res;
+			return nullptr;
+		}
+	}
+	return res;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////// Ordering ////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// vectors at least this large are sorted using all cpus when their elements can be compared
+// natively (without calling feral functions)
+#define PARALLEL_SORT_MIN 65536
+// runs of this many elements are insertion sorted before being merged
+#define SORT_RUN 16
+
+// calls the operator function 'name' of lhs with rhs and converts the result to bool
+static bool call_op(vm_state_t &vm, var_base_t *lhs, const char *name, var_base_t *rhs,
+		    bool &res, const size_t &src_id, const size_t &idx)
+{
+	var_base_t *fn = nullptr;
+	if(lhs->attr_based()) fn = lhs->attr_get(name);
+	if(fn == nullptr) fn = vm.get_typefn(lhs, name);
+	if(!fn) {
+		vm.fail(src_id, idx, "no '%s' function implemented for type: %s", name,
+			vm.type_name(lhs).c_str());
+		return false;
+	}
+	var_base_t *r = var_call(vm, fn, {lhs, rhs}, src_id, idx);
+	if(!r) return false;
+	bool ok = r->to_bool(vm, res, src_id, idx);
+	var_dref(r);
+	return ok;
+}
+
+// builtin types are compared without calling their typefns
+static bool elem_eq(vm_state_t &vm, var_base_t *a, var_base_t *b, bool &res,
+		    const size_t &src_id, const size_t &idx)
+{
+	if(a->type() == b->type()) {
+		if(a->istype<var_int_t>()) {
+			res = mpz_cmp(INT(a)->get(), INT(b)->get()) == 0;
+			return true;
+		} else if(a->istype<var_str_t>()) {
+			res = STR(a)->get() == STR(b)->get();
+			return true;
+		} else if(a->istype<var_flt_t>()) {
+			res = mpfr_cmp(FLT(a)->get(), FLT(b)->get()) == 0;
+			return true;
+		} else if(a->istype<var_bool_t>()) {
+			res = BOOL(a)->get() == BOOL(b)->get();
+			return true;
+		} else if(a->istype<var_nil_t>()) {
+			res = true;
+			return true;
+		}
+	}
+	return call_op(vm, a, "==", b, res, src_id, idx);
+}
+
+struct less_int_t
+{
+	inline bool operator()(var_base_t *a, var_base_t *b)
+	{
+		return mpz_cmp(INT(a)->get(), INT(b)->get()) < 0;
+	}
+};
+struct less_flt_t
+{
+	inline bool operator()(var_base_t *a, var_base_t *b)
+	{
+		return mpfr_cmp(FLT(a)->get(), FLT(b)->get()) < 0;
+	}
+};
+struct less_str_t
+{
+	inline bool operator()(var_base_t *a, var_base_t *b)
+	{
+		return STR(a)->get() < STR(b)->get();
+	}
+};
+
+// compares using the comparator function cmp(a, b) (true if a is ordered before b), or the
+// '<' operator of the elements if cmp is nullptr
+// once a comparison fails, all further ones (by any copy) return false without calling anything
+struct less_vm_t
+{
+	vm_state_t *vm;
+	var_base_t *cmp;
+	size_t src_id;
+	size_t idx;
+	bool *failed;
+
+	bool operator()(var_base_t *a, var_base_t *b)
+	{
+		if(*failed) return false;
+		bool res = false;
+		if(cmp == nullptr) {
+			if(a->type() == b->type()) {
+				if(a->istype<var_int_t>()) return less_int_t()(a, b);
+				if(a->istype<var_flt_t>()) return less_flt_t()(a, b);
+				if(a->istype<var_str_t>()) return less_str_t()(a, b);
+			}
+			if(!call_op(*vm, a, "<", b, res, src_id, idx)) *failed = true;
+			return res;
+		}
+		var_base_t *r = var_call(*vm, cmp, {nullptr, a, b}, src_id, idx);
+		if(!r || !r->to_bool(*vm, res, src_id, idx)) *failed = true;
+		if(r) var_dref(r);
+		return res;
+	}
+};
+
+template<typename Less> struct greater_t
+{
+	Less less;
+	inline bool operator()(var_base_t *a, var_base_t *b)
+	{
+		return less(b, a);
+	}
+};
+
+// sorted items are either the elements themselves, or elements with their precomputed
+// sort key (for sort(key = fn))
+template<typename Less> struct elem_less_t
+{
+	Less less;
+	inline bool operator()(var_base_t *a, var_base_t *b)
+	{
+		return less(a, b);
+	}
+};
+struct keyed_t
+{
+	var_base_t *key;
+	var_base_t *val;
+};
+template<typename Less> struct keyed_less_t
+{
+	Less less;
+	inline bool operator()(const keyed_t &a, const keyed_t &b)
+	{
+		return less(a.key, b.key);
+	}
+};
+
+template<typename T, typename Less> static void insertion_sort(T *a, const size_t &n, Less &less)
+{
+	for(size_t i = 1; i < n; ++i) {
+		T x	 = a[i];
+		size_t j = i;
+		for(; j > 0 && less(x, a[j - 1]); --j) a[j] = a[j - 1];
+		a[j] = x;
+	}
+}
+
+// merges the sorted ranges [0, mid) and [mid, n) of a, buf must hold at least mid items
+// items of the left range go first when equal, which keeps the sort stable
+template<typename T, typename Less>
+static void merge(T *a, const size_t &mid, const size_t &n, T *buf, Less &less)
+{
+	if(!less(a[mid], a[mid - 1])) return;
+	std::copy(a, a + mid, buf);
+	size_t i = 0, j = mid, k = 0;
+	while(i < mid && j < n) a[k++] = less(a[j], buf[i]) ? a[j++] : buf[i++];
+	while(i < mid) a[k++] = buf[i++];
+}
+
+template<typename T, typename Less>
+static void merge_sort(T *a, const size_t &n, T *buf, Less &less)
+{
+	for(size_t i = 0; i < n; i += SORT_RUN) {
+		insertion_sort(a + i, std::min<size_t>(SORT_RUN, n - i), less);
+	}
+	for(size_t w = SORT_RUN; w < n; w *= 2) {
+		for(size_t i = 0; i + w < n; i += 2 * w) {
+			merge(a + i, w, std::min(2 * w, n - i), buf + i, less);
+		}
+	}
+}
+
+// chunks are sorted by separate threads, then merged pairwise with each level of merges
+// also spread over threads - less must not use the vm
+template<typename T, typename Less>
+static void parallel_merge_sort(T *a, const size_t &n, T *buf, Less &less, const size_t &threads)
+{
+	size_t chunk = (n + threads - 1) / threads;
+	std::vector<std::thread> workers;
+	for(size_t i = 0; i < n; i += chunk) {
+		size_t len = std::min(chunk, n - i);
+		workers.emplace_back([=, &less]() { merge_sort(a + i, len, buf + i, less); });
+	}
+	for(auto &t : workers) t.join();
+	for(size_t w = chunk; w < n; w *= 2) {
+		workers.clear();
+		for(size_t i = 0; i + w < n; i += 2 * w) {
+			size_t len = std::min(2 * w, n - i);
+			workers.emplace_back([=, &less]() { merge(a + i, w, len, buf + i, less); });
+		}
+		for(auto &t : workers) t.join();
+	}
+}
+
+template<typename T, typename Less>
+static void sort_items(std::vector<T> &items, Less less, const bool &parallel)
+{
+	if(items.size() < 2) return;
+	std::vector<T> buf(items.size());
+	size_t threads = std::thread::hardware_concurrency();
+	if(parallel && items.size() >= PARALLEL_SORT_MIN && threads > 1) {
+		parallel_merge_sort(items.data(), items.size(), buf.data(), less, threads);
+	} else {
+		merge_sort(items.data(), items.size(), buf.data(), less);
+	}
+}
+
+template<template<typename> class Proj, typename T, typename Less>
+static void sort_dir(std::vector<T> &items, const Less &less, const bool &desc,
+		     const bool &parallel)
+{
+	if(desc) sort_items(items, Proj<greater_t<Less>>{greater_t<Less>{less}}, parallel);
+	else sort_items(items, Proj<Less>{less}, parallel);
+}
+
+// comparator usable for all of the (key) values
+enum SortKind
+{
+	SK_INT,
+	SK_FLT,
+	SK_STR,
+	SK_VM,
+};
+
+template<typename T, typename Get> static SortKind sort_kind(const std::vector<T> &items, Get get)
+{
+	if(items.empty()) return SK_VM;
+	std::uintptr_t type = get(items[0])->type();
+	for(auto &e : items) {
+		if(get(e)->type() != type) return SK_VM;
+	}
+	if(type == type_id<var_int_t>()) return SK_INT;
+	if(type == type_id<var_flt_t>()) return SK_FLT;
+	if(type == type_id<var_str_t>()) return SK_STR;
+	return SK_VM;
+}
+
+// builtin types are compared natively, possibly using multiple threads, everything else
+// with the vm comparator
+template<template<typename> class Proj, typename T>
+static bool sort_kind_dispatch(std::vector<T> &items, const SortKind &kind, const less_vm_t &vmless,
+			       const bool &desc)
+{
+	switch(kind) {
+	case SK_INT: sort_dir<Proj>(items, less_int_t(), desc, true); return true;
+	case SK_FLT: sort_dir<Proj>(items, less_flt_t(), desc, true); return true;
+	case SK_STR: sort_dir<Proj>(items, less_str_t(), desc, true); return true;
+	default: break;
+	}
+	sort_dir<Proj>(items, vmless, desc, false);
+	return !*vmless.failed;
+}
+
+static inline var_base_t *elem_of(var_base_t *e)
+{
+	return e;
+}
+static inline var_base_t *key_of(const keyed_t &e)
+{
+	return e.key;
+}
+
+// sort([cmp], key = fn) - cmp(a, b) returns true if a goes before b
+// key(a) is called once for each element and the results are compared instead of elements
+static var_base_t *vec_sort_impl(vm_state_t &vm, const fn_data_t &fd, const bool &desc)
+{
+	var_base_t *cmp = fd.args.size() > 1 ? fd.args[1] : nullptr;
+	var_base_t *key = nullptr;
+	if(fd.assn_args_loc.find("key") != fd.assn_args_loc.end()) {
+		key = fd.assn_args[fd.assn_args_loc.at("key")].val;
+	}
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	bool failed		       = false;
+	less_vm_t vmless	       = {&vm, cmp, fd.src_id, fd.idx, &failed};
+
+	// no feral code is run for builtin elements, so they are sorted in place
+	if(key == nullptr && cmp == nullptr) {
+		SortKind kind = sort_kind(vec, elem_of);
+		if(kind != SK_VM) {
+			sort_kind_dispatch<elem_less_t>(vec, kind, vmless, desc);
+			return fd.args[0];
+		}
+	}
+
+	// otherwise cmp, key or the '<' of the elements may modify the vec while it is sorted, so
+	// a copy is sorted instead (keeping the elements alive) and written back only if the vec
+	// is still the same afterwards
+	std::vector<var_base_t *> orig(vec);
+	for(auto &e : orig) var_iref(e);
+	std::vector<var_base_t *> elems;
+	std::vector<keyed_t> items;
+	if(key == nullptr) {
+		elems = orig;
+		if(!sort_kind_dispatch<elem_less_t>(elems, SK_VM, vmless, desc)) failed = true;
+	} else {
+		items.reserve(orig.size());
+		for(auto &e : orig) {
+			var_base_t *k = var_call(vm, key, {nullptr, e}, fd.src_id, fd.idx);
+			if(!k) {
+				failed = true;
+				break;
+			}
+			items.push_back({k, e});
+		}
+		if(!failed) {
+			SortKind kind = cmp ? SK_VM : sort_kind(items, key_of);
+			if(!sort_kind_dispatch<keyed_less_t>(items, kind, vmless, desc)) failed = true;
+		}
+	}
+	if(!failed && vec != orig) {
+		vm.fail(fd.src_id, fd.idx, "vec was modified while being sorted");
+		failed = true;
+	}
+	if(!failed && key == nullptr) vec = elems;
+	if(!failed && key != nullptr) {
+		for(size_t i = 0; i < items.size(); ++i) vec[i] = items[i].val;
+	}
+	for(auto &i : items) var_dref(i.key);
+	for(auto &e : orig) var_dref(e);
+	return failed ? nullptr : fd.args[0];
+}
+
+var_base_t *vec_sort(vm_state_t &vm, const fn_data_t &fd)
+{
+	return vec_sort_impl(vm, fd, false);
+}
+
+var_base_t *vec_sort_desc(vm_state_t &vm, const fn_data_t &fd)
+{
+	return vec_sort_impl(vm, fd, true);
+}
+
+// index of the first element which is not ordered before x (vector must be sorted)
+static bool lower_bound(vm_state_t &vm, const fn_data_t &fd, size_t &pos)
+{
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	var_base_t *x		       = fd.args[1];
+	bool failed		       = false;
+	less_vm_t less		       = {&vm, fd.args.size() > 2 ? fd.args[2] : nullptr, fd.src_id,
+				  fd.idx, &failed};
+	size_t len = vec.size();
+	size_t lo = 0, hi = len;
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if(less(vec[mid], x)) lo = mid + 1;
+		else hi = mid;
+		if(failed) return false;
+		if(vec.size() != len) {
+			vm.fail(fd.src_id, fd.idx, "vec was modified while being searched");
+			return false;
+		}
+	}
+	pos = lo;
+	return true;
+}
+
+var_base_t *vec_lower_bound(vm_state_t &vm, const fn_data_t &fd)
+{
+	size_t pos;
+	if(!lower_bound(vm, fd, pos)) return nullptr;
+	return make<var_int_t>(pos);
+}
+
+var_base_t *vec_binary_search(vm_state_t &vm, const fn_data_t &fd)
+{
+	size_t pos;
+	if(!lower_bound(vm, fd, pos)) return nullptr;
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	if(pos == vec.size()) return vm.fals;
+	// found if x is not ordered before vec[pos] either
+	bool failed    = false;
+	less_vm_t less = {&vm, fd.args.size() > 2 ? fd.args[2] : nullptr, fd.src_id, fd.idx,
+			  &failed};
+	bool before    = less(fd.args[1], vec[pos]);
+	if(failed) return nullptr;
+	return before ? vm.fals : vm.tru;
+}
+
+// stable - elements for which pred(e) is true are moved before the others
+// returns the index of the first element for which pred(e) is false
+// the vector is not modified if pred fails
+var_base_t *vec_partition(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	std::vector<bool> preds(vec.size());
+	for(size_t i = 0; i < vec.size(); ++i) {
+		var_base_t *r = var_call(vm, fd.args[1], {nullptr, vec[i]}, fd.src_id, fd.idx);
+		bool res      = false;
+		bool ok	      = r && r->to_bool(vm, res, fd.src_id, fd.idx);
+		if(r) var_dref(r);
+		if(!ok) return nullptr;
+		if(vec.size() != preds.size()) {
+			vm.fail(fd.src_id, fd.idx, "vec was modified while being partitioned");
+			return nullptr;
+		}
+		preds[i] = res;
+	}
+	std::vector<var_base_t *> no;
+	size_t yes = 0;
+	for(size_t i = 0; i < vec.size(); ++i) {
+		if(preds[i]) vec[yes++] = vec[i];
+		else no.push_back(vec[i]);
+	}
+	std::copy(no.begin(), no.end(), vec.begin() + yes);
+	return make<var_int_t>(yes);
+}
+
+// removes consecutive equal elements
+var_base_t *vec_unique(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	if(vec.empty()) return fd.args[0];
+	// like sort, the '==' of the elements may modify the vec, so the duplicates are found in a
+	// copy (keeping the elements alive) and removed only if the vec is still the same afterwards
+	std::vector<var_base_t *> orig(vec);
+	for(auto &e : orig) var_iref(e);
+	std::vector<bool> dup(orig.size(), false);
+	bool failed = false;
+	size_t last = 0;
+	for(size_t i = 1; i < orig.size(); ++i) {
+		bool eq = false;
+		if(!elem_eq(vm, orig[last], orig[i], eq, fd.src_id, fd.idx)) {
+			failed = true;
+			break;
+		}
+		if(eq) dup[i] = true;
+		else last = i;
+	}
+	if(!failed && vec != orig) {
+		vm.fail(fd.src_id, fd.idx, "vec was modified while being made unique");
+		failed = true;
+	}
+	if(!failed) {
+		vec.clear();
+		for(size_t i = 0; i < orig.size(); ++i) {
+			if(dup[i]) var_dref(orig[i]);
+			else vec.push_back(orig[i]);
+		}
+	}
+	for(auto &e : orig) var_dref(e);
+	return failed ? nullptr : fd.args[0];
+}
+
+var_base_t *vec_reverse(vm_state_t &vm, const fn_data_t &fd)
+{
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	std::reverse(vec.begin(), vec.end());
+	return fd.args[0];
+}
+
+// index of the first element equal to x, vec.size() if there is none
+static bool find_pos(vm_state_t &vm, const fn_data_t &fd, size_t &pos)
+{
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	for(pos = 0; pos < vec.size(); ++pos) {
+		bool eq = false;
+		if(!elem_eq(vm, vec[pos], fd.args[1], eq, fd.src_id, fd.idx)) return false;
+		if(eq) break;
+	}
+	return true;
+}
+
+var_base_t *vec_find(vm_state_t &vm, const fn_data_t &fd)
+{
+	size_t pos;
+	if(!find_pos(vm, fd, pos)) return nullptr;
+	return pos < VEC(fd.args[0])->get().size() ? vm.tru : vm.fals;
+}
+
+// returns true if element is found in the list (and removed), else false
+var_base_t *vec_rem(vm_state_t &vm, const fn_data_t &fd)
+{
+	size_t pos;
+	if(!find_pos(vm, fd, pos)) return nullptr;
+	std::vector<var_base_t *> &vec = VEC(fd.args[0])->get();
+	if(pos == vec.size()) return vm.fals;
+	var_dref(vec[pos]);
+	vec.erase(vec.begin() + pos);
+	return vm.tru;
+}
+
+var_base_t *vec_eq(vm_state_t &vm, const fn_data_t &fd)
+{
+	if(!fd.args[1]->istype<var_vec_t>()) return vm.fals;
+	std::vector<var_base_t *> &lhs = VEC(fd.args[0])->get();
+	std::vector<var_base_t *> &rhs = VEC(fd.args[1])->get();
+	size_t len = lhs.size();
+	if(rhs.size() != len) return vm.fals;
+	for(size_t i = 0; i < len; ++i) {
+		// the '==' of the elements may modify either vec, so both stay alive during the call
+		var_base_t *l = lhs[i], *r = rhs[i];
+		var_iref(l);
+		var_iref(r);
+		bool eq = false;
+		bool ok = elem_eq(vm, l, r, eq, fd.src_id, fd.idx);
+		var_dref(l);
+		var_dref(r);
+		if(!ok) return nullptr;
+		if(lhs.size() != len || rhs.size() != len) {
+			vm.fail(fd.src_id, fd.idx, "vec was modified while being compared");
+			return nullptr;
+		}
+		if(!eq) return vm.fals;
+	}
+	return vm.tru;
+}
+
 INIT_MODULE(vec)
 {
 	var_src_t *src = vm.current_source();
@@ -296,10 +843,23 @@ INIT_MODULE(vec)
 	vm.add_native_typefn<var_vec_t>("[]", vec_at, 1, src_id, idx);
 	vm.add_native_typefn<var_vec_t>("each", vec_each, 0, src_id, idx);
 
+	vm.add_native_typefn<var_vec_t>("==", vec_eq, 1, src_id, idx);
+	vm.add_native_typefn<var_vec_t>("find", vec_find, 1, src_id, idx);
+	vm.add_native_typefn<var_vec_t>("rem", vec_rem, 1, src_id, idx);
+	vm.add_native_typefn<var_vec_t>("sort", vec_sort, 0, src_id, idx, true);
+	vm.add_native_typefn<var_vec_t>("sort_desc", vec_sort_desc, 0, src_id, idx, true);
+	vm.add_native_typefn<var_vec_t>("lower_bound", vec_lower_bound, 1, src_id, idx, true);
+	vm.add_native_typefn<var_vec_t>("binary_search", vec_binary_search, 1, src_id, idx, true);
+	vm.add_native_typefn<var_vec_t>("partition", vec_partition, 1, src_id, idx);
+	vm.add_native_typefn<var_vec_t>("unique", vec_unique, 0, src_id, idx);
+	vm.add_native_typefn<var_vec_t>("reverse", vec_reverse, 0, src_id, idx);
+	vm.add_native_typefn<var_vec_t>("join", vec_join, 0, src_id, idx, true);
+
 	vm.add_native_typefn<var_vec_t>("sub_native", vec_sub, 2, src_id, idx);
 	vm.add_native_typefn<var_vec_t>("slice_native", vec_slice, 2, src_id, idx);
 
 	vm.add_native_typefn<var_vec_iterable_t>("next", vec_iterable_next, 0, src_id, idx);
+	vm.set_iter_next_fn<var_vec_iterable_t>(vec_iterable_next_fast);
 
 	return true;
 }